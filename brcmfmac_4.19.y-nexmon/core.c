@@ -45,6 +45,8 @@
 #include <linux/if_arp.h>
 #include <linux/netlink.h>
 #include "nexmon_ioctls.h"
+#include "csi.h"
+#include "nexmon_csi.h"
 
 #define MAX_WAIT_FOR_8021X_TX			msecs_to_jiffies(950)
 
@@ -53,6 +55,7 @@
 /* Nexmon */
 #define NETLINK_USER                     31
 #define NEXUDP_IOCTL                      0
+#define NEXUDP_IOCTL_BATCH                1
 
 #define MONITOR_DISABLED  0
 #define MONITOR_IEEE80211 1
@@ -79,55 +82,138 @@ static struct net_device *ndev_global = NULL;
     char payload[1];
 } __attribute__((packed));
 
+ /* NEXUDP_IOCTL_BATCH: several ioctls in one message, the reply is the same
+  * message with status set and the data of the get ioctls filled in */
+ struct nexudp_ioctl_entry {
+    unsigned int cmd;
+    unsigned short set;
+    unsigned short len;     /* payload bytes, the entry is padded to 4 bytes */
+    int status;             /* result of the ioctl, set in the reply */
+    char payload[0];
+} __attribute__((packed));
+
+ struct nexudp_ioctl_batch_header {
+    struct nexudp_header nexudphdr;
+    unsigned int n_entries; /* in the reply: entries that were run */
+    struct nexudp_ioctl_entry entries[0];
+} __attribute__((packed));
+
+ /* answer ioctls without calling the firmware, to measure the netlink path */
+static bool nexmon_nl_dry_run;
+module_param_named(nl_dry_run, nexmon_nl_dry_run, bool, 0600);
+MODULE_PARM_DESC(nl_dry_run, "Do not pass nexmon netlink ioctls to the firmware");
+
+ static s32
+nexmon_nl_ioctl(struct brcmf_if *ifp, u32 cmd, bool set, void *buf, u32 len)
+{
+    brcmf_dbg(FIL, "NEXMON: cmd: %u, set: %d, len: %u\n", cmd, set, len);
+
+     if (nexmon_nl_dry_run)
+        return 0;
+    if (set)
+        return brcmf_fil_cmd_data_set(ifp, cmd, buf, len);
+    return brcmf_fil_cmd_data_get(ifp, cmd, buf, len);
+}
+
+ /* the request is turned into the reply in place, so no reply is allocated or copied:
+  * a get ioctl writes its data into the request, a set is answered with "ACK" */
  static void
-nexmon_nl_ioctl_handler(struct sk_buff *skb)
+nexmon_nl_ioctl_single(struct brcmf_if *ifp, struct sk_buff *skb)
 {
-    struct nlmsghdr *nlh = (struct nlmsghdr *) skb->data;
+    struct nlmsghdr *nlh = nlmsg_hdr(skb);
     struct nexudp_ioctl_header *frame = (struct nexudp_ioctl_header *) nlmsg_data(nlh);
-    struct brcmf_if *ifp = netdev_priv(ndev_global);
-    struct sk_buff *skb_out;
-    struct nlmsghdr *nlh_tx;
+    u32 len = nlmsg_len(nlh) - offsetof(struct nexudp_ioctl_header, payload);
+    u32 portid = nlh->nlmsg_pid;
 
-     brcmf_err("NEXMON: %s: Enter\n", __FUNCTION__);
-
-     brcmf_err("NEXMON: %s: %08x %d %d\n", __FUNCTION__, *(int *) frame->nexudphdr.nex, nlmsg_len(nlh), skb->len);
+     nexmon_nl_ioctl(ifp, frame->cmd, frame->set, frame->payload, len);
+    if (frame->set) {
+        memcpy(nlmsg_data(nlh), "ACK", 4);
+        nlh->nlmsg_len = nlmsg_msg_size(4);
+    }
+    skb_trim(skb, min_t(u32, skb->len, nlmsg_total_size(nlmsg_len(nlh))));
+    nlh->nlmsg_type = NLMSG_DONE;
+    nlh->nlmsg_flags = 0;
+    nlh->nlmsg_seq = 0;
+    nlh->nlmsg_pid = 0;
+
+     /* the request belongs to the kernel socket until the handler returns, netlink_unicast takes an
+      * unowned reference and clones it for the receiver */
+    skb_orphan(skb);
+    NETLINK_CB(skb).portid = 0;
+    NETLINK_CB(skb).dst_group = 0; /* not in mcast group */
+    nlmsg_unicast(nl_sock, skb_get(skb), portid);
+}
 
-     if (memcmp(frame->nexudphdr.nex, "NEX", 3)) {
-        brcmf_err("NEXMON: %s: invalid nexudp_ioctl_header\n", __FUNCTION__);
+ static void
+nexmon_nl_ioctl_batch(struct brcmf_if *ifp, struct nlmsghdr *nlh)
+{
+    struct nexudp_ioctl_batch_header *batch;
+    struct nexudp_ioctl_entry *entry;
+    struct sk_buff *skb_out;
+    struct nlmsghdr *nlh_tx;
+    u32 len = nlmsg_len(nlh);
+    u32 off = sizeof(*batch);
+    u32 i, size;
+
+     /* one reply for all entries, the ioctls work on it in place */
+    skb_out = nlmsg_new(len, GFP_KERNEL);
+    if (!skb_out) {
+        brcmf_err("NEXMON: no memory for the reply\n");
         return;
     }
+    nlh_tx = nlmsg_put(skb_out, 0, nlh->nlmsg_seq, NLMSG_DONE, len, 0);
+    NETLINK_CB(skb_out).dst_group = 0; /* not in mcast group */
+    batch = memcpy(nlmsg_data(nlh_tx), nlmsg_data(nlh), len);
+
+     for (i = 0; i < batch->n_entries; i++) {
+        if (len - off < sizeof(*entry))
+            break;
+        entry = (struct nexudp_ioctl_entry *) ((char *) batch + off);
+        size = ALIGN(entry->len, 4);
+        if (len - off - sizeof(*entry) < size)
+            break;
+        entry->status = nexmon_nl_ioctl(ifp, entry->cmd, entry->set, entry->payload, entry->len);
+        off += sizeof(*entry) + size;
+    }
+    if (i < batch->n_entries)
+        brcmf_err("NEXMON: batch truncated after %u of %u entries\n", i, batch->n_entries);
+    batch->n_entries = i;
+
+     nlmsg_unicast(nl_sock, skb_out, nlh->nlmsg_pid);
+}
+
+ /* errors are rate limited by brcmf_err, the trace of every ioctl is enabled with debug bit FIL (0x1000) */
+ static void
+nexmon_nl_ioctl_handler(struct sk_buff *skb)
+{
+    struct nlmsghdr *nlh = (struct nlmsghdr *) skb->data;
+    struct nexudp_header *hdr = (struct nexudp_header *) nlmsg_data(nlh);
+    struct brcmf_if *ifp;
 
-     if (frame->nexudphdr.type != NEXUDP_IOCTL) {
-        brcmf_err("NEXMON: %s: invalid frame type\n", __FUNCTION__);
+     if (nlmsg_len(nlh) < sizeof(struct nexudp_header) || memcmp(hdr->nex, "NEX", 3)) {
+        brcmf_err("NEXMON: invalid nexudp_ioctl_header\n");
         return;
     }
 
-     if (ifp == NULL) {
-        brcmf_err("NEXMON: %s: ifp is NULL\n", __FUNCTION__);
+     if (ndev_global == NULL) {
+        brcmf_err("NEXMON: no interface\n");
         return;
     }
-
-     if (frame->set) {
-        brcmf_err("NEXMON: %s: calling brcmf_fil_cmd_data_set, cmd: %d\n", __FUNCTION__, frame->cmd);
-        brcmf_fil_cmd_data_set(ifp, frame->cmd, frame->payload, nlmsg_len(nlh) - sizeof(struct nexudp_ioctl_header) + sizeof(char));
-
-         skb_out = nlmsg_new(4, 0);
-        nlh_tx = nlmsg_put(skb_out, 0, 0, NLMSG_DONE, 4, 0);
-        NETLINK_CB(skb_out).dst_group = 0; /* not in mcast group */
-        memcpy(nlmsg_data(nlh_tx), "ACK", 4);
-        nlmsg_unicast(nl_sock, skb_out, nlh->nlmsg_pid);
-    } else {
-        brcmf_err("NEXMON: %s: calling brcmf_fil_cmd_data_get, cmd: %d\n", __FUNCTION__, frame->cmd);
-        brcmf_fil_cmd_data_get(ifp, frame->cmd, frame->payload, nlmsg_len(nlh) - sizeof(struct nexudp_ioctl_header) + sizeof(char));
-
-         skb_out = nlmsg_new(nlmsg_len(nlh), 0);
-        nlh_tx = nlmsg_put(skb_out, 0, 0, NLMSG_DONE, nlmsg_len(nlh), 0);
-        NETLINK_CB(skb_out).dst_group = 0; /* not in mcast group */
-        memcpy(nlmsg_data(nlh_tx), frame, nlmsg_len(nlh));
-        nlmsg_unicast(nl_sock, skb_out, nlh->nlmsg_pid);
+    ifp = netdev_priv(ndev_global);
+
+     switch (hdr->type) {
+        case NEXUDP_IOCTL:
+            if (nlmsg_len(nlh) < offsetof(struct nexudp_ioctl_header, payload))
+                break;
+            nexmon_nl_ioctl_single(ifp, skb);
+            return;
+        case NEXUDP_IOCTL_BATCH:
+            if (nlmsg_len(nlh) < sizeof(struct nexudp_ioctl_batch_header))
+                break;
+            nexmon_nl_ioctl_batch(ifp, nlh);
+            return;
     }
-
-     brcmf_err("NEXMON: %s: Exit\n", __FUNCTION__);
+    brcmf_err("NEXMON: invalid frame type %d or length %d\n", hdr->type, nlmsg_len(nlh));
 }
 
 
@@ -482,6 +568,10 @@ void brcmf_netif_rx(struct brcmf_if *ifp, struct sk_buff *skb)
 	ifp->ndev->stats.rx_bytes += skb->len;
 	ifp->ndev->stats.rx_packets++;
 
+	/* NEXMON: csi frames go to the csi ring while it is open */
+	if (brcmf_csi_rx(ifp, skb))
+		return;
+
 	brcmf_dbg(DATA, "rx proto=0x%X\n", ntohs(skb->protocol));
 	if (in_interrupt())
 		netif_rx(skb);
@@ -1201,6 +1291,12 @@ static int brcmf_bus_started(struct brcmf_pub *drvr, struct cfg80211_ops *ops)
 	brcmf_feat_debugfs_create(drvr);
 	brcmf_proto_debugfs_create(drvr);
 	brcmf_sdio_debugfs_create(drvr->bus_if->bus_priv.sdio->bus);
+	brcmf_csi_debugfs_create(drvr);
+
+	/* NEXMON: csi ring, the interface also works without it */
+	ret = brcmf_csi_attach(drvr);
+	if (ret)
+		brcmf_err("NEXMON: csi ring not available: %d\n", ret);
 
 	return 0;
 
@@ -1351,6 +1447,9 @@ void brcmf_detach(struct device *dev)
 
 	brcmf_bus_stop(drvr->bus_if);
 
+	/* NEXMON: no more rx after the bus is stopped */
+	brcmf_csi_detach(drvr);
+
 	brcmf_proto_detach_post_delif(drvr);
 
 	bus_if->drvr = NULL;
@@ -1432,20 +1531,19 @@ int __init brcmf_core_init(void)
 
 	/* NEXMON netlink init */
 	cfg.input = nexmon_nl_ioctl_handler;
+	cfg.groups = NEXMON_NL_GRP_MAX;
 	nl_sock = netlink_kernel_create(&init_net, NETLINK_USER, &cfg);
 	if (!nl_sock) {
 		brcmf_err("NEXMON: %s: Error creating netlink socket\n", __FUNCTION__);
 		return -1;
 	}
+	brcmf_csi_nl_init(nl_sock);
 
 	return 0;
 }
 
 void __exit brcmf_core_exit(void)
 {
-	/*NEXMON netlink */
-	netlink_kernel_release(nl_sock);
-	
 	cancel_work_sync(&brcmf_driver_work);
 
 #ifdef CONFIG_BRCMFMAC_SDIO
@@ -1457,5 +1555,9 @@ void __exit brcmf_core_exit(void)
 #ifdef CONFIG_BRCMFMAC_PCIE
 	brcmf_pcie_exit();
 #endif
+
+	/* NEXMON netlink, after the devices sent their last csi batch */
+	brcmf_csi_nl_init(NULL);
+	netlink_kernel_release(nl_sock);
 }
 
@@ -102,6 +102,8 @@ struct brcmf_rev_info {
 	u32 nvramrev;
 };
 
+struct brcmf_csi;
+
 /* Common structure for module and instance linkage */
 struct brcmf_pub {
 	/* Linkage ponters */
@@ -144,6 +146,9 @@ struct brcmf_pub {
 	struct brcmf_mp_device *settings;
 
 	u8 clmver[BRCMF_DCMD_SMLEN];
+
+	/* NEXMON */
+	struct brcmf_csi *csi;
 };
 
 /* forward declarations */
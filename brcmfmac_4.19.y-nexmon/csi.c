@@ -0,0 +1,741 @@
+/* NEXMON: csi frames from the firmware to userspace without the network stack.
+ *
+ * The firmware sends every csi frame as an ipv4/udp broadcast. Going through
+ * netif_rx, ip and udp and a packet socket costs more than decoding the
+ * frame. While /dev/nexmon_csi<n> is open or the csi group of the nexmon
+ * netlink socket has listeners, brcmf_netif_rx hands these frames to
+ * brcmf_csi_rx instead. It copies them into a ring that the reader maps and
+ * into batches that are sent to the group (see nexmon_csi.h). All other
+ * frames take the usual path.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/idr.h>
+#include <linux/kref.h>
+#include <linux/log2.h>
+#include <linux/ip.h>
+#include <linux/udp.h>
+#include <linux/etherdevice.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/timer.h>
+#include <net/ip.h>
+#include <net/netlink.h>
+#include <asm/unaligned.h>
+
+#include "core.h"
+#include "bus.h"
+#include "debug.h"
+#include "csi.h"
+#include "nexmon_csi.h"
+
+#define CSI_FRAME_MAGIC			0x1111
+#define CSI_FRAME_MAGIC_COMPACT		0x1112
+#define CSI_FRAME_MAGIC_BATCH		0x1113
+
+#define BRCMF_CSI_RING_MAX_KB		(64 * 1024)
+
+/* a batch is one order 1 allocation */
+#define BRCMF_CSI_NL_BATCH_LEN		SKB_WITH_OVERHEAD(2 * PAGE_SIZE)
+#define BRCMF_CSI_NL_SUBS		8
+
+/* synthetic full csi frame of 256 tones for the self test */
+#define BRCMF_CSI_TEST_PAYLOAD		(70 + 256 * 4)
+#define BRCMF_CSI_TEST_FRAMES		256
+#define BRCMF_CSI_TEST_ROUNDS		16
+/* udp discard port, the frames sent to the network stack are no csi */
+#define BRCMF_CSI_TEST_STACK_PORT	9
+
+static uint brcmf_csi_ring_kb = 1024;
+module_param_named(csi_ring_kb, brcmf_csi_ring_kb, uint, 0);
+MODULE_PARM_DESC(csi_ring_kb,
+		 "Size of the csi ring in KiB (rounded up to a power of 2)");
+
+static uint brcmf_csi_nl_batch = 16;
+module_param_named(csi_nl_batch, brcmf_csi_nl_batch, uint, 0);
+MODULE_PARM_DESC(csi_nl_batch,
+		 "Maximum number of csi frames in a netlink batch");
+
+static DEFINE_IDA(brcmf_csi_ida);
+
+/* nexmon netlink socket, batches go to group NEXMON_NL_GRP_CSI */
+static struct sock *brcmf_csi_nl;
+
+/**
+ * struct brcmf_csi_sub - accounting of one socket in the csi group.
+ *
+ * @sk: only compared, never dereferenced outside of the broadcast.
+ * @ino: inode of the socket, as in /proc/net/netlink.
+ * @batches: batches queued to the socket.
+ * @dropped: batches skipped because its receive buffer was full.
+ * @last: jiffies of the last batch.
+ */
+struct brcmf_csi_sub {
+	const struct sock *sk;
+	unsigned long ino;
+	u64 batches;
+	u64 dropped;
+	unsigned long last;
+};
+
+static struct brcmf_csi_sub brcmf_csi_subs[BRCMF_CSI_NL_SUBS];
+static DEFINE_SPINLOCK(brcmf_csi_subs_lock);
+
+/**
+ * struct brcmf_csi - csi ring of one device.
+ *
+ * @ring: vmalloc_user area that is mapped by the reader, records follow
+ *	the header at data_offset.
+ * @data: first record byte.
+ * @size: bytes of records.
+ * @head: kernel copy of ring->head, the mapping is writable by the reader.
+ * @map_len: size of the area.
+ * @lock: serializes writers.
+ * @wait: readers waiting in poll.
+ * @open: the device is open.
+ * @ref: the device and every open file hold a reference.
+ * @nl_lock: protects the batch.
+ * @batch: netlink message that is filled, NULL if there is none.
+ * @batch_timer: sends the batch one jiffy after its first frame.
+ * @batch_seq: sequence number of the next batch.
+ * @nl_dropped: frames that did not get into a batch.
+ * @nl_closed: set by brcmf_csi_detach, no new batch and no timer after it.
+ */
+struct brcmf_csi {
+	struct brcmf_pub *drvr;
+	struct miscdevice misc;
+	char name[16];
+	int id;
+	struct nexmon_csi_ring *ring;
+	u8 *data;
+	u32 size;
+	u32 head;
+	size_t map_len;
+	spinlock_t lock;
+	wait_queue_head_t wait;
+	atomic_t open;
+	struct kref ref;
+	spinlock_t nl_lock;
+	struct sk_buff *batch;
+	struct timer_list batch_timer;
+	u32 batch_seq;
+	u32 nl_dropped;
+	bool nl_closed;
+};
+
+static struct brcmf_csi *brcmf_csi_alloc(size_t size)
+{
+	struct brcmf_csi *csi;
+
+	csi = kzalloc(sizeof(*csi), GFP_KERNEL);
+	if (!csi)
+		return NULL;
+
+	csi->map_len = PAGE_SIZE + size;
+	csi->ring = vmalloc_user(csi->map_len);
+	if (!csi->ring) {
+		kfree(csi);
+		return NULL;
+	}
+	csi->data = (u8 *)csi->ring + PAGE_SIZE;
+	csi->ring->magic = NEXMON_CSI_RING_MAGIC;
+	csi->ring->version = NEXMON_CSI_RING_VERSION;
+	csi->ring->hdr_len = sizeof(*csi->ring);
+	csi->ring->data_offset = PAGE_SIZE;
+	csi->ring->size = size;
+	csi->size = size;
+
+	spin_lock_init(&csi->lock);
+	spin_lock_init(&csi->nl_lock);
+	init_waitqueue_head(&csi->wait);
+	kref_init(&csi->ref);
+	return csi;
+}
+
+static void brcmf_csi_release_ref(struct kref *ref)
+{
+	struct brcmf_csi *csi = container_of(ref, struct brcmf_csi, ref);
+
+	vfree(csi->ring);
+	kfree(csi);
+}
+
+static void brcmf_csi_reset(struct brcmf_csi *csi)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&csi->lock, flags);
+	csi->ring->frames = 0;
+	csi->ring->dropped = 0;
+	csi->ring->tail = 0;
+	csi->head = 0;
+	smp_store_release(&csi->ring->head, 0);
+	spin_unlock_irqrestore(&csi->lock, flags);
+}
+
+/* ipv4/udp to NEXMON_CSI_PORT with a csi magic, skb->data is the ip header */
+static bool brcmf_csi_match(const struct sk_buff *skb)
+{
+	const struct iphdr *iph;
+	const struct udphdr *uh;
+	unsigned int ihl;
+	u16 magic;
+
+	if (skb->protocol != htons(ETH_P_IP) ||
+	    skb_headlen(skb) < sizeof(*iph))
+		return false;
+
+	iph = (const struct iphdr *)skb->data;
+	ihl = iph->ihl * 4;
+	if (iph->version != 4 || iph->protocol != IPPROTO_UDP ||
+	    ihl < sizeof(*iph) || (iph->frag_off & htons(IP_MF | IP_OFFSET)) ||
+	    skb_headlen(skb) < ihl + sizeof(*uh) + sizeof(magic))
+		return false;
+
+	uh = (const struct udphdr *)(skb->data + ihl);
+	if (uh->dest != htons(NEXMON_CSI_PORT))
+		return false;
+
+	magic = get_unaligned_le16(skb->data + ihl + sizeof(*uh));
+	return magic == CSI_FRAME_MAGIC || magic == CSI_FRAME_MAGIC_COMPACT ||
+	       magic == CSI_FRAME_MAGIC_BATCH;
+}
+
+/* copies one ethernet frame into the ring, never waits for the reader */
+static void brcmf_csi_put(struct brcmf_csi *csi, const u8 *frame, u16 len,
+			  u16 ifidx, u64 ts)
+{
+	struct nexmon_csi_ring *ring = csi->ring;
+	struct nexmon_csi_record *rec;
+	u32 size = csi->size;
+	u32 need = ALIGN(sizeof(*rec) + len, NEXMON_CSI_RECORD_ALIGN);
+	u32 pos, to_end;
+	u32 head, tail;
+	unsigned long flags;
+
+	spin_lock_irqsave(&csi->lock, flags);
+	if (need > size)
+		goto drop;
+	head = csi->head;
+	/* tail comes from userspace, anything out of range reads as full */
+	tail = smp_load_acquire(&ring->tail);
+	pos = head & (size - 1);
+	to_end = size - pos;
+	if (to_end < need) {
+		if (head - tail > size || size - (head - tail) < to_end + need)
+			goto drop;
+		rec = (struct nexmon_csi_record *)(csi->data + pos);
+		rec->len = 0;
+		rec->flags = NEXMON_CSI_RECORD_SKIP;
+		head += to_end;
+		pos = 0;
+	} else if (head - tail > size || size - (head - tail) < need) {
+		goto drop;
+	}
+
+	rec = (struct nexmon_csi_record *)(csi->data + pos);
+	rec->len = len;
+	rec->flags = 0;
+	rec->ifidx = ifidx;
+	rec->ts_nsec = ts;
+	memcpy(rec + 1, frame, len);
+	ring->frames++;
+	csi->head = head + need;
+	smp_store_release(&ring->head, csi->head);
+	spin_unlock_irqrestore(&csi->lock, flags);
+
+	if (wq_has_sleeper(&csi->wait))
+		wake_up_interruptible(&csi->wait);
+	return;
+
+drop:
+	ring->dropped++;
+	spin_unlock_irqrestore(&csi->lock, flags);
+}
+
+static int brcmf_csi_nl_filter(struct sock *dsk, struct sk_buff *skb,
+			       void *data)
+{
+	struct brcmf_csi_sub *sub = NULL;
+	unsigned long ino = 0;
+	unsigned long flags;
+	bool full;
+	int i;
+
+	/* skipping a full socket here saves the clone that
+	 * netlink_broadcast would drop anyway
+	 */
+	full = atomic_read(&dsk->sk_rmem_alloc) + skb->truesize >
+	       READ_ONCE(dsk->sk_rcvbuf);
+	if (dsk->sk_socket)
+		ino = SOCK_INODE(dsk->sk_socket)->i_ino;
+
+	spin_lock_irqsave(&brcmf_csi_subs_lock, flags);
+	for (i = 0; i < BRCMF_CSI_NL_SUBS; i++) {
+		if (brcmf_csi_subs[i].sk == dsk &&
+		    brcmf_csi_subs[i].ino == ino) {
+			sub = &brcmf_csi_subs[i];
+			break;
+		}
+	}
+	if (!sub) {
+		/* a new socket takes the slot that was unused the longest */
+		sub = &brcmf_csi_subs[0];
+		for (i = 1; i < BRCMF_CSI_NL_SUBS; i++) {
+			if (!brcmf_csi_subs[i].sk ||
+			    (sub->sk && time_before(brcmf_csi_subs[i].last,
+						    sub->last)))
+				sub = &brcmf_csi_subs[i];
+		}
+		memset(sub, 0, sizeof(*sub));
+		sub->sk = dsk;
+		sub->ino = ino;
+	}
+	sub->last = jiffies;
+	if (full)
+		sub->dropped++;
+	else
+		sub->batches++;
+	spin_unlock_irqrestore(&brcmf_csi_subs_lock, flags);
+
+	return full;
+}
+
+static void brcmf_csi_nl_send(struct sk_buff *skb)
+{
+	struct sock *nl = READ_ONCE(brcmf_csi_nl);
+
+	if (!nl) {
+		kfree_skb(skb);
+		return;
+	}
+	nlmsg_end(skb, nlmsg_hdr(skb));
+	NETLINK_CB(skb).dst_group = NEXMON_NL_GRP_CSI;
+	netlink_broadcast_filtered(nl, skb, 0, NEXMON_NL_GRP_CSI, GFP_ATOMIC,
+				   brcmf_csi_nl_filter, NULL);
+}
+
+static void brcmf_csi_nl_flush(struct brcmf_csi *csi)
+{
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	spin_lock_irqsave(&csi->nl_lock, flags);
+	skb = csi->batch;
+	csi->batch = NULL;
+	spin_unlock_irqrestore(&csi->nl_lock, flags);
+
+	if (skb)
+		brcmf_csi_nl_send(skb);
+}
+
+static void brcmf_csi_nl_timeout(struct timer_list *t)
+{
+	struct brcmf_csi *csi = from_timer(csi, t, batch_timer);
+
+	brcmf_csi_nl_flush(csi);
+}
+
+/* appends one ethernet frame to the batch of the device. A full batch is
+ * sent first, the last one is sent by the timer.
+ */
+static void brcmf_csi_nl_add(struct brcmf_csi *csi, const u8 *frame, u16 len,
+			     u16 ifidx, u64 ts)
+{
+	struct nexmon_csi_batch *hdr;
+	struct nexmon_csi_record *rec;
+	struct sk_buff *full = NULL;
+	struct nlmsghdr *nlh;
+	u32 need = ALIGN(sizeof(*rec) + len, NEXMON_CSI_RECORD_ALIGN);
+	unsigned long flags;
+
+	spin_lock_irqsave(&csi->nl_lock, flags);
+	if (csi->nl_closed ||
+	    need > BRCMF_CSI_NL_BATCH_LEN - nlmsg_total_size(sizeof(*hdr)))
+		goto drop;
+	if (csi->batch) {
+		hdr = nlmsg_data(nlmsg_hdr(csi->batch));
+		if (skb_tailroom(csi->batch) < need ||
+		    hdr->n_records >= brcmf_csi_nl_batch) {
+			full = csi->batch;
+			csi->batch = NULL;
+		}
+	}
+	if (!csi->batch) {
+		csi->batch = alloc_skb(BRCMF_CSI_NL_BATCH_LEN, GFP_ATOMIC);
+		if (!csi->batch)
+			goto drop;
+		nlh = nlmsg_put(csi->batch, 0, 0, NEXMON_NL_CSI_BATCH,
+				sizeof(*hdr), 0);
+		hdr = nlmsg_data(nlh);
+		memset(hdr, 0, sizeof(*hdr));
+		hdr->seq = csi->batch_seq++;
+		hdr->dev = csi->id;
+		mod_timer(&csi->batch_timer, jiffies + 1);
+	}
+	hdr = nlmsg_data(nlmsg_hdr(csi->batch));
+	if (skb_tailroom(csi->batch) < need)
+		goto drop;
+
+	rec = skb_put_zero(csi->batch, need);
+	rec->len = len;
+	rec->ifidx = ifidx;
+	rec->ts_nsec = ts;
+	memcpy(rec + 1, frame, len);
+	hdr->n_records++;
+	hdr->dropped = csi->nl_dropped;
+	spin_unlock_irqrestore(&csi->nl_lock, flags);
+
+	if (full)
+		brcmf_csi_nl_send(full);
+	return;
+
+drop:
+	csi->nl_dropped++;
+	spin_unlock_irqrestore(&csi->nl_lock, flags);
+	if (full)
+		brcmf_csi_nl_send(full);
+}
+
+static bool brcmf_csi_take(struct brcmf_csi *csi, struct sk_buff *skb,
+			   u16 ifidx, bool to_ring, bool to_nl)
+{
+	unsigned int mac_len;
+	u64 ts;
+
+	/* the frame is copied from the linear data, others take the stack */
+	if (skb_is_nonlinear(skb) || !brcmf_csi_match(skb) ||
+	    !skb_mac_header_was_set(skb))
+		return false;
+
+	mac_len = skb->data - skb_mac_header(skb);
+	if (mac_len != ETH_HLEN || skb->len + mac_len > U16_MAX)
+		return false;
+
+	ts = ktime_get_real_ns();
+	if (to_ring)
+		brcmf_csi_put(csi, skb_mac_header(skb), skb->len + mac_len,
+			      ifidx, ts);
+	if (to_nl)
+		brcmf_csi_nl_add(csi, skb_mac_header(skb), skb->len + mac_len,
+				 ifidx, ts);
+	consume_skb(skb);
+	return true;
+}
+
+bool brcmf_csi_rx(struct brcmf_if *ifp, struct sk_buff *skb)
+{
+	struct brcmf_csi *csi = READ_ONCE(ifp->drvr->csi);
+	struct sock *nl = READ_ONCE(brcmf_csi_nl);
+	bool to_ring, to_nl;
+
+	if (!csi)
+		return false;
+
+	to_ring = atomic_read(&csi->open);
+	to_nl = nl && netlink_has_listeners(nl, NEXMON_NL_GRP_CSI);
+	if (!to_ring && !to_nl)
+		return false;
+
+	return brcmf_csi_take(csi, skb, ifp->ifidx, to_ring, to_nl);
+}
+
+void brcmf_csi_nl_init(struct sock *nl)
+{
+	WRITE_ONCE(brcmf_csi_nl, nl);
+}
+
+static int brcmf_csi_open(struct inode *inode, struct file *file)
+{
+	struct brcmf_csi *csi = container_of(file->private_data,
+					     struct brcmf_csi, misc);
+
+	/* there is only one tail, so only one reader */
+	if (atomic_cmpxchg(&csi->open, 0, 1))
+		return -EBUSY;
+
+	kref_get(&csi->ref);
+	brcmf_csi_reset(csi);
+	file->private_data = csi;
+	return 0;
+}
+
+static int brcmf_csi_release(struct inode *inode, struct file *file)
+{
+	struct brcmf_csi *csi = file->private_data;
+
+	atomic_set(&csi->open, 0);
+	kref_put(&csi->ref, brcmf_csi_release_ref);
+	return 0;
+}
+
+static int brcmf_csi_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct brcmf_csi *csi = file->private_data;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start > csi->map_len)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, csi->ring, 0);
+}
+
+static __poll_t brcmf_csi_poll(struct file *file, poll_table *wait)
+{
+	struct brcmf_csi *csi = file->private_data;
+
+	poll_wait(file, &csi->wait, wait);
+	if (READ_ONCE(csi->head) != READ_ONCE(csi->ring->tail))
+		return EPOLLIN | EPOLLRDNORM;
+	return 0;
+}
+
+static const struct file_operations brcmf_csi_fops = {
+	.owner = THIS_MODULE,
+	.open = brcmf_csi_open,
+	.release = brcmf_csi_release,
+	.mmap = brcmf_csi_mmap,
+	.poll = brcmf_csi_poll,
+	.llseek = noop_llseek,
+};
+
+int brcmf_csi_attach(struct brcmf_pub *drvr)
+{
+	struct brcmf_csi *csi;
+	uint kb = clamp_t(uint, brcmf_csi_ring_kb, PAGE_SIZE / 1024,
+			  BRCMF_CSI_RING_MAX_KB);
+	int ret;
+
+	csi = brcmf_csi_alloc(roundup_pow_of_two(kb * 1024));
+	if (!csi)
+		return -ENOMEM;
+
+	csi->drvr = drvr;
+	timer_setup(&csi->batch_timer, brcmf_csi_nl_timeout, 0);
+	csi->id = ida_simple_get(&brcmf_csi_ida, 0, 0, GFP_KERNEL);
+	if (csi->id < 0) {
+		ret = csi->id;
+		goto fail;
+	}
+	snprintf(csi->name, sizeof(csi->name), "nexmon_csi%d", csi->id);
+	csi->misc.minor = MISC_DYNAMIC_MINOR;
+	csi->misc.name = csi->name;
+	csi->misc.fops = &brcmf_csi_fops;
+	csi->misc.parent = drvr->bus_if->dev;
+	ret = misc_register(&csi->misc);
+	if (ret) {
+		ida_simple_remove(&brcmf_csi_ida, csi->id);
+		goto fail;
+	}
+
+	drvr->csi = csi;
+	return 0;
+
+fail:
+	kref_put(&csi->ref, brcmf_csi_release_ref);
+	return ret;
+}
+
+void brcmf_csi_detach(struct brcmf_pub *drvr)
+{
+	struct brcmf_csi *csi = drvr->csi;
+	unsigned long flags;
+
+	if (!csi)
+		return;
+
+	/* an open file keeps the ring until it is closed */
+	misc_deregister(&csi->misc);
+	ida_simple_remove(&brcmf_csi_ida, csi->id);
+	WRITE_ONCE(drvr->csi, NULL);
+
+	/* a frame that is still in brcmf_csi_nl_add may not re-arm the timer
+	 * once it has been killed, so close the batch under its lock first
+	 */
+	spin_lock_irqsave(&csi->nl_lock, flags);
+	csi->nl_closed = true;
+	spin_unlock_irqrestore(&csi->nl_lock, flags);
+
+	del_timer_sync(&csi->batch_timer);
+	brcmf_csi_nl_flush(csi);
+	kref_put(&csi->ref, brcmf_csi_release_ref);
+}
+
+/* a csi frame, or with csi false a udp frame of the same size to the discard
+ * port without magic that no csi consumer takes
+ */
+static struct sk_buff *brcmf_csi_test_skb(struct net_device *ndev, bool csi)
+{
+	u16 port = csi ? NEXMON_CSI_PORT : BRCMF_CSI_TEST_STACK_PORT;
+	struct sk_buff *skb;
+	struct ethhdr *eth;
+	struct iphdr *iph;
+	struct udphdr *uh;
+	u8 *payload;
+	unsigned int len = sizeof(*iph) + sizeof(*uh) + BRCMF_CSI_TEST_PAYLOAD;
+
+	skb = netdev_alloc_skb(ndev, ETH_HLEN + len);
+	if (!skb)
+		return NULL;
+
+	eth = skb_put_zero(skb, ETH_HLEN + len);
+	eth_broadcast_addr(eth->h_dest);
+	ether_addr_copy(eth->h_source, ndev->dev_addr);
+	eth->h_proto = htons(ETH_P_IP);
+
+	iph = (struct iphdr *)(eth + 1);
+	iph->version = 4;
+	iph->ihl = sizeof(*iph) / 4;
+	iph->ttl = 1;
+	iph->protocol = IPPROTO_UDP;
+	iph->tot_len = htons(len);
+	iph->saddr = htonl(0x0a0a0a0a);
+	iph->daddr = htonl(INADDR_BROADCAST);
+	iph->check = ip_fast_csum(iph, iph->ihl);
+
+	uh = (struct udphdr *)(iph + 1);
+	uh->source = htons(port);
+	uh->dest = htons(port);
+	uh->len = htons(len - sizeof(*iph));
+
+	payload = (u8 *)(uh + 1);
+	if (csi)
+		put_unaligned_le16(CSI_FRAME_MAGIC, payload);
+
+	skb->protocol = eth_type_trans(skb, ndev);
+	return skb;
+}
+
+/* ns per frame to take BRCMF_CSI_TEST_FRAMES synthetic frames through the
+ * fast path (to_ring) or through netif_rx_ni, or a negative error. the frames
+ * for netif_rx_ni go to the discard port, so sockets on the csi port and
+ * captures filtering on it never see them
+ */
+static s64 brcmf_csi_test_run(struct brcmf_csi *csi, struct net_device *ndev,
+			      bool to_ring)
+{
+	struct sk_buff **skbs;
+	u64 total = 0;
+	u64 start;
+	int round, i;
+
+	skbs = kcalloc(BRCMF_CSI_TEST_FRAMES, sizeof(*skbs), GFP_KERNEL);
+	if (!skbs)
+		return -ENOMEM;
+
+	for (round = 0; round < BRCMF_CSI_TEST_ROUNDS; round++) {
+		for (i = 0; i < BRCMF_CSI_TEST_FRAMES; i++) {
+			skbs[i] = brcmf_csi_test_skb(ndev, to_ring);
+			if (!skbs[i]) {
+				while (i--)
+					kfree_skb(skbs[i]);
+				kfree(skbs);
+				return -ENOMEM;
+			}
+		}
+
+		start = ktime_get_ns();
+		for (i = 0; i < BRCMF_CSI_TEST_FRAMES; i++) {
+			if (!to_ring) {
+				netif_rx_ni(skbs[i]);
+				continue;
+			}
+			if (!brcmf_csi_take(csi, skbs[i], 0, true, false))
+				kfree_skb(skbs[i]);
+			/* a reader that keeps up */
+			smp_store_release(&csi->ring->tail, csi->head);
+		}
+		total += ktime_get_ns() - start;
+	}
+	kfree(skbs);
+
+	return div_u64(total, BRCMF_CSI_TEST_ROUNDS * BRCMF_CSI_TEST_FRAMES);
+}
+
+/* reading csi_selftest takes synthetic frames through a private ring and, if
+ * the interface is up, sends as many udp frames into its network stack
+ */
+static int brcmf_csi_selftest_read(struct seq_file *s, void *data)
+{
+	struct brcmf_bus *bus_if = dev_get_drvdata(s->private);
+	struct brcmf_pub *drvr = bus_if->drvr;
+	struct brcmf_if *ifp = drvr->iflist[0];
+	struct brcmf_csi *csi;
+	s64 ns;
+
+	if (!ifp || !ifp->ndev)
+		return -ENODEV;
+
+	/* a private ring, so an open reader is not disturbed */
+	csi = brcmf_csi_alloc(1 << 20);
+	if (!csi)
+		return -ENOMEM;
+
+	seq_printf(s, "frames: %d x %d bytes\n",
+		   BRCMF_CSI_TEST_FRAMES * BRCMF_CSI_TEST_ROUNDS,
+		   ETH_HLEN + (int)(sizeof(struct iphdr) + sizeof(struct udphdr)) +
+		   BRCMF_CSI_TEST_PAYLOAD);
+
+	ns = brcmf_csi_test_run(csi, ifp->ndev, true);
+	if (ns >= 0)
+		seq_printf(s, "csi ring: %lld ns/frame, %llu dropped\n", ns,
+			   csi->ring->dropped);
+	else
+		seq_printf(s, "csi ring: error %lld\n", ns);
+
+	if (!(ifp->ndev->flags & IFF_UP)) {
+		seq_puts(s, "network stack: skipped, interface is down\n");
+	} else {
+		/* sends traffic on the interface, udp drops it unless a
+		 * socket listens on the discard port
+		 */
+		ns = brcmf_csi_test_run(csi, ifp->ndev, false);
+		if (ns >= 0)
+			seq_printf(s, "network stack (udp port %d): %lld ns/frame\n",
+				   BRCMF_CSI_TEST_STACK_PORT, ns);
+		else
+			seq_printf(s, "network stack: error %lld\n", ns);
+	}
+
+	kref_put(&csi->ref, brcmf_csi_release_ref);
+	return 0;
+}
+
+static int brcmf_csi_subscribers_read(struct seq_file *s, void *data)
+{
+	struct brcmf_bus *bus_if = dev_get_drvdata(s->private);
+	struct brcmf_csi *csi = bus_if->drvr->csi;
+	struct brcmf_csi_sub subs[BRCMF_CSI_NL_SUBS];
+	unsigned long flags;
+	int i;
+
+	if (csi)
+		seq_printf(s, "batches: %u, frames not batched: %u\n",
+			   csi->batch_seq, csi->nl_dropped);
+
+	spin_lock_irqsave(&brcmf_csi_subs_lock, flags);
+	memcpy(subs, brcmf_csi_subs, sizeof(subs));
+	spin_unlock_irqrestore(&brcmf_csi_subs_lock, flags);
+
+	seq_puts(s, "inode      batches    dropped    idle_ms\n");
+	for (i = 0; i < BRCMF_CSI_NL_SUBS; i++) {
+		if (!subs[i].sk)
+			continue;
+		seq_printf(s, "%-10lu %-10llu %-10llu %u\n", subs[i].ino,
+			   subs[i].batches, subs[i].dropped,
+			   jiffies_to_msecs(jiffies - subs[i].last));
+	}
+	return 0;
+}
+
+void brcmf_csi_debugfs_create(struct brcmf_pub *drvr)
+{
+	brcmf_debugfs_add_entry(drvr, "csi_selftest", brcmf_csi_selftest_read);
+	brcmf_debugfs_add_entry(drvr, "csi_subscribers",
+				brcmf_csi_subscribers_read);
+}
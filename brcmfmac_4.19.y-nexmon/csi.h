@@ -0,0 +1,21 @@
+#ifndef BRCMFMAC_CSI_H
+#define BRCMFMAC_CSI_H
+
+struct brcmf_pub;
+struct brcmf_if;
+struct sk_buff;
+struct sock;
+
+int brcmf_csi_attach(struct brcmf_pub *drvr);
+void brcmf_csi_detach(struct brcmf_pub *drvr);
+void brcmf_csi_debugfs_create(struct brcmf_pub *drvr);
+
+/* nexmon netlink socket with the csi group, NULL when it is released */
+void brcmf_csi_nl_init(struct sock *nl);
+
+/* takes the skb if it is a csi frame and the csi device is open or the csi
+ * netlink group has listeners
+ */
+bool brcmf_csi_rx(struct brcmf_if *ifp, struct sk_buff *skb);
+
+#endif /* BRCMFMAC_CSI_H */
@@ -0,0 +1,75 @@
+#ifndef NEXMON_CSI_H
+#define NEXMON_CSI_H
+
+#include <linux/types.h>
+
+/* Layout of the csi ring that userspace maps from /dev/nexmon_csi<n>.
+ *
+ * While the device is open, the driver copies every ethernet frame with a
+ * udp datagram to NEXMON_CSI_PORT that starts with a csi magic into the ring
+ * and drops it instead of passing it to the network stack.
+ *
+ * The mapping starts with struct nexmon_csi_ring, the records start at
+ * data_offset. Every record is a struct nexmon_csi_record followed by the
+ * ethernet frame, padded to NEXMON_CSI_RECORD_ALIGN. Records never wrap
+ * around the end of the ring. If the space left at the end is too small, it
+ * starts with a record with NEXMON_CSI_RECORD_SKIP set, and the next record
+ * is at the start of the ring. head and tail count bytes modulo 2^32 since
+ * the device was opened, the record at tail is at
+ * data_offset + tail % size. The driver advances head after a record is
+ * complete, the reader advances tail after it consumed the record. Frames
+ * that do not fit into the space between head and tail are dropped.
+ */
+
+#define NEXMON_CSI_PORT			5500
+#define NEXMON_CSI_RING_MAGIC		0x4943534e	/* "NSCI" */
+#define NEXMON_CSI_RING_VERSION		1
+
+#define NEXMON_CSI_RECORD_ALIGN		16
+#define NEXMON_CSI_RECORD_SKIP		0x0001
+
+/* The same records are sent in batches to multicast group NEXMON_NL_GRP_CSI
+ * of netlink protocol NEXMON_NL_USER, which the driver also uses for ioctls.
+ * A batch is a netlink message of type NEXMON_NL_CSI_BATCH with a struct
+ * nexmon_csi_batch followed by n_records records. Batches of a device are
+ * numbered, so a gap in seq means that the receive buffer of the socket was
+ * full. A slow socket misses batches, it never delays the others or the rx
+ * path.
+ */
+#define NEXMON_NL_USER			31
+#define NEXMON_NL_GRP_CSI		1
+#define NEXMON_NL_GRP_MAX		NEXMON_NL_GRP_CSI
+#define NEXMON_NL_CSI_BATCH		0x10
+
+struct nexmon_csi_ring {
+	__u32 magic;
+	__u16 version;
+	__u16 hdr_len;
+	__u32 data_offset;
+	__u32 size;		/* bytes of records, a power of 2 */
+	__u64 frames;		/* frames written to the ring */
+	__u64 dropped;		/* frames dropped because the ring was full */
+	__u8 PAD0[32];
+	__u32 head;		/* written by the driver */
+	__u8 PAD1[60];
+	__u32 tail;		/* written by the reader */
+	__u8 PAD2[60];
+};
+
+struct nexmon_csi_record {
+	__u16 len;		/* length of the ethernet frame */
+	__u16 flags;
+	__u16 ifidx;
+	__u16 PAD;
+	__u64 ts_nsec;		/* CLOCK_REALTIME when the driver received it */
+};
+
+struct nexmon_csi_batch {
+	__u32 seq;		/* batch number of this device */
+	__u16 n_records;
+	__u16 dev;		/* n of /dev/nexmon_csi<n> */
+	__u32 dropped;		/* frames of this device that got into no batch */
+	__u32 PAD;
+};
+
+#endif /* NEXMON_CSI_H */
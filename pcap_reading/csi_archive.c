@@ -0,0 +1,479 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "csi_archive.h"
+#include "csi_decode_internal.h"
+
+struct mac_chunks {
+    uint8_t mac[6];
+    uint32_t *ids;
+    uint32_t n;
+    uint32_t cap;
+};
+
+struct csi_archive_writer {
+    FILE *f;
+    uint16_t max_tones;
+    uint32_t chunk_frames;
+    uint32_t fill;                      /* frames in the current chunk */
+    uint8_t *col[CSI_RING_N_COLUMNS];   /* columns of the current chunk */
+    uint64_t pos;
+    struct csi_archive_chunk *chunks;
+    uint32_t n_chunks;
+    uint32_t cap_chunks;
+    struct mac_chunks *macs;
+    uint32_t n_macs;
+    uint32_t cap_macs;
+    int failed;
+};
+
+struct csi_archive {
+    int fd;
+    const uint8_t *base;
+    size_t size;
+    uint16_t max_tones;
+    struct csi_archive_trailer trailer;
+    const struct csi_archive_chunk *chunks;
+    const struct csi_archive_mac *macs;
+    const uint32_t *mac_chunks;
+};
+
+static inline size_t
+pad8(size_t len)
+{
+    return (len + 7) & ~(size_t) 7;
+}
+
+static int
+grow(void **array, uint32_t *cap, uint32_t n, size_t size)
+{
+    if (n < *cap) {
+        return 0;
+    }
+    uint32_t new_cap = *cap ? *cap * 2 : 16;
+    void *p = realloc(*array, new_cap * size);
+    if (p == NULL) {
+        return -1;
+    }
+    *array = p;
+    *cap = new_cap;
+    return 0;
+}
+
+static int
+write_bytes(struct csi_archive_writer *w, const void *data, size_t len)
+{
+    if (len > 0 && fwrite(data, len, 1, w->f) != 1) {
+        w->failed = 1;
+        return -1;
+    }
+    w->pos += len;
+    return 0;
+}
+
+static int
+write_padding(struct csi_archive_writer *w)
+{
+    static const uint8_t zero[8];
+    return write_bytes(w, zero, pad8(w->pos) - w->pos);
+}
+
+static int
+add_mac_chunk(struct csi_archive_writer *w, const uint8_t *mac, uint32_t chunk)
+{
+    struct mac_chunks *m = NULL;
+    uint32_t i;
+    for (i = 0; i < w->n_macs; i++) {
+        if (memcmp(w->macs[i].mac, mac, 6) == 0) {
+            m = &w->macs[i];
+            break;
+        }
+    }
+    if (m == NULL) {
+        if (grow((void **) &w->macs, &w->cap_macs, w->n_macs, sizeof(*w->macs)) < 0) {
+            return -1;
+        }
+        m = &w->macs[w->n_macs++];
+        memset(m, 0, sizeof(*m));
+        memcpy(m->mac, mac, 6);
+    }
+    if (m->n > 0 && m->ids[m->n - 1] == chunk) {
+        return 0;
+    }
+    if (grow((void **) &m->ids, &m->cap, m->n, sizeof(*m->ids)) < 0) {
+        return -1;
+    }
+    m->ids[m->n++] = chunk;
+    return 0;
+}
+
+static int
+flush_chunk(struct csi_archive_writer *w)
+{
+    struct csi_archive_chunk chunk;
+    const uint64_t *ts = (const uint64_t *) w->col[CSI_RING_TS_USEC];
+    const uint16_t *seq = (const uint16_t *) w->col[CSI_RING_SEQ_CNT];
+    const uint16_t *chanspec = (const uint16_t *) w->col[CSI_RING_CHANSPEC];
+    const int8_t *rssi = (const int8_t *) w->col[CSI_RING_RSSI];
+    uint32_t i, off = 0;
+    int c;
+
+    if (w->fill == 0) {
+        return 0;
+    }
+    if (grow((void **) &w->chunks, &w->cap_chunks, w->n_chunks, sizeof(*w->chunks)) < 0) {
+        w->failed = 1;
+        return -1;
+    }
+
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.offset = w->pos;
+    chunk.n_frames = w->fill;
+    chunk.ts_min = chunk.ts_max = ts[0];
+    chunk.seq_min = chunk.seq_max = seq[0];
+    chunk.chanspec_min = chunk.chanspec_max = chanspec[0];
+    chunk.rssi_min = chunk.rssi_max = rssi[0];
+    for (i = 0; i < w->fill; i++) {
+        if (ts[i] < chunk.ts_min) chunk.ts_min = ts[i];
+        if (ts[i] > chunk.ts_max) chunk.ts_max = ts[i];
+        if (seq[i] < chunk.seq_min) chunk.seq_min = seq[i];
+        if (seq[i] > chunk.seq_max) chunk.seq_max = seq[i];
+        if (chanspec[i] < chunk.chanspec_min) chunk.chanspec_min = chanspec[i];
+        if (chanspec[i] > chunk.chanspec_max) chunk.chanspec_max = chanspec[i];
+        if (rssi[i] < chunk.rssi_min) chunk.rssi_min = rssi[i];
+        if (rssi[i] > chunk.rssi_max) chunk.rssi_max = rssi[i];
+        if (add_mac_chunk(w, w->col[CSI_RING_SRC_MAC] + i * 6, w->n_chunks) < 0) {
+            w->failed = 1;
+            return -1;
+        }
+    }
+
+    for (c = 0; c < CSI_RING_N_COLUMNS; c++) {
+        chunk.column_offset[c] = off;
+        if (write_bytes(w, w->col[c], csi_column_size(c, w->max_tones) * w->fill) < 0 || write_padding(w) < 0) {
+            return -1;
+        }
+        off = w->pos - chunk.offset;
+    }
+    w->chunks[w->n_chunks++] = chunk;
+    w->fill = 0;
+    return 0;
+}
+
+struct csi_archive_writer *
+csi_archive_create(const char *filename, uint16_t max_tones, uint32_t chunk_frames)
+{
+    struct csi_archive_writer *w;
+    struct csi_archive_header hdr = { CSI_ARCHIVE_MAGIC, CSI_ARCHIVE_VERSION, max_tones };
+    int c;
+
+    if (max_tones == 0 || chunk_frames == 0) {
+        return NULL;
+    }
+    w = calloc(1, sizeof(*w));
+    if (w == NULL) {
+        return NULL;
+    }
+    w->max_tones = max_tones;
+    w->chunk_frames = chunk_frames;
+    for (c = 0; c < CSI_RING_N_COLUMNS; c++) {
+        w->col[c] = malloc(csi_column_size(c, max_tones) * chunk_frames);
+        if (w->col[c] == NULL) {
+            w->failed = 1;
+        }
+    }
+    w->f = fopen(filename, "wb");
+    if (w->f == NULL || w->failed || write_bytes(w, &hdr, sizeof(hdr)) < 0) {
+        w->failed = 1;
+        csi_archive_finish(w);
+        return NULL;
+    }
+    return w;
+}
+
+int
+csi_archive_append(struct csi_archive_writer *w, const struct csi_columns *cols, size_t n)
+{
+    size_t done = 0;
+    int c;
+
+    if (w->failed || cols->max_tones != w->max_tones) {
+        return -1;
+    }
+    while (done < n) {
+        size_t k = w->chunk_frames - w->fill;
+        if (k > n - done) {
+            k = n - done;
+        }
+        for (c = 0; c < CSI_RING_N_COLUMNS; c++) {
+            size_t size = csi_column_size(c, w->max_tones);
+            const uint8_t *src = *csi_column_ptr((struct csi_columns *) cols, c);
+            if (src) {
+                memcpy(w->col[c] + w->fill * size, src + done * size, k * size);
+            } else {
+                memset(w->col[c] + w->fill * size, 0, k * size);
+            }
+        }
+        w->fill += k;
+        done += k;
+        if (w->fill == w->chunk_frames && flush_chunk(w) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int
+compare_mac(const void *a, const void *b)
+{
+    return memcmp(((const struct mac_chunks *) a)->mac, ((const struct mac_chunks *) b)->mac, 6);
+}
+
+int
+csi_archive_finish(struct csi_archive_writer *w)
+{
+    struct csi_archive_trailer trailer;
+    uint32_t i, first = 0;
+    int c, ret;
+
+    if (w->f && !w->failed && flush_chunk(w) == 0) {
+        memset(&trailer, 0, sizeof(trailer));
+        trailer.chunk_table_offset = w->pos;
+        trailer.n_chunks = w->n_chunks;
+        trailer.n_macs = w->n_macs;
+        trailer.magic = CSI_ARCHIVE_MAGIC;
+        write_bytes(w, w->chunks, (size_t) w->n_chunks * sizeof(*w->chunks));
+
+        qsort(w->macs, w->n_macs, sizeof(*w->macs), compare_mac);
+        for (i = 0; i < w->n_macs; i++) {
+            struct csi_archive_mac m;
+            memset(&m, 0, sizeof(m));
+            memcpy(m.mac, w->macs[i].mac, 6);
+            m.first = first;
+            m.n_chunks = w->macs[i].n;
+            write_bytes(w, &m, sizeof(m));
+            first += m.n_chunks;
+        }
+        for (i = 0; i < w->n_macs; i++) {
+            write_bytes(w, w->macs[i].ids, (size_t) w->macs[i].n * sizeof(uint32_t));
+        }
+        trailer.n_mac_chunks = first;
+        write_padding(w);
+        write_bytes(w, &trailer, sizeof(trailer));
+    }
+    ret = w->failed ? -1 : 0;
+    if (w->f && fclose(w->f) != 0) {
+        ret = -1;
+    }
+    for (c = 0; c < CSI_RING_N_COLUMNS; c++) {
+        free(w->col[c]);
+    }
+    for (i = 0; i < w->n_macs; i++) {
+        free(w->macs[i].ids);
+    }
+    free(w->macs);
+    free(w->chunks);
+    free(w);
+    return ret;
+}
+
+long
+csi_archive_from_pcap(const char *pcap_file, const char *archive_file, uint16_t max_tones, uint32_t chunk_frames)
+{
+    struct csi_columns cols;
+    struct csi_pcap *pcap;
+    struct csi_archive_writer *w;
+    long total = 0;
+    size_t n;
+    int c;
+
+    pcap = csi_pcap_open(pcap_file);
+    if (pcap == NULL) {
+        return -1;
+    }
+    w = csi_archive_create(archive_file, max_tones, chunk_frames);
+    if (w == NULL) {
+        csi_pcap_close(pcap);
+        return -1;
+    }
+    // frames are decoded straight into the columns of the current chunk
+    memset(&cols, 0, sizeof(cols));
+    cols.max_tones = max_tones;
+    do {
+        for (c = 0; c < CSI_RING_N_COLUMNS; c++) {
+            *csi_column_ptr(&cols, c) = w->col[c] + w->fill * csi_column_size(c, max_tones);
+        }
+        n = csi_pcap_decode(pcap, &cols, w->chunk_frames - w->fill);
+        w->fill += n;
+        total += n;
+        if (w->fill == w->chunk_frames && flush_chunk(w) < 0) {
+            break;
+        }
+    } while (n > 0);
+    csi_pcap_close(pcap);
+    if (csi_archive_finish(w) < 0) {
+        return -1;
+    }
+    return total;
+}
+
+struct csi_archive *
+csi_archive_open(const char *filename)
+{
+    struct stat st;
+    struct csi_archive_header hdr;
+    struct csi_archive *a;
+    uint32_t i;
+    int c;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(hdr) + sizeof(struct csi_archive_trailer)) {
+        close(fd);
+        return NULL;
+    }
+    const uint8_t *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    a = calloc(1, sizeof(*a));
+    if (a == NULL) {
+        munmap((void *) base, st.st_size);
+        close(fd);
+        return NULL;
+    }
+    a->fd = fd;
+    a->base = base;
+    a->size = st.st_size;
+
+    memcpy(&hdr, base, sizeof(hdr));
+    memcpy(&a->trailer, base + a->size - sizeof(a->trailer), sizeof(a->trailer));
+    a->max_tones = hdr.max_tones;
+    struct csi_archive_trailer *t = &a->trailer;
+    uint64_t index_len = (uint64_t) t->n_chunks * sizeof(struct csi_archive_chunk)
+        + (uint64_t) t->n_macs * sizeof(struct csi_archive_mac) + (uint64_t) t->n_mac_chunks * sizeof(uint32_t);
+    if (hdr.magic != CSI_ARCHIVE_MAGIC || hdr.version != CSI_ARCHIVE_VERSION || t->magic != CSI_ARCHIVE_MAGIC
+            || (t->chunk_table_offset & 7) || t->chunk_table_offset + index_len > a->size - sizeof(*t)) {
+        csi_archive_close(a);
+        return NULL;
+    }
+    a->chunks = (const struct csi_archive_chunk *) (base + t->chunk_table_offset);
+    a->macs = (const struct csi_archive_mac *) (a->chunks + t->n_chunks);
+    a->mac_chunks = (const uint32_t *) (a->macs + t->n_macs);
+
+    // every column of every chunk has to lie before the index
+    for (i = 0; i < t->n_chunks; i++) {
+        for (c = 0; c < CSI_RING_N_COLUMNS; c++) {
+            uint64_t end = a->chunks[i].offset + a->chunks[i].column_offset[c]
+                + (uint64_t) a->chunks[i].n_frames * csi_column_size(c, a->max_tones);
+            if (end > t->chunk_table_offset) {
+                csi_archive_close(a);
+                return NULL;
+            }
+        }
+    }
+    for (i = 0; i < t->n_macs; i++) {
+        if ((uint64_t) a->macs[i].first + a->macs[i].n_chunks > t->n_mac_chunks) {
+            csi_archive_close(a);
+            return NULL;
+        }
+    }
+    return a;
+}
+
+void
+csi_archive_close(struct csi_archive *a)
+{
+    if (a == NULL) {
+        return;
+    }
+    munmap((void *) a->base, a->size);
+    close(a->fd);
+    free(a);
+}
+
+uint32_t
+csi_archive_n_chunks(const struct csi_archive *a)
+{
+    return a->trailer.n_chunks;
+}
+
+const struct csi_archive_chunk *
+csi_archive_chunk(const struct csi_archive *a, uint32_t i)
+{
+    return i < a->trailer.n_chunks ? &a->chunks[i] : NULL;
+}
+
+size_t
+csi_archive_chunk_columns(const struct csi_archive *a, uint32_t i, struct csi_columns *cols)
+{
+    int c;
+    if (i >= a->trailer.n_chunks) {
+        return 0;
+    }
+    const struct csi_archive_chunk *chunk = &a->chunks[i];
+    for (c = 0; c < CSI_RING_N_COLUMNS; c++) {
+        *csi_column_ptr(cols, c) = (uint8_t *) a->base + chunk->offset + chunk->column_offset[c];
+    }
+    cols->max_tones = a->max_tones;
+    return chunk->n_frames;
+}
+
+static int
+chunk_in_range(const struct csi_archive_chunk *chunk, uint64_t ts_from, uint64_t ts_to)
+{
+    return chunk->ts_max >= ts_from && chunk->ts_min <= ts_to;
+}
+
+size_t
+csi_archive_find(const struct csi_archive *a, uint64_t ts_from, uint64_t ts_to, const uint8_t *src_mac,
+    uint32_t *chunks, size_t max_chunks)
+{
+    size_t n = 0;
+    uint32_t i;
+
+    if (src_mac == NULL) {
+        for (i = 0; i < a->trailer.n_chunks; i++) {
+            if (chunk_in_range(&a->chunks[i], ts_from, ts_to)) {
+                if (n < max_chunks) {
+                    chunks[n] = i;
+                }
+                n++;
+            }
+        }
+        return n;
+    }
+
+    // binary search in the sorted mac index
+    uint32_t lo = 0, hi = a->trailer.n_macs;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        int cmp = memcmp(a->macs[mid].mac, src_mac, 6);
+        if (cmp == 0) {
+            const uint32_t *ids = a->mac_chunks + a->macs[mid].first;
+            for (i = 0; i < a->macs[mid].n_chunks; i++) {
+                if (ids[i] < a->trailer.n_chunks && chunk_in_range(&a->chunks[ids[i]], ts_from, ts_to)) {
+                    if (n < max_chunks) {
+                        chunks[n] = ids[i];
+                    }
+                    n++;
+                }
+            }
+            return n;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+#ifndef CSI_ARCHIVE_H
+#define CSI_ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "csi_decode.h"
+#include "csi_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// columnar archive of decoded csi frames, all values little endian:
+//   struct csi_archive_header
+//   chunks, every chunk holds the columns of up to chunk_frames frames, each column is an array
+//   with one entry per frame in the order of enum csi_ring_column, 8 byte aligned
+//   struct csi_archive_chunk[n_chunks]     chunk index with statistics
+//   struct csi_archive_mac[n_macs]         source mac index, sorted by mac
+//   uint32_t[n_mac_chunks]                 chunks of every source mac
+//   struct csi_archive_trailer
+// a reader maps the file, reads the trailer and only touches the chunks it needs.
+
+#define CSI_ARCHIVE_MAGIC           0x41495343      /* "CSIA" */
+#define CSI_ARCHIVE_VERSION         3
+
+struct csi_archive_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t max_tones;
+};
+
+struct csi_archive_chunk {
+    uint64_t offset;                    /* file offset of the chunk */
+    uint64_t ts_min;
+    uint64_t ts_max;
+    uint32_t n_frames;
+    uint32_t column_offset[CSI_RING_N_COLUMNS];     /* relative to offset */
+    uint16_t seq_min;
+    uint16_t seq_max;
+    uint16_t chanspec_min;
+    uint16_t chanspec_max;
+    int8_t rssi_min;
+    int8_t rssi_max;
+    uint8_t PAD[2];
+};
+
+struct csi_archive_mac {
+    uint8_t mac[6];
+    uint8_t PAD[2];
+    uint32_t first;                     /* index of the first chunk id in the chunk list */
+    uint32_t n_chunks;
+};
+
+struct csi_archive_trailer {
+    uint64_t chunk_table_offset;
+    uint32_t n_chunks;
+    uint32_t n_macs;
+    uint32_t n_mac_chunks;
+    uint32_t magic;
+};
+
+struct csi_archive_writer;
+struct csi_archive;
+
+// creates an archive for frames with max_tones tones, returns NULL on error
+struct csi_archive_writer *csi_archive_create(const char *filename, uint16_t max_tones, uint32_t chunk_frames);
+
+// appends n frames, cols->max_tones has to match the archive. NULL columns are stored as 0
+int csi_archive_append(struct csi_archive_writer *w, const struct csi_columns *cols, size_t n);
+
+// writes the last chunk and the index, returns 0 on success
+int csi_archive_finish(struct csi_archive_writer *w);
+
+// converts a pcap or pcapng file, returns the number of frames or -1 on error
+long csi_archive_from_pcap(const char *pcap_file, const char *archive_file, uint16_t max_tones, uint32_t chunk_frames);
+
+// maps an archive, returns NULL on error
+struct csi_archive *csi_archive_open(const char *filename);
+void csi_archive_close(struct csi_archive *a);
+
+uint32_t csi_archive_n_chunks(const struct csi_archive *a);
+const struct csi_archive_chunk *csi_archive_chunk(const struct csi_archive *a, uint32_t i);
+
+// points cols to the columns of chunk i in the mapping, returns its number of frames
+size_t csi_archive_chunk_columns(const struct csi_archive *a, uint32_t i, struct csi_columns *cols);
+
+// ids of the chunks that may contain frames in [ts_from, ts_to] from src_mac (NULL for every mac).
+// returns the number of matching chunks, at most max_chunks are written to chunks
+size_t csi_archive_find(const struct csi_archive *a, uint64_t ts_from, uint64_t ts_to, const uint8_t *src_mac,
+    uint32_t *chunks, size_t max_chunks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*CSI_ARCHIVE_H*/
@@ -0,0 +1,145 @@
+// converts a capture to an archive and compares every column of every chunk with csi_pcap_decode of the
+// capture, then checks the chunks csi_archive_find returns for time ranges and source macs against the
+// decoded frames. run by make test in utils/fwtest on the capture the firmware writes there.
+// usage: csi_archive_test <pcap file>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "csi_archive.h"
+#include "csi_decode_internal.h"
+
+#define MAX_TONES       256
+#define CHUNK_FRAMES    5
+#define MAX_CHUNKS      1024
+
+static int failed = 0;
+static struct csi_columns frames;
+static size_t n_frames;
+
+static void
+check(int ok, const char *what)
+{
+    printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+    failed |= !ok;
+}
+
+static int
+chunk_matches(uint32_t chunk, uint64_t ts_from, uint64_t ts_to, const uint8_t *src_mac)
+{
+    size_t f, end = (chunk + 1) * CHUNK_FRAMES < n_frames ? (chunk + 1) * CHUNK_FRAMES : n_frames;
+    uint64_t ts_min = UINT64_MAX, ts_max = 0;
+    int has_mac = src_mac == NULL;
+    for (f = chunk * CHUNK_FRAMES; f < end; f++) {
+        ts_min = frames.ts_usec[f] < ts_min ? frames.ts_usec[f] : ts_min;
+        ts_max = frames.ts_usec[f] > ts_max ? frames.ts_usec[f] : ts_max;
+        has_mac |= src_mac != NULL && memcmp(frames.src_mac + f * 6, src_mac, 6) == 0;
+    }
+    return has_mac && ts_min <= ts_to && ts_max >= ts_from;
+}
+
+// csi_archive_find returns exactly the chunks whose frames span the range and include src_mac
+static int
+find_is_exact(const struct csi_archive *a, uint64_t ts_from, uint64_t ts_to, const uint8_t *src_mac)
+{
+    uint32_t found[MAX_CHUNKS];
+    uint8_t returned[MAX_CHUNKS] = {0};
+    size_t i, n = csi_archive_find(a, ts_from, ts_to, src_mac, found, MAX_CHUNKS);
+    uint32_t c;
+    if (n > MAX_CHUNKS) {
+        return 0;
+    }
+    for (i = 0; i < n; i++) {
+        if (found[i] >= csi_archive_n_chunks(a) || returned[found[i]]) {
+            return 0;
+        }
+        returned[found[i]] = 1;
+    }
+    for (c = 0; c < csi_archive_n_chunks(a); c++) {
+        if (returned[c] != chunk_matches(c, ts_from, ts_to, src_mac)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+    static const uint8_t unknown_mac[6] = {0x02, 0, 0, 0, 0, 0x01};
+    char archive_file[] = "/tmp/csi_archive_test.XXXXXX";
+    struct csi_pcap *pcap;
+    struct csi_archive *a;
+    uint32_t c;
+    size_t f;
+    int i, fd, ok;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: csi_archive_test <pcap file>\n");
+        return 2;
+    }
+    pcap = csi_pcap_open(argv[1]);
+    fd = mkstemp(archive_file);
+    if (pcap == NULL || fd < 0) {
+        fprintf(stderr, "cannot read %s or write %s\n", argv[1], archive_file);
+        return 2;
+    }
+    close(fd);
+    n_frames = csi_pcap_count_frames(pcap);
+    frames.max_tones = MAX_TONES;
+    for (i = 0; i < CSI_RING_N_COLUMNS; i++) {
+        *csi_column_ptr(&frames, i) = calloc(n_frames, csi_column_size(i, MAX_TONES));
+    }
+    check(csi_pcap_decode(pcap, &frames, n_frames) == n_frames && n_frames > CHUNK_FRAMES, "capture decoded");
+    csi_pcap_close(pcap);
+
+    check(csi_archive_from_pcap(argv[1], archive_file, MAX_TONES, CHUNK_FRAMES) == (long) n_frames,
+        "archive written");
+    a = csi_archive_open(archive_file);
+    check(a != NULL && csi_archive_n_chunks(a) == (n_frames + CHUNK_FRAMES - 1) / CHUNK_FRAMES, "archive opened");
+    if (a == NULL) {
+        unlink(archive_file);
+        return 1;
+    }
+
+    // every column of every chunk equals the decoded frames
+    ok = 1;
+    for (c = 0, f = 0; c < csi_archive_n_chunks(a); c++) {
+        struct csi_columns chunk;
+        size_t n = csi_archive_chunk_columns(a, c, &chunk);
+        for (i = 0; i < CSI_RING_N_COLUMNS; i++) {
+            size_t size = csi_column_size(i, MAX_TONES);
+            if (f + n > n_frames || memcmp(*csi_column_ptr(&chunk, i), *csi_column_ptr(&frames, i) + f * size,
+                    n * size) != 0) {
+                printf("chunk %u: column %d differs\n", c, i);
+                ok = 0;
+            }
+        }
+        f += n;
+    }
+    check(ok && f == n_frames, "chunk columns equal csi_pcap_decode");
+
+    uint64_t first = frames.ts_usec[0], last = frames.ts_usec[n_frames - 1];
+    uint64_t mid_from = frames.ts_usec[n_frames / 3], mid_to = frames.ts_usec[2 * n_frames / 3];
+    check(find_is_exact(a, 0, UINT64_MAX, NULL), "find: all frames");
+    check(find_is_exact(a, mid_from, mid_to, NULL), "find: time range in the middle");
+    check(find_is_exact(a, first, first, NULL), "find: time of the first frame");
+    check(find_is_exact(a, last + 1, UINT64_MAX, NULL), "find: time range after the last frame");
+    ok = 1;
+    for (f = 0; f < n_frames; f++) {
+        ok &= find_is_exact(a, 0, UINT64_MAX, frames.src_mac + f * 6);
+        ok &= find_is_exact(a, mid_from, mid_to, frames.src_mac + f * 6);
+    }
+    check(ok, "find: source mac of every frame");
+    check(find_is_exact(a, 0, UINT64_MAX, unknown_mac), "find: unknown source mac");
+
+    csi_archive_close(a);
+    unlink(archive_file);
+    for (i = 0; i < CSI_RING_N_COLUMNS; i++) {
+        free(*csi_column_ptr(&frames, i));
+    }
+    printf("%s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
@@ -0,0 +1,506 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+#include "csi_decode.h"
+#include "csi_decode_internal.h"
+#include "csi_ring.h"
+#include "nexmon_csi.h"
+
+#define DEFAULT_PORT        5500
+#define DEFAULT_SHM_NAME    "/csi"
+#define DEFAULT_N_SLOTS     4096
+
+#define MIN_CSI_FRAME_LEN   24
+
+#define RX_BLOCK_SIZE       (1 << 18)
+#define RX_BLOCK_NR         32
+#define RX_FRAME_SIZE       (1 << 11)
+#define RX_BLOCK_TIMEOUT_MS 10
+
+#define NL_RCVBUF           (4 << 20)
+#define NL_MAX_DEVICES      16
+
+struct csi_ring {
+    struct csi_ring_header *hdr;
+    size_t size;
+    struct csi_columns cols;
+    uint64_t count;
+};
+
+struct capture_stats {
+    uint64_t packets;
+    uint64_t frames;
+};
+
+static volatile sig_atomic_t running = 1;
+
+void usage ()
+{
+    char *usage_str =
+        "Usage: csicapture [OPTION...]\n"
+        "\n"
+        "Decodes the csi frames the firmware sends to the host into a columnar shared memory ring.\n"
+        "\n"
+        "   -h           print this message\n"
+        "   -i ifname    capture on this interface (e.g. wlan0)\n"
+        "   -k device    read the csi ring of the driver (e.g. /dev/nexmon_csi0) instead of capturing\n"
+        "   -g           subscribe to the csi netlink group of the driver instead of capturing\n"
+        "   -r file      replay a pcap/pcapng file instead of capturing\n"
+        "   -p port      udp port of the csi frames (default is 5500)\n"
+        "   -s name      shared memory name of the ring (default is /csi)\n"
+        "   -n slots     number of frames in the ring (default is 4096)\n"
+        "   -t tones     number of tones per frame in the ring (default is 256)\n";
+    fprintf (stdout, "%s\n", usage_str);
+}
+
+static void
+stop(int sig)
+{
+    running = 0;
+}
+
+static size_t
+align64(size_t v)
+{
+    return (v + 63) & ~(size_t) 63;
+}
+
+static int
+ring_open(struct csi_ring *ring, const char *name, uint32_t n_slots, uint16_t max_tones)
+{
+    uint64_t offset[CSI_RING_N_COLUMNS];
+    size_t size = align64(sizeof(struct csi_ring_header));
+    int i;
+
+    for (i = 0; i < CSI_RING_N_COLUMNS; i++) {
+        offset[i] = size;
+        size = align64(size + csi_column_size(i, max_tones) * n_slots);
+    }
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        perror("shm_open");
+        return -1;
+    }
+    if (ftruncate(fd, size) < 0) {
+        perror("ftruncate");
+        close(fd);
+        return -1;
+    }
+    uint8_t *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    memset(base, 0, size);
+
+    ring->hdr = (struct csi_ring_header *) base;
+    ring->size = size;
+    ring->count = 0;
+    ring->hdr->version = CSI_RING_VERSION;
+    ring->hdr->max_tones = max_tones;
+    ring->hdr->n_slots = n_slots;
+    memcpy(ring->hdr->column_offset, offset, sizeof(offset));
+
+    for (i = 0; i < CSI_RING_N_COLUMNS; i++) {
+        *csi_column_ptr(&ring->cols, i) = base + offset[i];
+    }
+    ring->cols.max_tones = max_tones;
+
+    // readers check the magic last
+    __atomic_store_n(&ring->hdr->magic, CSI_RING_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// decodes the csi frames of one ethernet frame directly into the ring
+static void
+ring_write_packet(struct csi_ring *ring, const uint8_t *data, uint32_t caplen, uint64_t ts_usec,
+    struct capture_stats *stats)
+{
+    uint32_t n_slots = ring->hdr->n_slots;
+    size_t skip = 0;
+
+    stats->packets++;
+    for (;;) {
+        size_t idx = ring->count % n_slots;
+        size_t room = n_slots - idx;
+        // every csi frame takes at least MIN_CSI_FRAME_LEN bytes of the packet
+        size_t max_frames = caplen / MIN_CSI_FRAME_LEN + 1;
+        __atomic_store_n(&ring->hdr->write_begin, ring->count + (max_frames < room ? max_frames : room),
+            __ATOMIC_RELEASE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        size_t n = csi_decode_packet(data, caplen, ts_usec, skip, &ring->cols, idx, room);
+        ring->count += n;
+        stats->frames += n;
+        __atomic_store_n(&ring->hdr->write_count, ring->count, __ATOMIC_RELEASE);
+        if (n < room) {
+            break;
+        }
+        skip += n;
+    }
+}
+
+static int
+replay(struct csi_ring *ring, const char *filename, struct capture_stats *stats)
+{
+    const uint8_t *data;
+    uint32_t caplen;
+    uint64_t ts_usec;
+    struct csi_pcap *pcap = csi_pcap_open(filename);
+    if (pcap == NULL) {
+        fprintf (stderr, "Cannot open %s\n", filename);
+        return -1;
+    }
+    while (running && csi_pcap_next_packet(pcap, &data, &caplen, &ts_usec)) {
+        ring_write_packet(ring, data, caplen, ts_usec, stats);
+    }
+    csi_pcap_close(pcap);
+    return 0;
+}
+
+// accepts ipv4/udp frames to port with one of the csi magics in kk1
+static int
+attach_filter(int fd, uint16_t port)
+{
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),                 // ethertype
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 12),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),                 // ip protocol
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 10),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),                 // fragment offset
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 8, 0),
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),                // ip header length
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),                 // udp destination port
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 5),
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 22),                 // kk1, loaded big endian
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x1111, 2, 0),      // CSI_FRAME_MAGIC
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x1211, 1, 0),      // CSI_FRAME_MAGIC_COMPACT
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x1311, 0, 1),      // CSI_FRAME_MAGIC_BATCH
+        BPF_STMT(BPF_RET | BPF_K, 0x40000),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct sock_fprog prog = { sizeof(code) / sizeof(code[0]), code };
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+}
+
+static int
+capture(struct csi_ring *ring, const char *ifname, uint16_t port, struct capture_stats *stats)
+{
+    int version = TPACKET_V3;
+    struct tpacket_req3 req;
+    struct sockaddr_ll sll;
+    unsigned int block = 0;
+
+    unsigned int ifindex = if_nametoindex(ifname);
+    if (ifindex == 0) {
+        fprintf (stderr, "Invalid interface %s\n", ifname);
+        return -1;
+    }
+    int fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_IP));
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        perror("PACKET_VERSION");
+        close(fd);
+        return -1;
+    }
+    if (attach_filter(fd, port) < 0) {
+        perror("SO_ATTACH_FILTER");
+        close(fd);
+        return -1;
+    }
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = RX_BLOCK_SIZE;
+    req.tp_block_nr = RX_BLOCK_NR;
+    req.tp_frame_size = RX_FRAME_SIZE;
+    req.tp_frame_nr = (RX_BLOCK_SIZE / RX_FRAME_SIZE) * RX_BLOCK_NR;
+    req.tp_retire_blk_tov = RX_BLOCK_TIMEOUT_MS;
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        perror("PACKET_RX_RING");
+        close(fd);
+        return -1;
+    }
+    uint8_t *rx_ring = mmap(NULL, (size_t) RX_BLOCK_SIZE * RX_BLOCK_NR, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (rx_ring == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        return -1;
+    }
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex = ifindex;
+    if (bind(fd, (struct sockaddr *) &sll, sizeof(sll)) < 0) {
+        perror("bind");
+        munmap(rx_ring, (size_t) RX_BLOCK_SIZE * RX_BLOCK_NR);
+        close(fd);
+        return -1;
+    }
+
+    struct pollfd pfd = { fd, POLLIN | POLLERR, 0 };
+    while (running) {
+        struct tpacket_block_desc *bd = (struct tpacket_block_desc *) (rx_ring + (size_t) block * RX_BLOCK_SIZE);
+        if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            poll(&pfd, 1, 100);
+            continue;
+        }
+        // frames are decoded where the kernel put them
+        struct tpacket3_hdr *ppd = (struct tpacket3_hdr *) ((uint8_t *) bd + bd->hdr.bh1.offset_to_first_pkt);
+        uint32_t i;
+        for (i = 0; i < bd->hdr.bh1.num_pkts; i++) {
+            ring_write_packet(ring, (uint8_t *) ppd + ppd->tp_mac, ppd->tp_snaplen,
+                (uint64_t) ppd->tp_sec * 1000000 + ppd->tp_nsec / 1000, stats);
+            ppd = (struct tpacket3_hdr *) ((uint8_t *) ppd + ppd->tp_next_offset);
+        }
+        __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        block = (block + 1) % RX_BLOCK_NR;
+    }
+
+    struct tpacket_stats_v3 tp_stats;
+    socklen_t len = sizeof(tp_stats);
+    if (getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &tp_stats, &len) == 0) {
+        fprintf (stdout, "kernel drops: %u\n", tp_stats.tp_drops);
+    }
+    munmap(rx_ring, (size_t) RX_BLOCK_SIZE * RX_BLOCK_NR);
+    close(fd);
+    return 0;
+}
+
+// reads the frames that the driver copied to its csi ring (see nexmon_csi.h)
+static int
+kernel_capture(struct csi_ring *ring, const char *device, struct capture_stats *stats)
+{
+    struct nexmon_csi_ring *kring;
+    size_t len = sysconf(_SC_PAGESIZE);
+
+    int fd = open(device, O_RDWR);
+    if (fd < 0) {
+        perror(device);
+        return -1;
+    }
+    kring = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    if (kring == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        return -1;
+    }
+    if (kring->magic != NEXMON_CSI_RING_MAGIC || kring->version != NEXMON_CSI_RING_VERSION) {
+        fprintf (stderr, "%s is no csi ring of a known version\n", device);
+        munmap(kring, len);
+        close(fd);
+        return -1;
+    }
+    size_t map_len = (size_t) kring->data_offset + kring->size;
+    munmap(kring, len);
+    len = map_len;
+    kring = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (kring == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        return -1;
+    }
+    const uint8_t *data = (const uint8_t *) kring + kring->data_offset;
+    uint32_t size = kring->size;
+    uint32_t tail = kring->tail;
+
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    while (running) {
+        uint32_t head = __atomic_load_n(&kring->head, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            poll(&pfd, 1, 100);
+            continue;
+        }
+        while (tail != head) {
+            const struct nexmon_csi_record *rec = (const struct nexmon_csi_record *) (data + (tail & (size - 1)));
+            if (rec->flags & NEXMON_CSI_RECORD_SKIP) {
+                tail += size - (tail & (size - 1));
+                continue;
+            }
+            ring_write_packet(ring, (const uint8_t *) (rec + 1), rec->len, rec->ts_nsec / 1000, stats);
+            tail += (sizeof(*rec) + rec->len + NEXMON_CSI_RECORD_ALIGN - 1) & ~(NEXMON_CSI_RECORD_ALIGN - 1);
+        }
+        __atomic_store_n(&kring->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    fprintf (stdout, "driver drops: %llu\n", (unsigned long long) kring->dropped);
+    munmap(kring, len);
+    close(fd);
+    return 0;
+}
+
+// receives the csi batches of the driver's netlink group (see nexmon_csi.h)
+static int
+netlink_capture(struct csi_ring *ring, struct capture_stats *stats)
+{
+    struct sockaddr_nl sa;
+    uint32_t next_seq[NL_MAX_DEVICES];
+    uint32_t seen = 0;
+    uint64_t lost = 0, overruns = 0;
+    int rcvbuf = NL_RCVBUF;
+    static uint8_t buf[1 << 16];
+
+    int fd = socket(AF_NETLINK, SOCK_RAW, NEXMON_NL_USER);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    // a larger buffer only delays drops, the driver never waits for this socket
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups = 1 << (NEXMON_NL_GRP_CSI - 1);
+    if (bind(fd, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    while (running) {
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        ssize_t len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == ENOBUFS) {
+                overruns++;
+            }
+            continue;
+        }
+        struct nlmsghdr *nlh;
+        for (nlh = (struct nlmsghdr *) buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type != NEXMON_NL_CSI_BATCH || NLMSG_PAYLOAD(nlh, 0) < sizeof(struct nexmon_csi_batch)) {
+                continue;
+            }
+            const struct nexmon_csi_batch *batch = NLMSG_DATA(nlh);
+            const uint8_t *pos = (const uint8_t *) (batch + 1);
+            const uint8_t *end = (const uint8_t *) NLMSG_DATA(nlh) + NLMSG_PAYLOAD(nlh, 0);
+            if (batch->dev < NL_MAX_DEVICES) {
+                if (seen & (1u << batch->dev)) {
+                    lost += batch->seq - next_seq[batch->dev];
+                }
+                seen |= 1u << batch->dev;
+                next_seq[batch->dev] = batch->seq + 1;
+            }
+            uint16_t i;
+            for (i = 0; i < batch->n_records; i++) {
+                const struct nexmon_csi_record *rec = (const struct nexmon_csi_record *) pos;
+                if ((size_t) (end - pos) < sizeof(*rec) || (size_t) (end - pos) < sizeof(*rec) + rec->len) {
+                    break;
+                }
+                ring_write_packet(ring, (const uint8_t *) (rec + 1), rec->len, rec->ts_nsec / 1000, stats);
+                pos += (sizeof(*rec) + rec->len + NEXMON_CSI_RECORD_ALIGN - 1) & ~(NEXMON_CSI_RECORD_ALIGN - 1);
+            }
+        }
+    }
+
+    fprintf (stdout, "lost batches: %llu, overruns: %llu\n", (unsigned long long) lost,
+        (unsigned long long) overruns);
+    close(fd);
+    return 0;
+}
+
+int main (int argc, char **argv)
+{
+    char *ifname = NULL;
+    char *replay_file = NULL;
+    char *device = NULL;
+    int use_netlink = 0;
+    char *shm_name = DEFAULT_SHM_NAME;
+    long port = DEFAULT_PORT;
+    long n_slots = DEFAULT_N_SLOTS;
+    long max_tones = CSI_MAX_TONES;
+    struct csi_ring ring;
+    struct capture_stats stats = { 0, 0 };
+    int c, ret;
+
+    while ((c = getopt(argc, argv, "hi:k:gr:p:s:n:t:")) != EOF) {
+        switch (c) {
+            case 'h':
+                usage ();
+                return 0;
+            case 'i':
+                ifname = optarg;
+                break;
+            case 'k':
+                device = optarg;
+                break;
+            case 'g':
+                use_netlink = 1;
+                break;
+            case 'r':
+                replay_file = optarg;
+                break;
+            case 'p':
+                port = strtol(optarg, NULL, 0);
+                if (port <= 0 || port > 0xffff) {
+                    fprintf (stderr, "Invalid port\n");
+                    return 1;
+                }
+                break;
+            case 's':
+                shm_name = optarg;
+                break;
+            case 'n':
+                n_slots = strtol(optarg, NULL, 0);
+                if (n_slots <= 0 || n_slots > 0x1000000) {
+                    fprintf (stderr, "Invalid number of slots\n");
+                    return 1;
+                }
+                break;
+            case 't':
+                max_tones = strtol(optarg, NULL, 0);
+                if (max_tones <= 0 || max_tones > CSI_MAX_TONES) {
+                    fprintf (stderr, "Invalid number of tones\n");
+                    return 1;
+                }
+                break;
+            default:
+                fprintf (stderr, "Invalid option\n");
+                usage ();
+                return 1;
+        }
+    }
+    if ((ifname != NULL) + (replay_file != NULL) + (device != NULL) + use_netlink != 1) {
+        fprintf (stderr, "Give either an interface, a csi device, -g or a file to replay\n");
+        return 1;
+    }
+
+    if (ring_open(&ring, shm_name, n_slots, max_tones) < 0) {
+        return 1;
+    }
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    if (replay_file) {
+        ret = replay(&ring, replay_file, &stats);
+    } else if (device) {
+        ret = kernel_capture(&ring, device, &stats);
+    } else if (use_netlink) {
+        ret = netlink_capture(&ring, &stats);
+    } else {
+        ret = capture(&ring, ifname, port, &stats);
+    }
+    fprintf (stdout, "packets: %llu, csi frames: %llu\n",
+        (unsigned long long) stats.packets, (unsigned long long) stats.frames);
+    munmap(ring.hdr, ring.size);
+    return ret < 0;
+}
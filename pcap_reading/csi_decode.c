@@ -0,0 +1,836 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "csi_decode.h"
+#include "csi_decode_internal.h"
+
+#define PCAP_MAGIC_USEC         0xa1b2c3d4
+#define PCAP_MAGIC_NSEC         0xa1b23c4d
+#define PCAP_FILE_HEADER_LEN    24
+#define PCAP_RECORD_HEADER_LEN  16
+#define PCAP_LINKTYPE_ETHERNET  1
+
+#define ETH_HEADER_LEN          14
+#define ETHERTYPE_IPV4          0x0800
+#define IPPROTO_UDP_NUM         17
+#define UDP_HEADER_LEN          8
+
+// offsets in the udp payload, see struct csi_udp_frame in src/csi_extractor.c
+#define FRAME_KK1               0
+#define FRAME_RSSI              2
+#define FRAME_FC                3
+#define FRAME_SRC_MAC           4
+#define FRAME_SEQ_CNT           10
+#define FRAME_CSICONF           12
+#define FRAME_CHANSPEC          14
+#define FRAME_CHIP              16
+#define FRAME_GAINS             18
+#define FRAME_AGC_GAIN          66
+#define FRAME_FLAGS             68
+#define FRAME_HEADER_LEN        70
+
+// offsets in the udp payload, see struct csi_udp_frame_compact in src/csi_extractor.c
+#define COMPACT_GAIN_TYPE_MASK  18
+#define COMPACT_FLAGS           19
+#define COMPACT_AGC_GAIN        20
+#define COMPACT_GAINS           22
+
+// headers of older tool versions, the first 18 bytes are the same as in the current header
+#define LEGACY_HEADER_LEN       18
+#define LEGACY_PHYSTATUS_LEN    22
+#define LEGACY_GAIN_HEADER_LEN  30
+#define LEGACY_GAINS            18
+#define LEGACY_AGC_GAIN         26
+#define LEGACY_GAIN_TYPE        (CSI_N_GAIN_TYPES - 1)      /* gain_type 10 */
+
+// struct csi_ext_header, later versions append fields and have a larger len
+#define EXT_VERSION             0
+#define EXT_LEN                 1
+#define EXT_RX_TSF_TIME         2
+#define EXT_TSF_L               4
+#define EXT_PHYSTATUS           8
+#define EXT_TSF_H               20
+#define EXT_SWEEP_STEP          24
+#define EXT_HEADER_LEN_V1       20
+#define EXT_HEADER_LEN_V2       24
+#define EXT_HEADER_LEN_V3       28
+
+#define TONE_DESC_LEN           36
+#define BATCH_HEADER_LEN        4
+
+#define PCAPNG_BLOCK_SHB         0x0a0d0d0a
+#define PCAPNG_BLOCK_IDB         0x00000001
+#define PCAPNG_BLOCK_EPB         0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC  0x1a2b3c4d
+#define PCAPNG_OPT_IF_TSRESOL    9
+#define STREAM_READ_LEN          65536
+
+struct csi_stream {
+    int fd;
+    struct capture_format fmt;
+    int have_header;
+    int failed;
+    uint8_t *buf;                       /* bytes read from the file but not decoded yet */
+    size_t start;
+    size_t len;
+    size_t cap;
+    uint64_t offset;                    /* file offset of buf[start] */
+    struct batch_state batch;
+};
+
+const struct csi_column_desc csi_column_desc[CSI_RING_N_COLUMNS] = {
+    { offsetof(struct csi_columns, ts_usec), 8 },
+    { offsetof(struct csi_columns, src_mac), 6 },
+    { offsetof(struct csi_columns, seq_cnt), 2 },
+    { offsetof(struct csi_columns, fc), 1 },
+    { offsetof(struct csi_columns, csiconf), 2 },
+    { offsetof(struct csi_columns, chanspec), 2 },
+    { offsetof(struct csi_columns, chip), 2 },
+    { offsetof(struct csi_columns, rssi), 1 },
+    { offsetof(struct csi_columns, gain_type_mask), 1 },
+    { offsetof(struct csi_columns, gains), CSI_N_GAIN_STAGES * CSI_N_GAIN_TYPES },
+    { offsetof(struct csi_columns, agc_gain), 2 },
+    { offsetof(struct csi_columns, flags), 2 },
+    { offsetof(struct csi_columns, n_tones), 2 },
+    { offsetof(struct csi_columns, csi), 0 },
+    { offsetof(struct csi_columns, phystatus), CSI_N_PHYSTATUS * 2 },
+    { offsetof(struct csi_columns, rx_tsf_time), 2 },
+    { offsetof(struct csi_columns, tsf), 8 },
+    { offsetof(struct csi_columns, sweep_step), 2 },
+};
+
+static inline uint16_t
+ld16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t
+ld32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline size_t
+pad4(size_t len)
+{
+    return (len + 3) & ~(size_t) 3;
+}
+
+// returns the udp payload of an ethernet/ipv4/udp frame or NULL
+static const uint8_t *
+udp_payload(const uint8_t *pkt, uint32_t caplen, uint32_t *len)
+{
+    if (caplen < ETH_HEADER_LEN + 20 + UDP_HEADER_LEN) {
+        return NULL;
+    }
+    if (((pkt[12] << 8) | pkt[13]) != ETHERTYPE_IPV4) {
+        return NULL;
+    }
+    const uint8_t *ip = pkt + ETH_HEADER_LEN;
+    uint32_t ihl = (ip[0] & 0x0f) * 4;
+    if (ip[9] != IPPROTO_UDP_NUM || caplen < ETH_HEADER_LEN + ihl + UDP_HEADER_LEN) {
+        return NULL;
+    }
+    *len = caplen - ETH_HEADER_LEN - ihl - UDP_HEADER_LEN;
+    return ip + ihl + UDP_HEADER_LEN;
+}
+
+static int
+is_csi_frame(const uint8_t *frm, uint32_t len)
+{
+    if (len < 2) {
+        return 0;
+    }
+    uint16_t kk1 = ld16(frm + FRAME_KK1);
+    if (kk1 == CSI_FRAME_MAGIC) {
+        return len >= FRAME_HEADER_LEN;
+    }
+    if (kk1 == CSI_FRAME_MAGIC_COMPACT) {
+        return len >= COMPACT_GAINS;
+    }
+    return 0;
+}
+
+static int
+is_batch(const uint8_t *frm, uint32_t len)
+{
+    return len >= BATCH_HEADER_LEN && ld16(frm + FRAME_KK1) == CSI_FRAME_MAGIC_BATCH;
+}
+
+static int
+popcount8(uint8_t v)
+{
+    int n = 0;
+    for (; v; v >>= 1) {
+        n += v & 1;
+    }
+    return n;
+}
+
+// number of tones of the channel bandwidth in chanspec, 0 if unknown
+static int
+chanspec_tones(uint16_t chanspec)
+{
+    switch ((chanspec & 0x3800) >> 11) {
+        case 2: return 64;
+        case 3: return 128;
+        case 4: return 256;
+    }
+    return 0;
+}
+
+// header length of a frame of an older tool version, 0 for the current layouts. the length of the header is
+// what remains after the csi of all tones of the bandwidth
+static uint32_t
+legacy_header_len(const uint8_t *frm, uint32_t len)
+{
+    int tones = chanspec_tones(ld16(frm + FRAME_CHANSPEC));
+    if (tones == 0 || len < (uint32_t) tones * 4) {
+        return 0;
+    }
+    uint32_t hdr_len = len - tones * 4;
+    if (hdr_len != LEGACY_HEADER_LEN && hdr_len != LEGACY_PHYSTATUS_LEN && hdr_len != LEGACY_GAIN_HEADER_LEN) {
+        return 0;
+    }
+    // a frame with tone selection can have the same length, then its tone descriptor accounts for the length
+    uint16_t flags = ld16(frm + FRAME_FLAGS);
+    if ((flags & CSI_FLAG_TONE_SELECT)
+            && !(flags & ~(CSI_FLAG_TONE_SELECT | CSI_FLAG_PACKED14 | CSI_FLAG_EXT_HEADER))) {
+        uint32_t desc = FRAME_HEADER_LEN;
+        if ((flags & CSI_FLAG_EXT_HEADER) && desc + EXT_HEADER_LEN_V1 <= len) {
+            desc += frm[desc + EXT_LEN];
+        }
+        if (desc + TONE_DESC_LEN <= len) {
+            uint32_t n = ld16(frm + desc + 2);
+            uint32_t csi_len = (flags & CSI_FLAG_PACKED14) ? pad4((n * 7 + 1) / 2) : n * 4;
+            if (desc + TONE_DESC_LEN + csi_len == len) {
+                return 0;
+            }
+        }
+    }
+    return hdr_len;
+}
+
+static void
+store_tone(struct csi_columns *cols, size_t idx, int tone, int16_t re, int16_t im)
+{
+    if (tone < cols->max_tones) {
+        int16_t *dst = cols->csi + (idx * cols->max_tones + tone) * 2;
+        dst[0] = re;
+        dst[1] = im;
+    }
+}
+
+static void
+decode_csi(const uint8_t *csi, uint32_t len, int n_tones, const uint8_t *tone_mask, int packed,
+    struct csi_columns *cols, size_t idx)
+{
+    int i;
+    int tone = -1;
+    memset(cols->csi + idx * cols->max_tones * 2, 0, cols->max_tones * 2 * sizeof(int16_t));
+    for (i = 0; i < n_tones; i++) {
+        // next tone index, either consecutive or the next bit set in the tone mask
+        tone++;
+        if (tone_mask) {
+            while (tone < CSI_MAX_TONES && !(tone_mask[tone >> 3] & (1 << (tone & 7)))) {
+                tone++;
+            }
+            if (tone >= CSI_MAX_TONES) {
+                break;
+            }
+        }
+        if (packed) {
+            const uint8_t *b = csi + (i >> 1) * 7;
+            uint32_t v;
+            if ((i & 1) == 0) {
+                v = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t) (b[3] & 0x0f) << 24);
+            } else {
+                v = (b[3] >> 4) | (b[4] << 4) | (b[5] << 12) | ((uint32_t) b[6] << 20);
+            }
+            // sign extend int14
+            int16_t re = (int16_t) ((int32_t) (((v >> 14) & 0x3fff) << 18) >> 18);
+            int16_t im = (int16_t) ((int32_t) ((v & 0x3fff) << 18) >> 18);
+            store_tone(cols, idx, tone, re, im);
+        } else {
+            store_tone(cols, idx, tone, (int16_t) ld16(csi + i * 4), (int16_t) ld16(csi + i * 4 + 2));
+        }
+    }
+}
+
+static void
+decode_frame(const uint8_t *frm, uint32_t len, uint64_t ts_usec, struct csi_columns *cols, size_t idx)
+{
+    uint16_t kk1 = ld16(frm + FRAME_KK1);
+    uint32_t legacy_len = kk1 == CSI_FRAME_MAGIC ? legacy_header_len(frm, len) : 0;
+    uint16_t flags;
+    uint8_t gain_type_mask;
+    uint32_t hdr_len;
+    int16_t agc_gain;
+    int t, s;
+
+    if (kk1 == CSI_FRAME_MAGIC_COMPACT) {
+        gain_type_mask = frm[COMPACT_GAIN_TYPE_MASK] & ((1 << CSI_N_GAIN_TYPES) - 1);
+        flags = frm[COMPACT_FLAGS];
+        agc_gain = (int16_t) ld16(frm + COMPACT_AGC_GAIN);
+        hdr_len = COMPACT_GAINS + popcount8(gain_type_mask) * CSI_N_GAIN_STAGES;
+    } else if (legacy_len) {
+        // no flags, no header extension, only the gain recovery header has gains
+        int has_gains = legacy_len == LEGACY_GAIN_HEADER_LEN;
+        gain_type_mask = has_gains ? 1 << LEGACY_GAIN_TYPE : 0;
+        flags = CSI_FLAG_LEGACY | (legacy_len == LEGACY_PHYSTATUS_LEN ? CSI_FLAG_LEGACY_PHYSTATUS : 0);
+        agc_gain = has_gains ? (int16_t) ld16(frm + LEGACY_AGC_GAIN) : 0;
+        hdr_len = legacy_len;
+    } else {
+        gain_type_mask = (1 << CSI_N_GAIN_TYPES) - 1;
+        flags = ld16(frm + FRAME_FLAGS);
+        agc_gain = (int16_t) ld16(frm + FRAME_AGC_GAIN);
+        hdr_len = FRAME_HEADER_LEN;
+    }
+
+    if (cols->ts_usec) cols->ts_usec[idx] = ts_usec;
+    if (cols->src_mac) memcpy(cols->src_mac + idx * 6, frm + FRAME_SRC_MAC, 6);
+    if (cols->seq_cnt) cols->seq_cnt[idx] = ld16(frm + FRAME_SEQ_CNT);
+    if (cols->fc) cols->fc[idx] = frm[FRAME_FC];
+    if (cols->csiconf) cols->csiconf[idx] = ld16(frm + FRAME_CSICONF);
+    if (cols->chanspec) cols->chanspec[idx] = ld16(frm + FRAME_CHANSPEC);
+    if (cols->chip) cols->chip[idx] = ld16(frm + FRAME_CHIP);
+    if (cols->rssi) cols->rssi[idx] = (int8_t) frm[FRAME_RSSI];
+    if (cols->gain_type_mask) cols->gain_type_mask[idx] = gain_type_mask;
+    if (cols->agc_gain) cols->agc_gain[idx] = agc_gain;
+    if (cols->flags) cols->flags[idx] = flags;
+
+    if (cols->gains) {
+        int8_t *gains = cols->gains + idx * CSI_N_GAIN_STAGES * CSI_N_GAIN_TYPES;
+        if (kk1 == CSI_FRAME_MAGIC_COMPACT) {
+            // compact frames carry one record of all stages per selected gain type
+            const uint8_t *rec = frm + COMPACT_GAINS;
+            memset(gains, 0, CSI_N_GAIN_STAGES * CSI_N_GAIN_TYPES);
+            for (t = 0; t < CSI_N_GAIN_TYPES; t++) {
+                if (!(gain_type_mask & (1 << t)) || rec + CSI_N_GAIN_STAGES > frm + len) {
+                    continue;
+                }
+                for (s = 0; s < CSI_N_GAIN_STAGES; s++) {
+                    gains[s * CSI_N_GAIN_TYPES + t] = (int8_t) rec[s];
+                }
+                rec += CSI_N_GAIN_STAGES;
+            }
+        } else if (legacy_len) {
+            memset(gains, 0, CSI_N_GAIN_STAGES * CSI_N_GAIN_TYPES);
+            if (gain_type_mask) {
+                for (s = 0; s < CSI_N_GAIN_STAGES; s++) {
+                    gains[s * CSI_N_GAIN_TYPES + LEGACY_GAIN_TYPE] = (int8_t) frm[LEGACY_GAINS + s];
+                }
+            }
+        } else {
+            memcpy(gains, frm + FRAME_GAINS, CSI_N_GAIN_STAGES * CSI_N_GAIN_TYPES);
+        }
+    }
+
+    // receive status in the header instead of the csi
+    const uint8_t *ext = NULL;
+    if ((flags & CSI_FLAG_EXT_HEADER) && hdr_len + EXT_HEADER_LEN_V1 <= len
+            && frm[hdr_len + EXT_LEN] >= EXT_HEADER_LEN_V1 && hdr_len + frm[hdr_len + EXT_LEN] <= len) {
+        ext = frm + hdr_len;
+        hdr_len += ext[EXT_LEN];
+    }
+    if (cols->phystatus) {
+        for (t = 0; t < CSI_N_PHYSTATUS; t++) {
+            cols->phystatus[idx * CSI_N_PHYSTATUS + t] = ext ? ld16(ext + EXT_PHYSTATUS + t * 2) : 0;
+        }
+    }
+    if (cols->rx_tsf_time) cols->rx_tsf_time[idx] = ext ? ld16(ext + EXT_RX_TSF_TIME) : 0;
+    if (cols->tsf) {
+        uint64_t tsf_h = ext && ext[EXT_LEN] >= EXT_HEADER_LEN_V2 ? ld32(ext + EXT_TSF_H) : 0;
+        cols->tsf[idx] = ext ? (tsf_h << 32) | ld32(ext + EXT_TSF_L) : 0;
+    }
+    if (cols->sweep_step) {
+        cols->sweep_step[idx] = ext && ext[EXT_LEN] >= EXT_HEADER_LEN_V3 ? ld16(ext + EXT_SWEEP_STEP) : CSI_SWEEP_NONE;
+    }
+
+    const uint8_t *tone_mask = NULL;
+    int n_tones = -1;
+    if ((flags & CSI_FLAG_TONE_SELECT) && hdr_len + TONE_DESC_LEN <= len) {
+        n_tones = ld16(frm + hdr_len + 2);
+        tone_mask = frm + hdr_len + 4;
+        hdr_len += TONE_DESC_LEN;
+    }
+    uint32_t csi_len = len > hdr_len ? len - hdr_len : 0;
+    int packed = flags & CSI_FLAG_PACKED14;
+    int max_in_payload = packed ? csi_len * 2 / 7 : csi_len / 4;
+    if (n_tones < 0) {
+        // packed frames are padded, so the bandwidth tells the number of tones
+        n_tones = packed ? chanspec_tones(ld16(frm + FRAME_CHANSPEC)) : max_in_payload;
+        if (n_tones == 0) {
+            n_tones = max_in_payload;
+        }
+    }
+    if (n_tones > max_in_payload) {
+        n_tones = max_in_payload;
+    }
+    if (cols->n_tones) cols->n_tones[idx] = n_tones;
+    if (cols->csi) {
+        decode_csi(frm + hdr_len, csi_len, n_tones, tone_mask, packed, cols, idx);
+    }
+}
+
+// converts a pcapng timestamp with resolution 10^-tsresol or 2^-(tsresol & 0x7f) seconds to us
+static uint64_t
+pcapng_ts_usec(uint64_t ts, uint8_t tsresol)
+{
+    if (tsresol & 0x80) {
+        int shift = tsresol & 0x7f;
+        if (shift >= 64) {
+            return 0;
+        }
+        uint64_t frac = ts & ((1ULL << shift) - 1);
+        return (ts >> shift) * 1000000 + ((frac * 1000000) >> shift);
+    }
+    uint64_t scale = 1;
+    int i;
+    for (i = 6; i < tsresol; i++) {
+        scale *= 10;
+    }
+    if (tsresol >= 6) {
+        return ts / scale;
+    }
+    for (i = tsresol; i < 6; i++) {
+        scale *= 10;
+    }
+    return ts * scale;
+}
+
+static void
+parse_pcapng_idb(struct capture_format *fmt, const uint8_t *blk, uint32_t blen)
+{
+    if (fmt->n_ifs >= PCAPNG_MAX_INTERFACES || blen < 20) {
+        fmt->n_ifs++;
+        return;
+    }
+    fmt->ifs[fmt->n_ifs].linktype = ld16(blk + 8);
+    fmt->ifs[fmt->n_ifs].tsresol = 6;
+    // options between the fixed fields and the trailing block length
+    size_t pos = 16;
+    while (pos + 4 <= blen - 4) {
+        uint16_t code = ld16(blk + pos);
+        uint16_t olen = ld16(blk + pos + 2);
+        if (code == 0 || pos + 4 + olen > blen - 4) {
+            break;
+        }
+        if (code == PCAPNG_OPT_IF_TSRESOL && olen >= 1) {
+            fmt->ifs[fmt->n_ifs].tsresol = blk[pos + 4];
+        }
+        pos += 4 + pad4(olen);
+    }
+    fmt->n_ifs++;
+}
+
+size_t
+capture_parse_block(struct capture_format *fmt, const uint8_t *buf, size_t avail, struct packet *pkt)
+{
+    pkt->data = NULL;
+    if (!fmt->pcapng) {
+        if (avail < PCAP_RECORD_HEADER_LEN) {
+            return BLOCK_INCOMPLETE;
+        }
+        uint32_t caplen = ld32(buf + 8);
+        if (caplen > CAPTURE_MAX_BLOCK_LEN || (fmt->snaplen && caplen > fmt->snaplen)) {
+            return BLOCK_INVALID;
+        }
+        if (avail < PCAP_RECORD_HEADER_LEN + (size_t) caplen) {
+            return BLOCK_INCOMPLETE;
+        }
+        pkt->ts_usec = (uint64_t) ld32(buf) * 1000000 + (fmt->nsec ? ld32(buf + 4) / 1000 : ld32(buf + 4));
+        pkt->data = buf + PCAP_RECORD_HEADER_LEN;
+        pkt->caplen = caplen;
+        return PCAP_RECORD_HEADER_LEN + caplen;
+    }
+
+    if (avail < 12) {
+        return BLOCK_INCOMPLETE;
+    }
+    uint32_t type = ld32(buf);
+    uint32_t blen = ld32(buf + 4);
+    if (blen < 12 || (blen & 3) || blen > CAPTURE_MAX_BLOCK_LEN) {
+        return BLOCK_INVALID;
+    }
+    if (avail < blen) {
+        return BLOCK_INCOMPLETE;
+    }
+    if (type == PCAPNG_BLOCK_SHB) {
+        // only little endian sections are supported
+        if (blen < 28 || ld32(buf + 8) != PCAPNG_BYTE_ORDER_MAGIC) {
+            return BLOCK_INVALID;
+        }
+        fmt->n_ifs = 0;
+    } else if (type == PCAPNG_BLOCK_IDB) {
+        parse_pcapng_idb(fmt, buf, blen);
+    } else if (type == PCAPNG_BLOCK_EPB && blen >= 32) {
+        uint32_t ifid = ld32(buf + 8);
+        uint32_t caplen = ld32(buf + 20);
+        if (ifid < fmt->n_ifs && ifid < PCAPNG_MAX_INTERFACES && 28 + (size_t) caplen + 4 <= blen
+                && fmt->ifs[ifid].linktype == PCAP_LINKTYPE_ETHERNET) {
+            uint64_t ts = ((uint64_t) ld32(buf + 12) << 32) | ld32(buf + 16);
+            pkt->ts_usec = pcapng_ts_usec(ts, fmt->ifs[ifid].tsresol);
+            pkt->data = buf + 28;
+            pkt->caplen = caplen;
+        }
+    }
+    return blen;
+}
+
+int
+capture_parse_header(struct capture_format *fmt, const uint8_t *buf, size_t avail, size_t *hdr_len)
+{
+    memset(fmt, 0, sizeof(*fmt));
+    if (avail < 4) {
+        return 0;
+    }
+    uint32_t magic = ld32(buf);
+    if (magic == PCAPNG_BLOCK_SHB) {
+        // the section header block is parsed like every other block
+        fmt->pcapng = 1;
+        *hdr_len = 0;
+        return 1;
+    }
+    if (magic != PCAP_MAGIC_USEC && magic != PCAP_MAGIC_NSEC) {
+        return -1;
+    }
+    if (avail < PCAP_FILE_HEADER_LEN) {
+        return 0;
+    }
+    if (ld32(buf + 20) != PCAP_LINKTYPE_ETHERNET) {
+        return -1;
+    }
+    fmt->nsec = magic == PCAP_MAGIC_NSEC;
+    fmt->snaplen = ld32(buf + 16);
+    *hdr_len = PCAP_FILE_HEADER_LEN;
+    return 1;
+}
+
+// decodes the remaining records of the current batch
+static size_t
+decode_batch(struct batch_state *bs, const uint8_t *batch, uint32_t len, uint64_t ts_usec,
+    struct csi_columns *cols, size_t idx, size_t max_frames)
+{
+    size_t n = 0;
+    while (bs->left > 0 && idx + n < max_frames) {
+        if (bs->pos + 2 > len) {
+            bs->left = 0;
+            break;
+        }
+        uint16_t rec_len = ld16(batch + bs->pos);
+        const uint8_t *rec = batch + bs->pos + 2;
+        bs->pos += 2 + rec_len;
+        bs->left--;
+        if (bs->pos > len) {
+            bs->left = 0;
+            break;
+        }
+        if (is_csi_frame(rec, rec_len)) {
+            decode_frame(rec, rec_len, ts_usec, cols, idx + n);
+            n++;
+        }
+    }
+    return n;
+}
+
+size_t
+capture_decode_packet(struct batch_state *bs, const struct packet *pkt, struct csi_columns *cols,
+    size_t idx, size_t max_frames)
+{
+    uint32_t len;
+    const uint8_t *frm = pkt->data ? udp_payload(pkt->data, pkt->caplen, &len) : NULL;
+    uint64_t ts_usec = pkt->ts_usec;
+
+    if (frm == NULL) {
+        bs->left = 0;
+        return 0;
+    }
+    if (bs->left == 0) {
+        if (is_batch(frm, len)) {
+            bs->pos = BATCH_HEADER_LEN;
+            bs->left = ld16(frm + 2);
+        } else {
+            if (is_csi_frame(frm, len)) {
+                decode_frame(frm, len, ts_usec, cols, idx);
+                return 1;
+            }
+            return 0;
+        }
+    }
+    return decode_batch(bs, frm, len, ts_usec, cols, idx, max_frames);
+}
+
+struct csi_pcap *
+csi_pcap_open(const char *filename)
+{
+    struct stat st;
+    struct csi_pcap *pcap;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < 4) {
+        close(fd);
+        return NULL;
+    }
+    const uint8_t *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    pcap = calloc(1, sizeof(*pcap));
+    if (pcap == NULL) {
+        munmap((void *) base, st.st_size);
+        close(fd);
+        return NULL;
+    }
+    pcap->fd = fd;
+    pcap->base = base;
+    pcap->size = st.st_size;
+    if (capture_parse_header(&pcap->fmt, base, pcap->size, &pcap->pos) <= 0) {
+        csi_pcap_close(pcap);
+        return NULL;
+    }
+    madvise((void *) base, st.st_size, MADV_SEQUENTIAL);
+    csi_pcap_rewind(pcap);
+    return pcap;
+}
+
+void
+csi_pcap_close(struct csi_pcap *pcap)
+{
+    if (pcap == NULL) {
+        return;
+    }
+    munmap((void *) pcap->base, pcap->size);
+    close(pcap->fd);
+    free(pcap);
+}
+
+void
+csi_pcap_rewind(struct csi_pcap *pcap)
+{
+    capture_parse_header(&pcap->fmt, pcap->base, pcap->size, &pcap->pos);
+    pcap->batch.left = 0;
+}
+
+size_t
+capture_count_packet(const struct packet *pkt)
+{
+    uint32_t len;
+    const uint8_t *frm = pkt->data ? udp_payload(pkt->data, pkt->caplen, &len) : NULL;
+
+    if (frm == NULL) {
+        return 0;
+    }
+    if (is_batch(frm, len)) {
+        return ld16(frm + 2);
+    }
+    return is_csi_frame(frm, len);
+}
+
+size_t
+csi_pcap_count_frames(struct csi_pcap *pcap)
+{
+    struct capture_format fmt;
+    struct packet pkt;
+    size_t pos;
+    size_t n = 0;
+
+    capture_parse_header(&fmt, pcap->base, pcap->size, &pos);
+    while (pos < pcap->size) {
+        size_t blen = capture_parse_block(&fmt, pcap->base + pos, pcap->size - pos, &pkt);
+        if (blen == BLOCK_INCOMPLETE || blen == BLOCK_INVALID) {
+            break;
+        }
+        pos += blen;
+        n += capture_count_packet(&pkt);
+    }
+    return n;
+}
+
+size_t
+csi_pcap_decode(struct csi_pcap *pcap, struct csi_columns *cols, size_t max_frames)
+{
+    size_t n = 0;
+    struct packet pkt;
+
+    while (n < max_frames && pcap->pos < pcap->size) {
+        // a truncated last record ends the file
+        size_t blen = capture_parse_block(&pcap->fmt, pcap->base + pcap->pos, pcap->size - pcap->pos, &pkt);
+        if (blen == BLOCK_INCOMPLETE || blen == BLOCK_INVALID) {
+            break;
+        }
+        n += capture_decode_packet(&pcap->batch, &pkt, cols, n, max_frames);
+        if (pcap->batch.left == 0) {
+            pcap->pos += blen;
+        }
+    }
+    return n;
+}
+
+int
+csi_pcap_next_packet(struct csi_pcap *pcap, const uint8_t **data, uint32_t *caplen, uint64_t *ts_usec)
+{
+    struct packet pkt;
+
+    while (pcap->pos < pcap->size) {
+        size_t blen = capture_parse_block(&pcap->fmt, pcap->base + pcap->pos, pcap->size - pcap->pos, &pkt);
+        if (blen == BLOCK_INCOMPLETE || blen == BLOCK_INVALID) {
+            break;
+        }
+        pcap->pos += blen;
+        pcap->batch.left = 0;
+        if (pkt.data != NULL) {
+            *data = pkt.data;
+            *caplen = pkt.caplen;
+            *ts_usec = pkt.ts_usec;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+size_t
+csi_decode_packet(const uint8_t *data, uint32_t caplen, uint64_t ts_usec, size_t skip,
+    struct csi_columns *cols, size_t idx, size_t max_frames)
+{
+    struct packet pkt = { data, caplen, ts_usec };
+    struct batch_state bs = { 0, 0 };
+
+    if (max_frames == 0) {
+        return 0;
+    }
+    // frames taken by an earlier call are decoded to idx as well and overwritten below
+    while (skip > 0) {
+        size_t n = capture_decode_packet(&bs, &pkt, cols, idx, idx + (skip < max_frames ? skip : max_frames));
+        if (n == 0 || bs.left == 0) {
+            return 0;
+        }
+        skip -= n;
+    }
+    return capture_decode_packet(&bs, &pkt, cols, idx, idx + max_frames);
+}
+
+struct csi_stream *
+csi_stream_open(const char *filename)
+{
+    struct csi_stream *stream;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    stream = calloc(1, sizeof(*stream));
+    if (stream == NULL) {
+        close(fd);
+        return NULL;
+    }
+    stream->fd = fd;
+    return stream;
+}
+
+void
+csi_stream_close(struct csi_stream *stream)
+{
+    if (stream == NULL) {
+        return;
+    }
+    close(stream->fd);
+    free(stream->buf);
+    free(stream);
+}
+
+// appends whatever the writer has added to the file since the last read, returns 0 if nothing was read
+static int
+stream_fill(struct csi_stream *stream)
+{
+    if (stream->start > 0) {
+        memmove(stream->buf, stream->buf + stream->start, stream->len - stream->start);
+        stream->len -= stream->start;
+        stream->start = 0;
+    }
+    if (stream->cap - stream->len < STREAM_READ_LEN) {
+        // grows to the largest record seen plus one read, records are at most CAPTURE_MAX_BLOCK_LEN
+        size_t cap = stream->len + STREAM_READ_LEN;
+        uint8_t *buf = realloc(stream->buf, cap);
+        if (buf == NULL) {
+            return 0;
+        }
+        stream->buf = buf;
+        stream->cap = cap;
+    }
+    ssize_t r = read(stream->fd, stream->buf + stream->len, stream->cap - stream->len);
+    if (r <= 0) {
+        return 0;
+    }
+    stream->len += r;
+    return 1;
+}
+
+size_t
+csi_stream_poll(struct csi_stream *stream, struct csi_columns *cols, size_t max_frames)
+{
+    size_t n = 0;
+    struct packet pkt;
+
+    while (n < max_frames && !stream->failed) {
+        const uint8_t *buf = stream->buf + stream->start;
+        size_t avail = stream->len - stream->start;
+        size_t blen;
+
+        if (!stream->have_header) {
+            int ret = capture_parse_header(&stream->fmt, buf, avail, &blen);
+            if (ret < 0) {
+                stream->failed = 1;
+                break;
+            }
+            if (ret == 0) {
+                if (!stream_fill(stream)) {
+                    break;
+                }
+                continue;
+            }
+            stream->have_header = 1;
+        } else {
+            blen = capture_parse_block(&stream->fmt, buf, avail, &pkt);
+            if (blen == BLOCK_INVALID) {
+                stream->failed = 1;
+                break;
+            }
+            if (blen == BLOCK_INCOMPLETE) {
+                // partially written record, wait for the writer if the end of the file is reached
+                if (!stream_fill(stream)) {
+                    break;
+                }
+                continue;
+            }
+            n += capture_decode_packet(&stream->batch, &pkt, cols, n, max_frames);
+            if (stream->batch.left > 0) {
+                // max_frames reached in a batch, keep the record for the next call
+                break;
+            }
+        }
+        stream->start += blen;
+        stream->offset += blen;
+    }
+    return n;
+}
+
+uint64_t
+csi_stream_offset(struct csi_stream *stream)
+{
+    return stream->offset;
+}
+
+int
+csi_stream_failed(struct csi_stream *stream)
+{
+    return stream->failed;
+}
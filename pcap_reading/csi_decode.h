@@ -0,0 +1,119 @@
+#ifndef CSI_DECODE_H
+#define CSI_DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// magic values in the kk1 field of the udp frames sent by the firmware
+#define CSI_FRAME_MAGIC             0x1111
+#define CSI_FRAME_MAGIC_COMPACT     0x1112
+#define CSI_FRAME_MAGIC_BATCH       0x1113
+
+// header flags
+#define CSI_FLAG_TONE_SELECT        0x01
+#define CSI_FLAG_PACKED14           0x02
+#define CSI_FLAG_EXT_HEADER         0x04    /* struct csi_ext_header follows the header */
+
+// set by the decoder, never sent by the firmware. frames of older tool versions have the same magic but an
+// 18 (CSI_TOOL_VERSION_INCLUDE_RSSI), 22 (CSI_TOOL_VERSION_TEST_PHYSTATUS) or 30 byte header
+// (CSI_TOOL_VERSION_GAIN_RECOVERY, one gain record stored as gain_type 10) and the csi of all tones of the
+// bandwidth. they are told apart by their length like CSIDataPcapFrame.detect_format does
+#define CSI_FLAG_LEGACY             0x8000
+#define CSI_FLAG_LEGACY_PHYSTATUS   0x4000  /* CSI_TOOL_VERSION_TEST_PHYSTATUS, phystatus in the csi */
+
+#define CSI_N_PHYSTATUS             6       /* PhyRxStatus_0..5 */
+#define CSI_SWEEP_NONE              0xffff  /* sweep_step of frames received while no gain sweep ran (ioctl 512) */
+
+#define CSI_N_GAIN_TYPES            6       /* gain_type 1, 2, 3, 4, 9, 10 */
+#define CSI_N_GAIN_STAGES           8       /* elna, lna1, lna2, mix, lpf0, lpf1, dvga, trLoss */
+#define CSI_MAX_TONES               256
+
+enum csi_gain_stage {
+    CSI_GAIN_ELNA = 0,
+    CSI_GAIN_LNA1,
+    CSI_GAIN_LNA2,
+    CSI_GAIN_MIX,
+    CSI_GAIN_LPF0,
+    CSI_GAIN_LPF1,
+    CSI_GAIN_DVGA,
+    CSI_GAIN_TRLOSS,
+};
+
+// caller provided output arrays, one entry per frame unless noted, every pointer may be NULL.
+// tsf is the receive time in us taken by the chip and the primary time of frames with CSI_FLAG_EXT_HEADER,
+// ts_usec also contains the jitter of the bus and the host
+struct csi_columns {
+    uint64_t *ts_usec;                  /* pcap timestamp in us */
+    uint8_t  *src_mac;                  /* 6 bytes per frame */
+    uint16_t *seq_cnt;
+    uint8_t  *fc;
+    uint16_t *csiconf;
+    uint16_t *chanspec;
+    uint16_t *chip;
+    int8_t   *rssi;
+    uint8_t  *gain_type_mask;           /* gain types present in gains */
+    int8_t   *gains;                    /* CSI_N_GAIN_STAGES x CSI_N_GAIN_TYPES per frame, as in csi_udp_frame */
+    int16_t  *agc_gain;
+    uint16_t *flags;
+    uint16_t *n_tones;                  /* number of csi values of the frame */
+    int16_t  *csi;                      /* max_tones x (real, imag) per frame, tones at their fft index */
+    uint16_t *phystatus;                /* CSI_N_PHYSTATUS per frame, 0 for frames without CSI_FLAG_EXT_HEADER */
+    uint16_t *rx_tsf_time;              /* RxTSFTime, 0 without CSI_FLAG_EXT_HEADER */
+    uint64_t *tsf;                      /* 64 bit tsf of the received frame (32 bit before ext version 2),
+                                           0 without CSI_FLAG_EXT_HEADER */
+    uint16_t *sweep_step;               /* step of the firmware gain sweep the frame was received with,
+                                           CSI_SWEEP_NONE before ext version 3 */
+    size_t   max_tones;
+};
+
+struct csi_pcap;
+
+// maps a pcap or pcapng file, returns NULL on error
+struct csi_pcap *csi_pcap_open(const char *filename);
+void csi_pcap_close(struct csi_pcap *pcap);
+
+// number of csi frames in the file, batches count with their number of records
+size_t csi_pcap_count_frames(struct csi_pcap *pcap);
+
+// decodes up to max_frames frames starting at the current position into cols, returns the number of frames decoded
+size_t csi_pcap_decode(struct csi_pcap *pcap, struct csi_columns *cols, size_t max_frames);
+
+// starts decoding at the first frame again
+void csi_pcap_rewind(struct csi_pcap *pcap);
+
+// returns the next ethernet frame of the file, 0 at the end of the file. csi_pcap_decode continues after it
+int csi_pcap_next_packet(struct csi_pcap *pcap, const uint8_t **data, uint32_t *caplen, uint64_t *ts_usec);
+
+// decodes the csi frames of one captured ethernet frame to cols starting at index idx, at most max_frames.
+// the first skip csi frames of a batch are left out, so a batch can be split, e.g. at the end of a ring.
+// returns the number of frames decoded, less than max_frames if the packet has no more frames
+size_t csi_decode_packet(const uint8_t *data, uint32_t caplen, uint64_t ts_usec, size_t skip,
+    struct csi_columns *cols, size_t idx, size_t max_frames);
+
+struct csi_stream;
+
+// follows a pcap or pcapng file that is still being written, e.g. by tcpdump -U.
+// the file header does not need to be written yet
+struct csi_stream *csi_stream_open(const char *filename);
+void csi_stream_close(struct csi_stream *stream);
+
+// decodes up to max_frames frames that were appended since the last call, returns the number of frames decoded.
+// records that are only partially written are kept until they are complete
+size_t csi_stream_poll(struct csi_stream *stream, struct csi_columns *cols, size_t max_frames);
+
+// file offset up to which the stream has been decoded
+uint64_t csi_stream_offset(struct csi_stream *stream);
+
+// 1 if the file is no pcap or contains a corrupt block, e.g. a record longer than the snaplen of the file
+// or 256 KiB. the stream does not decode anything afterwards
+int csi_stream_failed(struct csi_stream *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*CSI_DECODE_H*/
@@ -0,0 +1,89 @@
+#ifndef CSI_DECODE_INTERNAL_H
+#define CSI_DECODE_INTERNAL_H
+
+// shared by the decoder, the archive and the parallel decoder, not part of the library interface
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "csi_decode.h"
+#include "csi_ring.h"
+
+#define PCAPNG_MAX_INTERFACES    8
+
+#define BLOCK_INCOMPLETE         0
+#define BLOCK_INVALID            SIZE_MAX
+// longest record or pcapng block, longer ones are corrupt and would make the stream buffer grow without end
+#define CAPTURE_MAX_BLOCK_LEN    (256 * 1024)
+
+// record layout of the capture, shared by the mmap and the streaming reader
+struct capture_format {
+    int pcapng;
+    int nsec;                           /* pcap timestamps have ns instead of us resolution */
+    uint32_t snaplen;                   /* longest pcap record, 0 if not limited */
+    int n_ifs;                          /* pcapng interfaces seen in the current section */
+    struct {
+        uint16_t linktype;
+        uint8_t tsresol;                /* if_tsresol option, 6 (us) by default */
+    } ifs[PCAPNG_MAX_INTERFACES];
+};
+
+// ethernet frame of a capture record
+struct packet {
+    const uint8_t *data;                /* NULL if the record carries no ethernet frame */
+    uint32_t caplen;
+    uint64_t ts_usec;
+};
+
+// position in a partially decoded batch
+struct batch_state {
+    size_t pos;                         /* offset of the next batch record */
+    uint16_t left;                      /* number of batch records left */
+};
+
+struct csi_pcap {
+    int fd;
+    const uint8_t *base;
+    size_t size;
+    struct capture_format fmt;
+    size_t pos;                         /* offset of the next record */
+    struct batch_state batch;
+};
+
+// columns of struct csi_columns in the order of enum csi_ring_column, size 0 is max_tones x (real, imag)
+struct csi_column_desc {
+    size_t field;
+    size_t size;
+};
+
+extern const struct csi_column_desc csi_column_desc[CSI_RING_N_COLUMNS];
+
+static inline size_t
+csi_column_size(int c, size_t max_tones)
+{
+    return csi_column_desc[c].size ? csi_column_desc[c].size : max_tones * 4;
+}
+
+static inline uint8_t **
+csi_column_ptr(struct csi_columns *cols, int c)
+{
+    return (uint8_t **) ((uint8_t *) cols + csi_column_desc[c].field);
+}
+
+// parses the file header at buf and sets *hdr_len to its length.
+// returns 1 on success, 0 if the header is not completely available yet and -1 if it is no pcap
+int capture_parse_header(struct capture_format *fmt, const uint8_t *buf, size_t avail, size_t *hdr_len);
+
+// parses the record or pcapng block at buf with avail bytes available.
+// returns its length, BLOCK_INCOMPLETE if it is not completely available yet or BLOCK_INVALID
+size_t capture_parse_block(struct capture_format *fmt, const uint8_t *buf, size_t avail, struct packet *pkt);
+
+// decodes the csi frames of one ethernet frame, a batch is continued if bs->left is not 0.
+// the packet is completely decoded when bs->left is 0 afterwards
+size_t capture_decode_packet(struct batch_state *bs, const struct packet *pkt, struct csi_columns *cols,
+    size_t idx, size_t max_frames);
+
+// number of csi frames in one ethernet frame
+size_t capture_count_packet(const struct packet *pkt);
+
+#endif /*CSI_DECODE_INTERNAL_H*/
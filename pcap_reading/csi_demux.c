@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "csi_demux.h"
+#include "csi_decode_internal.h"
+
+#define SEQ_MOD         4096
+#define MAP_EMPTY       UINT32_MAX
+
+struct tx_state {
+    struct csi_tx_stats stats;
+    uint64_t conf_mask;                 /* csiconfs seen with last_seq */
+    int have_seq;
+};
+
+struct csi_demux {
+    // open addressing hash map from the mac to the index in tx
+    uint64_t *keys;
+    uint32_t *values;
+    uint32_t cap;                       /* power of two */
+    struct tx_state *tx;
+    uint32_t n_tx;
+    uint32_t cap_tx;
+    int failed;                         /* out of memory */
+};
+
+static inline uint64_t
+mac_key(const uint8_t *mac)
+{
+    return (uint64_t) mac[0] | ((uint64_t) mac[1] << 8) | ((uint64_t) mac[2] << 16) | ((uint64_t) mac[3] << 24)
+        | ((uint64_t) mac[4] << 32) | ((uint64_t) mac[5] << 40);
+}
+
+static inline uint32_t
+map_slot(uint64_t key, uint32_t cap)
+{
+    return (uint32_t) ((key * 0x9e3779b97f4a7c15ULL) >> 32) & (cap - 1);
+}
+
+static int
+map_grow(struct csi_demux *d)
+{
+    uint32_t cap = d->cap ? d->cap * 2 : 64;
+    uint64_t *keys = malloc(cap * sizeof(*keys));
+    uint32_t *values = malloc(cap * sizeof(*values));
+    uint32_t i;
+
+    if (keys == NULL || values == NULL) {
+        free(keys);
+        free(values);
+        return -1;
+    }
+    for (i = 0; i < cap; i++) {
+        values[i] = MAP_EMPTY;
+    }
+    for (i = 0; i < d->cap; i++) {
+        if (d->values[i] != MAP_EMPTY) {
+            uint32_t s = map_slot(d->keys[i], cap);
+            while (values[s] != MAP_EMPTY) {
+                s = (s + 1) & (cap - 1);
+            }
+            keys[s] = d->keys[i];
+            values[s] = d->values[i];
+        }
+    }
+    free(d->keys);
+    free(d->values);
+    d->keys = keys;
+    d->values = values;
+    d->cap = cap;
+    return 0;
+}
+
+// returns the transmitter with this mac, adds it if it is new, NULL if out of memory
+static struct tx_state *
+find_tx(struct csi_demux *d, const uint8_t *mac, uint32_t *id)
+{
+    uint64_t key = mac_key(mac);
+    uint32_t s;
+
+    if ((d->n_tx + 1) * 2 > d->cap && map_grow(d) < 0) {
+        return NULL;
+    }
+    for (s = map_slot(key, d->cap); d->values[s] != MAP_EMPTY; s = (s + 1) & (d->cap - 1)) {
+        if (d->keys[s] == key) {
+            *id = d->values[s];
+            return &d->tx[*id];
+        }
+    }
+    if (d->n_tx == d->cap_tx) {
+        uint32_t cap_tx = d->cap_tx ? d->cap_tx * 2 : 16;
+        struct tx_state *tx = realloc(d->tx, cap_tx * sizeof(*tx));
+        if (tx == NULL) {
+            return NULL;
+        }
+        d->tx = tx;
+        d->cap_tx = cap_tx;
+    }
+    *id = d->n_tx++;
+    d->keys[s] = key;
+    d->values[s] = *id;
+    struct tx_state *t = &d->tx[*id];
+    memset(t, 0, sizeof(*t));
+    memcpy(t->stats.mac, mac, 6);
+    return t;
+}
+
+// returns 1 if the frame is passed on
+static int
+track_seq(struct tx_state *t, uint16_t seq, uint16_t csiconf)
+{
+    uint64_t conf_bit = 1ULL << (csiconf & 0x3f);
+    uint16_t delta = (seq - t->stats.last_seq) & (SEQ_MOD - 1);
+
+    if (!t->have_seq) {
+        t->have_seq = 1;
+    } else if (delta == 0) {
+        if (t->conf_mask & conf_bit) {
+            t->stats.duplicates++;
+            return 0;
+        }
+        // another core or spatial stream of the same frame
+        t->conf_mask |= conf_bit;
+        return 1;
+    } else if (delta < SEQ_MOD / 2) {
+        t->stats.lost += delta - 1;
+    } else if (SEQ_MOD - delta <= CSI_DEMUX_REORDER_WINDOW) {
+        // late retry of an earlier frame
+        t->stats.duplicates++;
+        return 0;
+    } else {
+        t->stats.restarts++;
+    }
+    t->stats.last_seq = seq;
+    t->conf_mask = conf_bit;
+    return 1;
+}
+
+struct csi_demux *
+csi_demux_new(void)
+{
+    struct csi_demux *d = calloc(1, sizeof(*d));
+    if (d != NULL && map_grow(d) < 0) {
+        free(d);
+        return NULL;
+    }
+    return d;
+}
+
+void
+csi_demux_free(struct csi_demux *d)
+{
+    if (d == NULL) {
+        return;
+    }
+    free(d->keys);
+    free(d->values);
+    free(d->tx);
+    free(d);
+}
+
+size_t
+csi_demux_process(struct csi_demux *d, struct csi_columns *cols, size_t n, uint32_t *stream_id)
+{
+    size_t i, out = 0;
+    uint32_t id;
+    int c;
+
+    if (cols->src_mac == NULL || cols->seq_cnt == NULL) {
+        return n;
+    }
+    for (i = 0; i < n && !d->failed; i++) {
+        struct tx_state *t = find_tx(d, cols->src_mac + i * 6, &id);
+        if (t == NULL) {
+            d->failed = 1;
+            break;
+        }
+        if (!track_seq(t, cols->seq_cnt[i] >> 4, cols->csiconf ? cols->csiconf[i] : 0)) {
+            continue;
+        }
+        uint64_t ts = cols->ts_usec ? cols->ts_usec[i] : 0;
+        if (t->stats.frames == 0) {
+            t->stats.first_ts_usec = ts;
+        }
+        t->stats.last_ts_usec = ts;
+        t->stats.frames++;
+
+        if (out != i) {
+            for (c = 0; c < CSI_RING_N_COLUMNS; c++) {
+                uint8_t *col = *csi_column_ptr(cols, c);
+                size_t size = csi_column_size(c, cols->max_tones);
+                if (col) {
+                    memcpy(col + out * size, col + i * size, size);
+                }
+            }
+        }
+        if (stream_id) {
+            stream_id[out] = id;
+        }
+        out++;
+    }
+    return out;
+}
+
+int
+csi_demux_failed(const struct csi_demux *d)
+{
+    return d->failed;
+}
+
+uint32_t
+csi_demux_n_streams(const struct csi_demux *d)
+{
+    return d->n_tx;
+}
+
+int
+csi_demux_stats(const struct csi_demux *d, uint32_t id, struct csi_tx_stats *stats)
+{
+    if (id >= d->n_tx) {
+        return -1;
+    }
+    *stats = d->tx[id].stats;
+    return 0;
+}
+
+void
+csi_demux_order(const uint32_t *stream_id, size_t n, uint32_t n_streams, uint32_t *order, size_t *start)
+{
+    size_t i;
+    uint32_t s;
+
+    // counting sort, stable within every stream
+    memset(start, 0, (n_streams + 1) * sizeof(*start));
+    for (i = 0; i < n; i++) {
+        if (stream_id[i] < n_streams) {
+            start[stream_id[i] + 1]++;
+        }
+    }
+    for (s = 0; s < n_streams; s++) {
+        start[s + 1] += start[s];
+    }
+    size_t *next = malloc((n_streams ? n_streams : 1) * sizeof(*next));
+    if (next == NULL) {
+        return;
+    }
+    memcpy(next, start, n_streams * sizeof(*next));
+    for (i = 0; i < n; i++) {
+        if (stream_id[i] < n_streams) {
+            order[next[stream_id[i]]++] = i;
+        }
+    }
+    free(next);
+}
@@ -0,0 +1,59 @@
+#ifndef CSI_DEMUX_H
+#define CSI_DEMUX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "csi_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// frames of the same 802.11 frame (one per core and spatial stream) share the sequence number and differ in
+// csiconf. a frame with a sequence number and csiconf that was already seen is a duplicate (retry).
+// sequence numbers that are skipped count as lost, frames that are up to CSI_DEMUX_REORDER_WINDOW
+// sequence numbers late are dropped as retries, older ones restart the sequence tracking.
+#define CSI_DEMUX_REORDER_WINDOW    64
+
+struct csi_tx_stats {
+    uint8_t mac[6];
+    uint16_t last_seq;                  /* last 802.11 sequence number (seqCnt >> 4) */
+    uint64_t frames;                    /* frames passed on */
+    uint64_t duplicates;                /* frames dropped as duplicates or retries */
+    uint64_t lost;                      /* skipped sequence numbers */
+    uint64_t restarts;                  /* sequence tracking restarted */
+    uint64_t first_ts_usec;
+    uint64_t last_ts_usec;
+};
+
+struct csi_demux;
+
+struct csi_demux *csi_demux_new(void);
+void csi_demux_free(struct csi_demux *d);
+
+// assigns every frame the id of its transmitter (in the order of their first frame) and drops duplicates by
+// moving the remaining frames to the front of every column. the state is kept across calls, so a stream can
+// be processed batch by batch. stream_id (may be NULL) gets the transmitter of every remaining frame.
+// cols->src_mac and cols->seq_cnt are required. returns the number of remaining frames.
+// if a new transmitter cannot be added for lack of memory, the frames from it on are not processed
+// and csi_demux_failed returns 1
+size_t csi_demux_process(struct csi_demux *d, struct csi_columns *cols, size_t n, uint32_t *stream_id);
+
+// 1 if csi_demux_process ran out of memory, the demux does not process any frames afterwards
+int csi_demux_failed(const struct csi_demux *d);
+
+uint32_t csi_demux_n_streams(const struct csi_demux *d);
+
+// returns 0 and the statistics of stream id, -1 if there is no such stream
+int csi_demux_stats(const struct csi_demux *d, uint32_t id, struct csi_tx_stats *stats);
+
+// groups n frames by stream: order gets the frame indices of stream 0, then stream 1, ... in their original order,
+// the frames of stream i are order[start[i]] to order[start[i + 1] - 1]. start has n_streams + 1 entries
+void csi_demux_order(const uint32_t *stream_id, size_t n, uint32_t n_streams, uint32_t *order, size_t *start);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*CSI_DEMUX_H*/
@@ -0,0 +1,135 @@
+// runs synthetic columns of two transmitters through csi_demux_process in two batches: gaps, duplicates,
+// late retries inside and just outside CSI_DEMUX_REORDER_WINDOW, the 4095 -> 0 wrap of the sequence number
+// and two csiconfs of the same frame. checks the frames that remain, their order and columns, the stream ids
+// and the statistics of both transmitters
+
+#include <stdio.h>
+#include <string.h>
+
+#include "csi_demux.h"
+
+struct test_frame {
+    int tx;
+    uint16_t seq;                       /* 802.11 sequence number, seq_cnt >> 4 */
+    uint16_t csiconf;
+    int passed;
+};
+
+static const struct test_frame frames[] = {
+    { 0, 10, 0, 1 },
+    { 0, 11, 0, 1 },
+    { 1, 4094, 0, 1 },
+    { 0, 11, 1, 1 },                    /* another csiconf of the same frame */
+    { 0, 11, 0, 0 },                    /* duplicate */
+    { 1, 4095, 0, 1 },
+    { 0, 14, 0, 1 },                    /* 12 and 13 lost */
+    { 1, 0, 0, 1 },                     /* wrap */
+    { 1, 0, 1, 1 },
+    { 0, 12, 0, 0 },                    /* late retry */
+    { 1, 4095, 0, 0 },                  /* late retry across the wrap */
+    { 1, 2, 0, 1 },                     /* 1 lost */
+    // second batch
+    { 0, 14, 1, 1 },
+    { 0, 14, 1, 0 },
+    { 0, 14 - CSI_DEMUX_REORDER_WINDOW + 4096, 0, 0 },          /* last seq number of the window */
+    { 0, 14 - CSI_DEMUX_REORDER_WINDOW - 1 + 4096, 0, 1 },      /* outside of the window, restart */
+    { 0, 14 - CSI_DEMUX_REORDER_WINDOW + 4096, 0, 1 },
+};
+#define N_FRAMES        (sizeof(frames) / sizeof(frames[0]))
+#define FIRST_BATCH     12
+
+static const uint8_t macs[2][6] = {
+    {0x00, 0x11, 0x22, 0x33, 0x44, 0x55},
+    {0x00, 0x11, 0x22, 0x33, 0x44, 0x66},
+};
+
+// frames, duplicates, lost, restarts and last_seq of both transmitters
+static const uint64_t expected_stats[2][5] = {
+    { 7, 4, 2, 1, 14 - CSI_DEMUX_REORDER_WINDOW + 4096 },
+    { 5, 1, 1, 0, 2 },
+};
+
+static int failed = 0;
+
+static void
+check(int ok, const char *what)
+{
+    printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+    failed |= !ok;
+}
+
+// the frames of a batch that remain are at the front of its columns in their original order
+static int
+check_batch(size_t first, size_t count, size_t n, const uint8_t *src_mac, const uint16_t *seq_cnt,
+    const uint16_t *csiconf, const uint64_t *ts_usec, const uint32_t *stream_id)
+{
+    size_t i, out = first;
+    for (i = first; i < first + count; i++) {
+        if (!frames[i].passed) {
+            continue;
+        }
+        if (out >= first + n || ts_usec[out] != 1000 + i || seq_cnt[out] >> 4 != frames[i].seq
+                || csiconf[out] != frames[i].csiconf || memcmp(src_mac + out * 6, macs[frames[i].tx], 6) != 0
+                || stream_id[out] != (uint32_t) frames[i].tx) {
+            printf("frame %zu is not at %zu\n", i, out);
+            return 0;
+        }
+        out++;
+    }
+    return out == first + n;
+}
+
+int
+main(void)
+{
+    uint8_t src_mac[N_FRAMES * 6];
+    uint16_t seq_cnt[N_FRAMES], csiconf[N_FRAMES];
+    uint64_t ts_usec[N_FRAMES];
+    uint32_t stream_id[N_FRAMES];
+    struct csi_columns cols = { .ts_usec = ts_usec, .src_mac = src_mac, .seq_cnt = seq_cnt, .csiconf = csiconf };
+    struct csi_demux *d = csi_demux_new();
+    struct csi_tx_stats stats;
+    size_t i, n;
+    int t, ok;
+
+    for (i = 0; i < N_FRAMES; i++) {
+        memcpy(src_mac + i * 6, macs[frames[i].tx], 6);
+        seq_cnt[i] = frames[i].seq << 4 | (i & 0xf);
+        csiconf[i] = frames[i].csiconf;
+        ts_usec[i] = 1000 + i;
+    }
+
+    n = csi_demux_process(d, &cols, FIRST_BATCH, stream_id);
+    check(check_batch(0, FIRST_BATCH, n, src_mac, seq_cnt, csiconf, ts_usec, stream_id),
+        "first batch: remaining frames, columns and stream ids");
+
+    // the second batch is processed with the state of the first
+    cols.ts_usec += FIRST_BATCH;
+    cols.src_mac += FIRST_BATCH * 6;
+    cols.seq_cnt += FIRST_BATCH;
+    cols.csiconf += FIRST_BATCH;
+    n = csi_demux_process(d, &cols, N_FRAMES - FIRST_BATCH, stream_id + FIRST_BATCH);
+    check(check_batch(FIRST_BATCH, N_FRAMES - FIRST_BATCH, n, src_mac, seq_cnt, csiconf, ts_usec, stream_id),
+        "second batch: remaining frames, columns and stream ids");
+    check(!csi_demux_failed(d) && csi_demux_n_streams(d) == 2, "two transmitters");
+
+    for (t = 0; t < 2; t++) {
+        char what[64];
+        ok = csi_demux_stats(d, t, &stats) == 0 && memcmp(stats.mac, macs[t], 6) == 0;
+        ok &= stats.frames == expected_stats[t][0] && stats.duplicates == expected_stats[t][1]
+            && stats.lost == expected_stats[t][2] && stats.restarts == expected_stats[t][3]
+            && stats.last_seq == expected_stats[t][4];
+        if (!ok) {
+            printf("frames %llu, duplicates %llu, lost %llu, restarts %llu, last seq %u\n",
+                (unsigned long long) stats.frames, (unsigned long long) stats.duplicates,
+                (unsigned long long) stats.lost, (unsigned long long) stats.restarts, stats.last_seq);
+        }
+        snprintf(what, sizeof(what), "transmitter %d: statistics", t);
+        check(ok, what);
+    }
+    check(csi_demux_stats(d, 2, &stats) < 0, "no third transmitter");
+
+    csi_demux_free(d);
+    printf("%s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
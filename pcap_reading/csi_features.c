@@ -0,0 +1,194 @@
+#include <math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "csi_features.h"
+
+// converts n (real, imag) pairs to float, writes the interleaved complex values and the power |csi|^2,
+// either may be NULL
+#if defined(__AVX2__)
+static size_t
+convert_vec(const int16_t *csi, size_t n, float *cplx, float *power)
+{
+    size_t i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        // 8 tones: re0 im0 re1 im1 ... re7 im7
+        __m256i v = _mm256_loadu_si256((const __m256i *) (csi + i * 2));
+        __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+        __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+        if (cplx) {
+            _mm256_storeu_ps(cplx + i * 2, lo);
+            _mm256_storeu_ps(cplx + i * 2 + 8, hi);
+        }
+        if (power) {
+            // re^2 + im^2 of neighbouring pairs, hadd works per 128 bit lane
+            __m256 p = _mm256_hadd_ps(_mm256_mul_ps(lo, lo), _mm256_mul_ps(hi, hi));
+            p = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(p), 0xd8));
+            _mm256_storeu_ps(power + i, p);
+        }
+    }
+    return i;
+}
+#elif defined(__SSE2__)
+static size_t
+convert_vec(const int16_t *csi, size_t n, float *cplx, float *power)
+{
+    size_t i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        // 4 tones: re0 im0 re1 im1 re2 im2 re3 im3
+        __m128i v = _mm_loadu_si128((const __m128i *) (csi + i * 2));
+        // sign extend by moving every int16 to the upper half of an int32
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+        if (cplx) {
+            _mm_storeu_ps(cplx + i * 2, lo);
+            _mm_storeu_ps(cplx + i * 2 + 4, hi);
+        }
+        if (power) {
+            lo = _mm_mul_ps(lo, lo);
+            hi = _mm_mul_ps(hi, hi);
+            __m128 re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 im = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(power + i, _mm_add_ps(re, im));
+        }
+    }
+    return i;
+}
+#else
+static size_t
+convert_vec(const int16_t *csi, size_t n, float *cplx, float *power)
+{
+    return 0;
+}
+#endif
+
+static void
+convert(const int16_t *csi, size_t n, float *cplx, float *power)
+{
+    size_t i = convert_vec(csi, n, cplx, power);
+    for (; i < n; i++) {
+        float re = csi[i * 2];
+        float im = csi[i * 2 + 1];
+        if (cplx) {
+            cplx[i * 2] = re;
+            cplx[i * 2 + 1] = im;
+        }
+        if (power) {
+            power[i] = re * re + im * im;
+        }
+    }
+}
+
+void
+csi_features(const int16_t *csi, size_t n_frames, size_t n_tones,
+    float *cplx, float *mag, float *db, float *phase)
+{
+    size_t f, i;
+    if (n_tones == 0) {
+        return;
+    }
+    float power[n_tones];
+
+    for (f = 0; f < n_frames; f++) {
+        const int16_t *in = csi + f * n_tones * 2;
+        size_t o = f * n_tones;
+
+        // the power is only needed for mag and db
+        convert(in, n_tones, cplx ? cplx + o * 2 : NULL, (mag || db) ? power : NULL);
+        if (db) {
+            for (i = 0; i < n_tones; i++) {
+                db[o + i] = 10.0f * log10f(power[i]);
+            }
+        }
+        if (mag) {
+            for (i = 0; i < n_tones; i++) {
+                mag[o + i] = sqrtf(power[i]);
+            }
+        }
+        if (phase) {
+            // same as numpy.unwrap: add multiples of 2 pi so that neighbouring tones differ by at most pi
+            float offset = 0.0f;
+            float prev = 0.0f;
+            for (i = 0; i < n_tones; i++) {
+                float p = atan2f(in[i * 2 + 1], in[i * 2]);
+                if (i > 0) {
+                    float d = p - prev;
+                    if (d > (float) M_PI) {
+                        offset -= 2.0f * (float) M_PI * ceilf((d - (float) M_PI) / (2.0f * (float) M_PI));
+                    } else if (d < -(float) M_PI) {
+                        offset += 2.0f * (float) M_PI * ceilf((-d - (float) M_PI) / (2.0f * (float) M_PI));
+                    }
+                }
+                prev = p;
+                phase[o + i] = p + offset;
+            }
+        }
+    }
+}
+
+void
+csi_gain_calibration_default(struct csi_gain_calibration *cal)
+{
+    int s;
+    for (s = 0; s < CSI_N_GAIN_STAGES; s++) {
+        cal->weight[s] = 1.0f;
+        cal->offset[s] = 0.0f;
+    }
+    cal->weight[CSI_GAIN_TRLOSS] = -1.0f;
+}
+
+void
+csi_gain_normalize(const int16_t *csi, const int8_t *gains, const uint8_t *gain_type_mask,
+    size_t n_frames, size_t n_tones, int gain_type, const struct csi_gain_calibration *cal,
+    float *cplx, float *gain_db)
+{
+    size_t f, i;
+    int s;
+
+    if (gain_type < 0 || gain_type >= CSI_N_GAIN_TYPES) {
+        return;
+    }
+    for (f = 0; f < n_frames; f++) {
+        const int8_t *g = gains + f * CSI_N_GAIN_STAGES * CSI_N_GAIN_TYPES;
+        float *out = cplx + f * n_tones * 2;
+        float db = 0.0f;
+        // the gains of a type the frame does not carry are 0, not a gain
+        if (gain_type_mask && !(gain_type_mask[f] & (1 << gain_type))) {
+            for (i = 0; i < n_tones * 2; i++) {
+                out[i] = NAN;
+            }
+            if (gain_db) {
+                gain_db[f] = NAN;
+            }
+            continue;
+        }
+        for (s = 0; s < CSI_N_GAIN_STAGES; s++) {
+            db += cal->weight[s] * g[s * CSI_N_GAIN_TYPES + gain_type] + cal->offset[s];
+        }
+        if (gain_db) {
+            gain_db[f] = db;
+        }
+
+        float scale = powf(10.0f, -db / 20.0f);
+        convert(csi + f * n_tones * 2, n_tones, out, NULL);
+        for (i = 0; i < n_tones * 2; i++) {
+            out[i] *= scale;
+        }
+    }
+}
+
+const char *
+csi_features_isa(void)
+{
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
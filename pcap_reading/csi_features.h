@@ -0,0 +1,51 @@
+#ifndef CSI_FEATURES_H
+#define CSI_FEATURES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "csi_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// converts n_frames x n_tones (real, imag) int16 pairs, as written by csi_pcap_decode, in one pass.
+// every output may be NULL and is then not computed, e.g. only cplx for the complex csi.
+// each has n_frames x n_tones entries (cplx has two floats per entry):
+//   cplx   float32 (real, imag), same layout as numpy complex64
+//   mag    |csi|
+//   db     10 * log10(|csi|^2)
+//   phase  angle(csi), unwrapped along the tones of each frame
+void csi_features(const int16_t *csi, size_t n_frames, size_t n_tones,
+    float *cplx, float *mag, float *db, float *phase);
+
+// index of gain_type 10 in the gain arrays, the only gain type that follows the agc
+#define CSI_GAIN_TYPE_10            5
+
+// the gain of a stage in dB is weight * gain + offset
+struct csi_gain_calibration {
+    float weight[CSI_N_GAIN_STAGES];
+    float offset[CSI_N_GAIN_STAGES];
+};
+
+// weight 1 for all stages except trLoss (-1), no offsets
+void csi_gain_calibration_default(struct csi_gain_calibration *cal);
+
+// scales the csi of every frame by the total rx gain of gain type gain_type (index into the 6 gain types)
+// to the absolute received amplitude, gains and gain_type_mask as in struct csi_columns.
+// cplx gets n_frames x n_tones float32 (real, imag), gain_db (may be NULL) the total gain of each frame.
+// frames whose gain_type_mask lacks gain_type, e.g. compact frames of other gain types, get NaN in both.
+// gain_type_mask may be NULL if every frame carries all gain types
+void csi_gain_normalize(const int16_t *csi, const int8_t *gains, const uint8_t *gain_type_mask,
+    size_t n_frames, size_t n_tones, int gain_type, const struct csi_gain_calibration *cal,
+    float *cplx, float *gain_db);
+
+// name of the vector instruction set the library was built for
+const char *csi_features_isa(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*CSI_FEATURES_H*/
@@ -0,0 +1,74 @@
+// frames per second of csi_features for 20, 40 and 80 MHz frames, with all features and with the
+// complex csi only as the readers of read_pcap.py convert it.
+// usage: csi_features_bench [frames]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "csi_features.h"
+
+#define ROUNDS          5
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// best of ROUNDS in frames/s
+static double
+run(const int16_t *csi, size_t n_frames, size_t n_tones, float *cplx, float *mag, float *db, float *phase)
+{
+    double best = 0.0;
+    int r;
+    for (r = 0; r < ROUNDS; r++) {
+        double start = now();
+        csi_features(csi, n_frames, n_tones, cplx, mag, db, phase);
+        double rate = n_frames / (now() - start);
+        if (rate > best) {
+            best = rate;
+        }
+    }
+    return best;
+}
+
+int
+main(int argc, char **argv)
+{
+    static const size_t tones[] = {64, 128, 256};
+    size_t n_frames = argc > 1 ? strtoul(argv[1], NULL, 0) : 20000;
+    size_t n = n_frames * tones[2];
+    size_t i, b;
+
+    int16_t *csi = malloc(n * 2 * sizeof(int16_t));
+    float *cplx = malloc(n * 2 * sizeof(float));
+    float *mag = malloc(n * sizeof(float));
+    float *db = malloc(n * sizeof(float));
+    float *phase = malloc(n * sizeof(float));
+    if (!csi || !cplx || !mag || !db || !phase) {
+        fprintf(stderr, "cannot allocate %zu frames\n", n_frames);
+        return 1;
+    }
+    srand(10);
+    for (i = 0; i < n * 2; i++) {
+        csi[i] = (rand() % 16384) - 8192;
+    }
+
+    printf("%zu frames, %s\n", n_frames, csi_features_isa());
+    printf("%-8s %16s %16s %8s\n", "tones", "all frames/s", "complex frames/s", "speedup");
+    for (b = 0; b < sizeof(tones) / sizeof(tones[0]); b++) {
+        double all = run(csi, n_frames, tones[b], cplx, mag, db, phase);
+        double complex_only = run(csi, n_frames, tones[b], cplx, NULL, NULL, NULL);
+        printf("%-8zu %16.0f %16.0f %7.1fx\n", tones[b], all, complex_only, complex_only / all);
+    }
+
+    free(csi);
+    free(cplx);
+    free(mag);
+    free(db);
+    free(phase);
+    return 0;
+}
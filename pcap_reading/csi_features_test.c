@@ -0,0 +1,73 @@
+// checks csi_gain_normalize on synthetic columns: a frame with all gain types, a compact frame with the
+// selected gain type and a compact frame without it, which must be NaN instead of scaled by zero gains
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "csi_features.h"
+
+#define N_FRAMES        3
+#define N_TONES         4
+
+static int failed = 0;
+
+static void
+check(int ok, const char *what)
+{
+    printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+    failed |= !ok;
+}
+
+int
+main(void)
+{
+    static const uint8_t masks[N_FRAMES] = {
+        (1 << CSI_N_GAIN_TYPES) - 1,
+        1 << CSI_GAIN_TYPE_10,
+        1 << 0,
+    };
+    int16_t csi[N_FRAMES * N_TONES * 2];
+    int8_t gains[N_FRAMES][CSI_N_GAIN_STAGES * CSI_N_GAIN_TYPES];
+    float cplx[N_FRAMES * N_TONES * 2];
+    float gain_db[N_FRAMES];
+    struct csi_gain_calibration cal;
+    int f, i, ok;
+
+    for (i = 0; i < N_FRAMES * N_TONES * 2; i++) {
+        csi[i] = 100 * (i + 1);
+    }
+    // 20 dB in the first stage of the types a frame carries, as csi_pcap_decode leaves 0 for the others
+    memset(gains, 0, sizeof(gains));
+    for (f = 0; f < N_FRAMES; f++) {
+        for (i = 0; i < CSI_N_GAIN_TYPES; i++) {
+            if (masks[f] & (1 << i)) {
+                gains[f][i] = 20;
+            }
+        }
+    }
+    csi_gain_calibration_default(&cal);
+    csi_gain_normalize(csi, &gains[0][0], masks, N_FRAMES, N_TONES, CSI_GAIN_TYPE_10, &cal, cplx, gain_db);
+
+    for (f = 0; f < 2; f++) {
+        ok = fabsf(gain_db[f] - 20.0f) < 1e-4f;
+        for (i = 0; i < N_TONES * 2; i++) {
+            int o = f * N_TONES * 2 + i;
+            ok &= fabsf(cplx[o] - csi[o] / 10.0f) < 1e-3f;
+        }
+        check(ok, f == 0 ? "frame with all gain types is scaled" : "compact frame with the gain type is scaled");
+    }
+    ok = isnan(gain_db[2]);
+    for (i = 0; i < N_TONES * 2; i++) {
+        ok &= isnan(cplx[2 * N_TONES * 2 + i]);
+    }
+    check(ok, "compact frame without the gain type is NaN");
+
+    // without masks every frame counts as carrying all gain types
+    csi_gain_normalize(csi, &gains[0][0], NULL, N_FRAMES, N_TONES, CSI_GAIN_TYPE_10, &cal, cplx, gain_db);
+    check(!isnan(gain_db[2]) && fabsf(cplx[2 * N_TONES * 2] - csi[2 * N_TONES * 2]) < 1e-3f,
+        "no gain_type_mask: all frames are scaled");
+
+    printf("%s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
@@ -0,0 +1,408 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "csi_parallel.h"
+#include "csi_decode_internal.h"
+
+// part of a file that starts and ends at record boundaries
+struct job_chunk {
+    uint32_t file;
+    size_t start;
+    size_t end;
+    struct capture_format fmt;          /* pcapng interfaces known at start */
+    size_t n_frames;                    /* counted */
+    size_t out;                         /* index of the first frame in the output */
+    size_t decoded;
+};
+
+struct csi_job {
+    struct csi_pcap **files;
+    size_t n_files;
+    struct job_chunk *chunks;
+    size_t n_chunks;
+    int counted;
+};
+
+// every worker owns a range of tasks, takes them from the front and steals from the back of the others
+struct task_queue {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+};
+
+struct pool {
+    struct task_queue *queues;
+    int n_threads;
+    void (*run)(struct csi_job *job, size_t task, void *arg);
+    struct csi_job *job;
+    void *arg;
+};
+
+struct pool_worker {
+    struct pool *pool;
+    int id;
+};
+
+struct decode_arg {
+    struct csi_columns *cols;
+    uint32_t *file_index;
+    size_t max_frames;
+};
+
+static int
+take_task(struct task_queue *q, int steal, size_t *task)
+{
+    int ret = 0;
+    pthread_mutex_lock(&q->lock);
+    if (q->next < q->end) {
+        *task = steal ? --q->end : q->next++;
+        ret = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+static void *
+pool_worker(void *data)
+{
+    struct pool_worker *w = data;
+    struct pool *pool = w->pool;
+    size_t task;
+    int i;
+
+    for (;;) {
+        if (take_task(&pool->queues[w->id], 0, &task)) {
+            pool->run(pool->job, task, pool->arg);
+            continue;
+        }
+        // own queue is empty, steal from the others
+        int stolen = 0;
+        for (i = 1; i < pool->n_threads && !stolen; i++) {
+            stolen = take_task(&pool->queues[(w->id + i) % pool->n_threads], 1, &task);
+        }
+        if (!stolen) {
+            break;
+        }
+        pool->run(pool->job, task, pool->arg);
+    }
+    return NULL;
+}
+
+static void
+run_pool(struct csi_job *job, size_t n_tasks, int n_threads,
+    void (*run)(struct csi_job *job, size_t task, void *arg), void *arg)
+{
+    struct pool pool = { NULL, n_threads, run, job, arg };
+    struct pool_worker *workers;
+    pthread_t *threads;
+    int i, started = 1;
+
+    if (n_threads < 1) {
+        n_threads = pool.n_threads = 1;
+    }
+    pool.queues = calloc(n_threads, sizeof(*pool.queues));
+    workers = calloc(n_threads, sizeof(*workers));
+    threads = calloc(n_threads, sizeof(*threads));
+    if (pool.queues == NULL || workers == NULL || threads == NULL) {
+        // run everything on the calling thread
+        size_t t;
+        for (t = 0; t < n_tasks; t++) {
+            run(job, t, arg);
+        }
+        free(pool.queues);
+        free(workers);
+        free(threads);
+        return;
+    }
+    for (i = 0; i < n_threads; i++) {
+        pthread_mutex_init(&pool.queues[i].lock, NULL);
+        pool.queues[i].next = n_tasks * i / n_threads;
+        pool.queues[i].end = n_tasks * (i + 1) / n_threads;
+        workers[i].pool = &pool;
+        workers[i].id = i;
+    }
+    // the calling thread is worker 0, workers that cannot be started leave their tasks to be stolen
+    for (i = 1; i < n_threads; i++) {
+        if (pthread_create(&threads[i], NULL, pool_worker, &workers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+    pool_worker(&workers[0]);
+    for (i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (i = 0; i < n_threads; i++) {
+        pthread_mutex_destroy(&pool.queues[i].lock);
+    }
+    free(pool.queues);
+    free(workers);
+    free(threads);
+}
+
+static int
+add_chunk(struct csi_job *job, size_t *cap, uint32_t file, size_t start, size_t end, const struct capture_format *fmt)
+{
+    if (start >= end) {
+        return 0;
+    }
+    if (job->n_chunks == *cap) {
+        size_t new_cap = *cap ? *cap * 2 : 64;
+        struct job_chunk *chunks = realloc(job->chunks, new_cap * sizeof(*chunks));
+        if (chunks == NULL) {
+            return -1;
+        }
+        job->chunks = chunks;
+        *cap = new_cap;
+    }
+    struct job_chunk *c = &job->chunks[job->n_chunks++];
+    memset(c, 0, sizeof(*c));
+    c->file = file;
+    c->start = start;
+    c->end = end;
+    c->fmt = *fmt;
+    return 0;
+}
+
+struct csi_job *
+csi_job_open(const char * const *files, size_t n_files, size_t chunk_bytes)
+{
+    struct csi_job *job;
+    size_t cap = 0;
+    size_t f;
+
+    job = calloc(1, sizeof(*job));
+    if (job == NULL) {
+        return NULL;
+    }
+    job->files = calloc(n_files, sizeof(*job->files));
+    if (job->files == NULL) {
+        free(job);
+        return NULL;
+    }
+    job->n_files = n_files;
+
+    for (f = 0; f < n_files; f++) {
+        struct csi_pcap *pcap = csi_pcap_open(files[f]);
+        struct capture_format fmt;
+        struct packet pkt;
+        size_t pos, start;
+
+        if (pcap == NULL) {
+            csi_job_close(job);
+            return NULL;
+        }
+        job->files[f] = pcap;
+
+        // only the record headers are read to find the chunk boundaries
+        capture_parse_header(&fmt, pcap->base, pcap->size, &pos);
+        struct capture_format chunk_fmt = fmt;
+        start = pos;
+        while (pos < pcap->size) {
+            if (pos - start >= chunk_bytes) {
+                if (add_chunk(job, &cap, f, start, pos, &chunk_fmt) < 0) {
+                    csi_job_close(job);
+                    return NULL;
+                }
+                start = pos;
+                chunk_fmt = fmt;
+            }
+            size_t blen = capture_parse_block(&fmt, pcap->base + pos, pcap->size - pos, &pkt);
+            if (blen == BLOCK_INCOMPLETE || blen == BLOCK_INVALID) {
+                break;
+            }
+            pos += blen;
+        }
+        if (add_chunk(job, &cap, f, start, pos, &chunk_fmt) < 0) {
+            csi_job_close(job);
+            return NULL;
+        }
+    }
+    return job;
+}
+
+void
+csi_job_close(struct csi_job *job)
+{
+    size_t f;
+    if (job == NULL) {
+        return;
+    }
+    for (f = 0; f < job->n_files; f++) {
+        csi_pcap_close(job->files[f]);
+    }
+    free(job->files);
+    free(job->chunks);
+    free(job);
+}
+
+size_t
+csi_job_n_chunks(const struct csi_job *job)
+{
+    return job->n_chunks;
+}
+
+static void
+count_chunk(struct csi_job *job, size_t task, void *arg)
+{
+    struct job_chunk *c = &job->chunks[task];
+    const uint8_t *base = job->files[c->file]->base;
+    struct capture_format fmt = c->fmt;
+    struct packet pkt;
+    size_t pos = c->start;
+
+    c->n_frames = 0;
+    while (pos < c->end) {
+        size_t blen = capture_parse_block(&fmt, base + pos, c->end - pos, &pkt);
+        if (blen == BLOCK_INCOMPLETE || blen == BLOCK_INVALID) {
+            break;
+        }
+        pos += blen;
+        c->n_frames += capture_count_packet(&pkt);
+    }
+}
+
+size_t
+csi_job_count_frames(struct csi_job *job, int n_threads)
+{
+    size_t i, total = 0;
+
+    run_pool(job, job->n_chunks, n_threads, count_chunk, NULL);
+    for (i = 0; i < job->n_chunks; i++) {
+        job->chunks[i].out = total;
+        total += job->chunks[i].n_frames;
+    }
+    job->counted = 1;
+    return total;
+}
+
+static void
+decode_chunk(struct csi_job *job, size_t task, void *data)
+{
+    struct decode_arg *arg = data;
+    struct job_chunk *c = &job->chunks[task];
+    const uint8_t *base = job->files[c->file]->base;
+    struct capture_format fmt = c->fmt;
+    struct batch_state bs = { 0, 0 };
+    struct packet pkt;
+    size_t pos = c->start;
+    size_t limit, i;
+
+    c->decoded = 0;
+    if (c->out >= arg->max_frames) {
+        return;
+    }
+    limit = c->out + c->n_frames;
+    if (limit > arg->max_frames) {
+        limit = arg->max_frames;
+    }
+    while (pos < c->end && c->out + c->decoded < limit) {
+        size_t blen = capture_parse_block(&fmt, base + pos, c->end - pos, &pkt);
+        if (blen == BLOCK_INCOMPLETE || blen == BLOCK_INVALID) {
+            break;
+        }
+        c->decoded += capture_decode_packet(&bs, &pkt, arg->cols, c->out + c->decoded, limit);
+        bs.left = 0;
+        pos += blen;
+    }
+    if (arg->file_index) {
+        for (i = 0; i < c->decoded; i++) {
+            arg->file_index[c->out + i] = c->file;
+        }
+    }
+}
+
+struct sort_key {
+    uint64_t ts;
+    size_t idx;
+};
+
+static int
+compare_key(const void *a, const void *b)
+{
+    const struct sort_key *x = a, *y = b;
+    if (x->ts != y->ts) {
+        return x->ts < y->ts ? -1 : 1;
+    }
+    return x->idx < y->idx ? -1 : x->idx > y->idx;
+}
+
+// moves entry order[i] of every column to i
+static int
+permute_columns(struct csi_columns *cols, uint32_t *file_index, const struct sort_key *order, size_t n)
+{
+    size_t i;
+    int c;
+
+    for (c = 0; c <= CSI_RING_N_COLUMNS; c++) {
+        uint8_t *col = c < CSI_RING_N_COLUMNS ? *csi_column_ptr(cols, c) : (uint8_t *) file_index;
+        size_t size = c < CSI_RING_N_COLUMNS ? csi_column_size(c, cols->max_tones) : sizeof(*file_index);
+        if (col == NULL) {
+            continue;
+        }
+        uint8_t *tmp = malloc(n * size);
+        if (tmp == NULL) {
+            return -1;
+        }
+        for (i = 0; i < n; i++) {
+            memcpy(tmp + i * size, col + order[i].idx * size, size);
+        }
+        memcpy(col, tmp, n * size);
+        free(tmp);
+    }
+    return 0;
+}
+
+size_t
+csi_job_decode(struct csi_job *job, struct csi_columns *cols, size_t max_frames, uint32_t *file_index,
+    int n_threads)
+{
+    struct decode_arg arg = { cols, file_index, max_frames };
+    struct csi_columns with_ts = *cols;
+    uint64_t *ts = NULL;
+    struct sort_key *keys;
+    size_t i, j, n = 0;
+    int sorted = 1;
+
+    if (!job->counted) {
+        csi_job_count_frames(job, n_threads);
+    }
+    // timestamps are needed for the merge even if the caller does not want them
+    if (with_ts.ts_usec == NULL) {
+        ts = malloc((max_frames ? max_frames : 1) * sizeof(*ts));
+        if (ts == NULL) {
+            return 0;
+        }
+        with_ts.ts_usec = ts;
+    }
+    arg.cols = &with_ts;
+    run_pool(job, job->n_chunks, n_threads, decode_chunk, &arg);
+
+    // chunks that decoded less frames than counted leave holes, which are skipped by the merge
+    keys = malloc((max_frames ? max_frames : 1) * sizeof(*keys));
+    if (keys == NULL) {
+        free(ts);
+        return 0;
+    }
+    for (i = 0; i < job->n_chunks; i++) {
+        struct job_chunk *c = &job->chunks[i];
+        for (j = 0; j < c->decoded; j++) {
+            keys[n].ts = with_ts.ts_usec[c->out + j];
+            keys[n].idx = c->out + j;
+            if (keys[n].idx != n || (n > 0 && keys[n].ts < keys[n - 1].ts)) {
+                sorted = 0;
+            }
+            n++;
+        }
+    }
+    if (!sorted) {
+        qsort(keys, n, sizeof(*keys), compare_key);
+        if (permute_columns(&with_ts, file_index, keys, n) < 0) {
+            n = 0;
+        }
+    }
+    free(keys);
+    free(ts);
+    return n;
+}
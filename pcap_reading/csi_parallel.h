@@ -0,0 +1,34 @@
+#ifndef CSI_PARALLEL_H
+#define CSI_PARALLEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "csi_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct csi_job;
+
+// maps the files and splits them into chunks of about chunk_bytes at record boundaries, returns NULL on error
+struct csi_job *csi_job_open(const char * const *files, size_t n_files, size_t chunk_bytes);
+void csi_job_close(struct csi_job *job);
+
+size_t csi_job_n_chunks(const struct csi_job *job);
+
+// number of csi frames in all files, counted with n_threads threads
+size_t csi_job_count_frames(struct csi_job *job, int n_threads);
+
+// decodes all files with n_threads threads into cols, at most max_frames frames (csi_job_count_frames).
+// the frames of all files are merged in timestamp order, frames with the same timestamp keep their order.
+// file_index (may be NULL) gets the index of the file of every frame. returns the number of frames decoded
+size_t csi_job_decode(struct csi_job *job, struct csi_columns *cols, size_t max_frames, uint32_t *file_index,
+    int n_threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*CSI_PARALLEL_H*/
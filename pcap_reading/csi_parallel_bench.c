@@ -0,0 +1,196 @@
+// files per second of csi_job_decode (csi_parallel.h) with 1 to n threads. writes n_files synthetic
+// pcap files of 80 MHz frames to a temporary directory, decodes all of them with every thread count
+// and removes them again. the files are in the page cache, so this measures decoding, not the disk.
+// usage: csi_parallel_bench [n_files] [frames per file] [max threads]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "csi_parallel.h"
+
+#define N_TONES         256
+#define FRAME_LEN       (70 + N_TONES * 4)
+#define UDP_LEN         (8 + FRAME_LEN)
+#define IP_LEN          (20 + UDP_LEN)
+#define PACKET_LEN      (14 + IP_LEN)
+#define ROUNDS          3
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+st16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+// ethernet/ipv4/udp frame to port 5500 with a csi_udp_frame of 80 MHz
+static void
+build_packet(uint8_t *pkt, uint16_t seq)
+{
+    uint8_t *ip = pkt + 14;
+    uint8_t *frm = ip + 20 + 8;
+    int i;
+    memset(pkt, 0, PACKET_LEN);
+    memset(pkt, 0xff, 6);
+    pkt[12] = 0x08;
+    ip[0] = 0x45;
+    ip[2] = IP_LEN >> 8;
+    ip[3] = IP_LEN & 0xff;
+    ip[9] = 17;
+    ip[20] = ip[22] = 5500 >> 8;
+    ip[21] = ip[23] = 5500 & 0xff;
+    ip[24] = UDP_LEN >> 8;
+    ip[25] = UDP_LEN & 0xff;
+    // magic, rssi, fc, src mac, seq, csiconf, chanspec, chip
+    st16(frm, 0x1111);
+    frm[2] = (uint8_t) -50;
+    frm[3] = 0x88;
+    memcpy(frm + 4, "\x00\x11\x22\x33\x44\x55", 6);
+    st16(frm + 10, seq);
+    st16(frm + 14, 0xe02a);
+    st16(frm + 16, 0x4345);
+    for (i = 0; i < N_TONES * 2; i++) {
+        st16(frm + 70 + i * 2, (uint16_t) ((rand() % 16384) - 8192));
+    }
+}
+
+static int
+write_pcap(const char *path, size_t n_frames, uint32_t ts_sec)
+{
+    uint32_t hdr[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1 };
+    uint8_t pkt[PACKET_LEN];
+    size_t f;
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+    fwrite(hdr, sizeof(hdr), 1, fp);
+    for (f = 0; f < n_frames; f++) {
+        uint32_t rec[4] = { ts_sec, f, PACKET_LEN, PACKET_LEN };
+        build_packet(pkt, f);
+        fwrite(rec, sizeof(rec), 1, fp);
+        fwrite(pkt, sizeof(pkt), 1, fp);
+    }
+    return fclose(fp);
+}
+
+static void *
+column(size_t n, size_t size)
+{
+    void *p = calloc(n, size);
+    if (p == NULL) {
+        fprintf(stderr, "cannot allocate %zu frames\n", n);
+        exit(1);
+    }
+    return p;
+}
+
+// best time of ROUNDS to open, count and decode all files, returns the number of frames in *frames
+static double
+run(const char * const *files, size_t n_files, int n_threads, size_t *frames)
+{
+    double best = 0.0;
+    int r;
+    for (r = 0; r < ROUNDS; r++) {
+        double start = now();
+        struct csi_job *job = csi_job_open(files, n_files, 16 << 20);
+        if (job == NULL) {
+            fprintf(stderr, "cannot open the files\n");
+            exit(1);
+        }
+        size_t n = csi_job_count_frames(job, n_threads);
+        struct csi_columns cols = {
+            .ts_usec = column(n, sizeof(uint64_t)),
+            .src_mac = column(n, 6),
+            .seq_cnt = column(n, sizeof(uint16_t)),
+            .chanspec = column(n, sizeof(uint16_t)),
+            .rssi = column(n, sizeof(int8_t)),
+            .n_tones = column(n, sizeof(uint16_t)),
+            .csi = column(n * N_TONES * 2, sizeof(int16_t)),
+            .max_tones = N_TONES,
+        };
+        *frames = csi_job_decode(job, &cols, n, NULL, n_threads);
+        csi_job_close(job);
+        double t = now() - start;
+        if (r == 0 || t < best) {
+            best = t;
+        }
+        free(cols.ts_usec);
+        free(cols.src_mac);
+        free(cols.seq_cnt);
+        free(cols.chanspec);
+        free(cols.rssi);
+        free(cols.n_tones);
+        free(cols.csi);
+    }
+    return best;
+}
+
+int
+main(int argc, char **argv)
+{
+    size_t n_files = argc > 1 ? strtoul(argv[1], NULL, 0) : 64;
+    size_t frames_per_file = argc > 2 ? strtoul(argv[2], NULL, 0) : 2000;
+    int max_threads = argc > 3 ? atoi(argv[3]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    char dir[] = "/tmp/csi_parallel_bench.XXXXXX";
+    char **files;
+    size_t i, frames;
+    int n, ret = 0;
+    double base = 0.0;
+
+    if (n_files == 0 || max_threads < 1 || mkdtemp(dir) == NULL) {
+        fprintf(stderr, "usage: csi_parallel_bench [n_files] [frames per file] [max threads]\n");
+        return 2;
+    }
+    files = column(n_files, sizeof(char *));
+    srand(15);
+    for (i = 0; i < n_files; i++) {
+        files[i] = column(sizeof(dir) + 16, 1);
+        snprintf(files[i], sizeof(dir) + 16, "%s/%zu.pcap", dir, i);
+        if (write_pcap(files[i], frames_per_file, i) != 0) {
+            fprintf(stderr, "cannot write %s\n", files[i]);
+            ret = 1;
+            goto out;
+        }
+    }
+
+    printf("%zu files of %zu frames with %d tones, %d cpus\n", n_files, frames_per_file, N_TONES,
+        (int) sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-8s %10s %12s %8s\n", "threads", "files/s", "frames/s", "speedup");
+    // 1, 2, 4, ... threads and max_threads
+    for (n = 1; ; n = n * 2 < max_threads ? n * 2 : max_threads) {
+        double t = run((const char * const *) files, n_files, n, &frames);
+        if (n == 1) {
+            base = t;
+        }
+        printf("%-8d %10.1f %12.0f %7.2fx%s\n", n, n_files / t, frames / t, base / t,
+            frames == n_files * frames_per_file ? "" : "  WRONG FRAME COUNT");
+        if (frames != n_files * frames_per_file) {
+            ret = 1;
+        }
+        if (n == max_threads) {
+            break;
+        }
+    }
+
+out:
+    for (i = 0; i < n_files; i++) {
+        if (files[i] != NULL) {
+            unlink(files[i]);
+            free(files[i]);
+        }
+    }
+    free(files);
+    rmdir(dir);
+    return ret;
+}
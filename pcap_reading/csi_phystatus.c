@@ -0,0 +1,153 @@
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "csi_phystatus.h"
+
+// frames gathered at once, the words of a block stay in the l1 cache while all fields are extracted
+#define BLOCK_FRAMES    512
+
+const struct csi_phystatus_field_desc csi_phystatus_fields[CSI_PRXS_N_FIELDS] = {
+    [CSI_PRXS_FT] = { "ft", 0, 0, 0, 0x0003 },
+    [CSI_PRXS_CLIP] = { "clip", 0, 2, 0, 0x000c },
+    [CSI_PRXS_UNSRATE] = { "unsrate", 0, 4, 0, 0x0010 },
+    [CSI_PRXS_BAND5G] = { "band5g", 0, 5, 0, 0x0020 },
+    [CSI_PRXS_LCRS] = { "lcrs", 0, 6, 0, 0x0040 },
+    [CSI_PRXS_SHORTH] = { "shorth", 0, 7, 0, 0x0080 },
+    [CSI_PRXS_PLCPFV] = { "plcpfv", 0, 8, 0, 0x0100 },
+    [CSI_PRXS_PLCPHCF] = { "plcphcf", 0, 9, 0, 0x0200 },
+    [CSI_PRXS_MFCRS] = { "mfcrs", 0, 10, 0, 0x0400 },
+    [CSI_PRXS_ACCRS] = { "accrs", 0, 11, 0, 0x0800 },
+    [CSI_PRXS_SUBBAND] = { "subband", 0, 12, 0, 0xf000 },
+    [CSI_PRXS_COREMASK] = { "coremask", 1, 0, 0, 0x000f },
+    [CSI_PRXS_ANTCFG] = { "antcfg", 1, 4, 0, 0x00f0 },
+    [CSI_PRXS_RXPWR_ANT0] = { "rxpwr_ant0", 2, 8, 1, 0xff00 },
+    [CSI_PRXS_RXPWR_ANT1] = { "rxpwr_ant1", 3, 0, 1, 0x00ff },
+    [CSI_PRXS_RXPWR_ANT2] = { "rxpwr_ant2", 3, 8, 1, 0xff00 },
+    [CSI_PRXS_RXPWR_ANT3] = { "rxpwr_ant3", 4, 0, 1, 0x00ff },
+    [CSI_PRXS_CFO] = { "cfo", 4, 8, 1, 0xff00 },
+    [CSI_PRXS_FFO] = { "ffo", 5, 0, 1, 0x00ff },
+    [CSI_PRXS_AR] = { "ar", 5, 8, 1, 0xff00 },
+    [CSI_PRXS_LNAGN] = { "lnagn", 2, 14, 0, 0xc000 },
+    [CSI_PRXS_PGAGN] = { "pgagn", 2, 10, 0, 0x3c00 },
+    [CSI_PRXS_FOFF] = { "foff", 2, 0, 0, 0x03ff },
+};
+
+static int
+field_width(uint16_t mask)
+{
+    return __builtin_popcount(mask);
+}
+
+// signed fields are moved to the top of the word and shifted back arithmetically
+#if defined(__AVX2__)
+static size_t
+extract_vec(const uint16_t *words, size_t n, const struct csi_phystatus_field_desc *d, int16_t *out)
+{
+    __m256i mask = _mm256_set1_epi16((short) d->mask);
+    __m128i shift = _mm_cvtsi32_si128(d->shift);
+    __m128i up = _mm_cvtsi32_si128(16 - d->shift - field_width(d->mask));
+    __m128i down = _mm_cvtsi32_si128(16 - field_width(d->mask));
+    size_t i;
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (words + i)), mask);
+        if (d->is_signed) {
+            v = _mm256_sra_epi16(_mm256_sll_epi16(v, up), down);
+        } else {
+            v = _mm256_srl_epi16(v, shift);
+        }
+        _mm256_storeu_si256((__m256i *) (out + i), v);
+    }
+    return i;
+}
+#elif defined(__SSE2__)
+static size_t
+extract_vec(const uint16_t *words, size_t n, const struct csi_phystatus_field_desc *d, int16_t *out)
+{
+    __m128i mask = _mm_set1_epi16((short) d->mask);
+    __m128i shift = _mm_cvtsi32_si128(d->shift);
+    __m128i up = _mm_cvtsi32_si128(16 - d->shift - field_width(d->mask));
+    __m128i down = _mm_cvtsi32_si128(16 - field_width(d->mask));
+    size_t i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *) (words + i)), mask);
+        if (d->is_signed) {
+            v = _mm_sra_epi16(_mm_sll_epi16(v, up), down);
+        } else {
+            v = _mm_srl_epi16(v, shift);
+        }
+        _mm_storeu_si128((__m128i *) (out + i), v);
+    }
+    return i;
+}
+#else
+static size_t
+extract_vec(const uint16_t *words, size_t n, const struct csi_phystatus_field_desc *d, int16_t *out)
+{
+    return 0;
+}
+#endif
+
+static void
+extract(const uint16_t *words, size_t n, const struct csi_phystatus_field_desc *d, int16_t *out)
+{
+    int width = field_width(d->mask);
+    size_t i = extract_vec(words, n, d, out);
+    for (; i < n; i++) {
+        uint16_t v = (words[i] & d->mask) >> d->shift;
+        if (d->is_signed && (v & (1 << (width - 1)))) {
+            out[i] = (int16_t) (v - (1 << width));
+        } else {
+            out[i] = (int16_t) v;
+        }
+    }
+}
+
+void
+csi_phystatus_extract(const int16_t *csi, size_t max_tones, const uint16_t *chanspec, const uint16_t *flags,
+    const uint16_t *phystatus, size_t n, int16_t * const *fields, uint8_t *valid)
+{
+    uint16_t words[CSI_PHYSTATUS_WORDS][BLOCK_FRAMES];
+    size_t start, i;
+    int w, f;
+
+    for (start = 0; start < n; start += BLOCK_FRAMES) {
+        size_t len = n - start < BLOCK_FRAMES ? n - start : BLOCK_FRAMES;
+
+        // gather the words of every frame so that each field is a shift and mask over a contiguous array
+        for (i = 0; i < len; i++) {
+            size_t idx = start + i;
+            uint16_t f_flags = flags ? flags[idx] : 0;
+            size_t tone = ((chanspec[idx] & 0x3800) >> 11) == 2 ? CSI_PHYSTATUS_TONE_20MHZ : 0;
+            const uint16_t *src = (const uint16_t *) (csi + (idx * max_tones + tone) * 2);
+            int ok;
+            if (f_flags & CSI_FLAG_LEGACY) {
+                // only CSI_TOOL_VERSION_TEST_PHYSTATUS inserted it, at tone 28 at every bandwidth
+                tone = CSI_PHYSTATUS_TONE_20MHZ;
+                src = (const uint16_t *) (csi + (idx * max_tones + tone) * 2);
+                ok = (f_flags & CSI_FLAG_LEGACY_PHYSTATUS) && tone + CSI_PHYSTATUS_WORDS / 2 <= max_tones;
+            } else if (f_flags & CSI_FLAG_EXT_HEADER) {
+                ok = phystatus != NULL;
+                src = phystatus + idx * CSI_PHYSTATUS_WORDS;
+            } else {
+                ok = !(f_flags & (CSI_FLAG_TONE_SELECT | CSI_FLAG_PACKED14))
+                    && tone + CSI_PHYSTATUS_WORDS / 2 <= max_tones;
+            }
+            for (w = 0; w < CSI_PHYSTATUS_WORDS; w++) {
+                words[w][i] = ok ? src[w] : 0;
+            }
+            if (valid) {
+                valid[idx] = ok;
+            }
+        }
+        for (f = 0; f < CSI_PRXS_N_FIELDS; f++) {
+            if (fields[f]) {
+                extract(words[csi_phystatus_fields[f].word], len, &csi_phystatus_fields[f], fields[f] + start);
+            }
+        }
+    }
+}
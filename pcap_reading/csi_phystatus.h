@@ -0,0 +1,71 @@
+#ifndef CSI_PHYSTATUS_H
+#define CSI_PHYSTATUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "csi_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// frames with CSI_FLAG_EXT_HEADER carry PhyRxStatus_0..5 of the received frame in the header. otherwise the
+// firmware copies them into the csi of every frame that is sent without tone selection or packing: at tone 28
+// for 20 MHz (an unused tone), at tone 0 otherwise. word 2k is the real and word 2k + 1 the imaginary part
+// of tone offset + k. of the older tool versions (CSI_FLAG_LEGACY) only CSI_TOOL_VERSION_TEST_PHYSTATUS
+// carries phystatus, at tone 28 at every bandwidth.
+#define CSI_PHYSTATUS_WORDS         CSI_N_PHYSTATUS
+#define CSI_PHYSTATUS_TONE_20MHZ    28
+
+// bitfields of the acphy PhyRxStatus words (PRXS*_ACPHY_* in d11.h). the mcs is not part of
+// PhyRxStatus, ft only tells cck, ofdm, ht and vht apart. lnagn, pgagn and foff are the
+// PRXS2_* fields of older phys that CSI_TOOL_VERSION_TEST_PHYSTATUS reads.
+enum csi_phystatus_field {
+    CSI_PRXS_FT = 0,                    /* PRXS0_ACPHY_FT_MASK: 0 cck, 1 ofdm, 2 ht, 3 vht */
+    CSI_PRXS_CLIP,                      /* PRXS0_ACPHY_CLIP_MASK */
+    CSI_PRXS_UNSRATE,                   /* PRXS0_ACPHY_UNSRATE */
+    CSI_PRXS_BAND5G,                    /* PRXS0_ACPHY_BAND5G */
+    CSI_PRXS_LCRS,                      /* PRXS0_ACPHY_LCRS */
+    CSI_PRXS_SHORTH,                    /* PRXS0_ACPHY_SHORTH */
+    CSI_PRXS_PLCPFV,                    /* PRXS0_ACPHY_PLCPFV */
+    CSI_PRXS_PLCPHCF,                   /* PRXS0_ACPHY_PLCPHCF */
+    CSI_PRXS_MFCRS,                     /* PRXS0_ACPHY_MFCRS */
+    CSI_PRXS_ACCRS,                     /* PRXS0_ACPHY_ACCRS */
+    CSI_PRXS_SUBBAND,                   /* PRXS0_ACPHY_SUBBAND_MASK */
+    CSI_PRXS_COREMASK,                  /* PRXS1_ACPHY_COREMASK */
+    CSI_PRXS_ANTCFG,                    /* PRXS1_ACPHY_ANTCFG */
+    CSI_PRXS_RXPWR_ANT0,                /* PRXS2_ACPHY_RXPWR_ANT0, dBm */
+    CSI_PRXS_RXPWR_ANT1,                /* PRXS3_ACPHY_RXPWR_ANT1 */
+    CSI_PRXS_RXPWR_ANT2,                /* PRXS3_ACPHY_RXPWR_ANT2 */
+    CSI_PRXS_RXPWR_ANT3,                /* PRXS4_ACPHY_RXPWR_ANT3 */
+    CSI_PRXS_CFO,                       /* PRXS4_ACPHY_CFO, coarse frequency offset */
+    CSI_PRXS_FFO,                       /* PRXS5_ACPHY_FFO, fine frequency offset */
+    CSI_PRXS_AR,                        /* PRXS5_ACPHY_AR, advance retard */
+    CSI_PRXS_LNAGN,                     /* PRXS2_LNAGN_MASK */
+    CSI_PRXS_PGAGN,                     /* PRXS2_PGAGN_MASK */
+    CSI_PRXS_FOFF,                      /* PRXS2_FOFF_MASK */
+    CSI_PRXS_N_FIELDS
+};
+
+struct csi_phystatus_field_desc {
+    const char *name;
+    uint8_t word;                       /* PhyRxStatus_<word> */
+    uint8_t shift;
+    uint8_t is_signed;
+    uint16_t mask;                      /* before the shift */
+};
+
+extern const struct csi_phystatus_field_desc csi_phystatus_fields[CSI_PRXS_N_FIELDS];
+
+// extracts the PhyRxStatus fields of n frames decoded by csi_pcap_decode (csi with max_tones tones per frame,
+// chanspec, flags and phystatus columns, phystatus may be NULL). fields[f] (may be NULL) gets n int16 values
+// of field f, valid (may be NULL) is 0 for frames that carry no phystatus, their fields are 0
+void csi_phystatus_extract(const int16_t *csi, size_t max_tones, const uint16_t *chanspec, const uint16_t *flags,
+    const uint16_t *phystatus, size_t n, int16_t * const *fields, uint8_t *valid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*CSI_PHYSTATUS_H*/
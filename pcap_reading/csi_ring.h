@@ -0,0 +1,50 @@
+#ifndef CSI_RING_H
+#define CSI_RING_H
+
+#include <stdint.h>
+
+// shared memory ring written by csicapture (see csi_capture.c).
+// the ring is columnar: every column of struct csi_columns is an array of n_slots entries at
+// column_offset[] from the start of the ring, frame i is stored in slot i % n_slots.
+// write_count is the number of frames written so far and is updated after the frames are complete,
+// write_begin is updated before the writer starts to overwrite slots. a reader that copied frames
+// [a, write_count) has to check write_begin afterwards, frames before write_begin - n_slots may
+// have been overwritten while they were copied.
+
+#define CSI_RING_MAGIC              0x52495343      /* "CSIR" */
+#define CSI_RING_VERSION            3
+
+enum csi_ring_column {
+    CSI_RING_TS_USEC = 0,
+    CSI_RING_SRC_MAC,
+    CSI_RING_SEQ_CNT,
+    CSI_RING_FC,
+    CSI_RING_CSICONF,
+    CSI_RING_CHANSPEC,
+    CSI_RING_CHIP,
+    CSI_RING_RSSI,
+    CSI_RING_GAIN_TYPE_MASK,
+    CSI_RING_GAINS,
+    CSI_RING_AGC_GAIN,
+    CSI_RING_FLAGS,
+    CSI_RING_N_TONES,
+    CSI_RING_CSI,
+    CSI_RING_PHYSTATUS,
+    CSI_RING_RX_TSF_TIME,
+    CSI_RING_TSF,
+    CSI_RING_SWEEP_STEP,
+    CSI_RING_N_COLUMNS
+};
+
+struct csi_ring_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t max_tones;
+    uint32_t n_slots;
+    uint32_t PAD;
+    uint64_t write_begin;
+    uint64_t write_count;
+    uint64_t column_offset[CSI_RING_N_COLUMNS];
+};
+
+#endif /*CSI_RING_H*/
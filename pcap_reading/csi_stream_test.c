@@ -0,0 +1,176 @@
+// appends a synthetic capture to a file in pieces that end in the middle of records and checks after every
+// piece that csi_stream_poll returned exactly the complete records and csi_stream_offset points behind them.
+// then appends records longer than the snaplen and than CAPTURE_MAX_BLOCK_LEN, which must fail the stream
+// instead of growing its buffer
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "csi_decode.h"
+
+#define N_RECORDS       40
+#define MAX_TONES       256
+#define SNAPLEN         65535
+#define MAX_FRAMES      16
+
+static int failed = 0;
+
+static void
+check(int ok, const char *what)
+{
+    printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+    failed |= !ok;
+}
+
+static void
+st16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void
+st32(uint8_t *p, uint32_t v)
+{
+    st16(p, v & 0xffff);
+    st16(p + 2, v >> 16);
+}
+
+// pcap record of an ethernet/ipv4/udp frame to port 5500 with a csi_udp_frame, returns its length
+static size_t
+build_record(uint8_t *rec, uint16_t seq, int n_tones)
+{
+    size_t frame_len = 70 + n_tones * 4;
+    size_t packet_len = 14 + 20 + 8 + frame_len;
+    uint8_t *pkt = rec + 16;
+    uint8_t *ip = pkt + 14;
+    uint8_t *frm = ip + 20 + 8;
+    int i;
+
+    memset(rec, 0, 16 + packet_len);
+    st32(rec, 1000 + seq);
+    st32(rec + 8, packet_len);
+    st32(rec + 12, packet_len);
+    memset(pkt, 0xff, 6);
+    pkt[12] = 0x08;
+    ip[0] = 0x45;
+    ip[2] = (packet_len - 14) >> 8;
+    ip[3] = (packet_len - 14) & 0xff;
+    ip[9] = 17;
+    ip[20] = ip[22] = 5500 >> 8;
+    ip[21] = ip[23] = 5500 & 0xff;
+    ip[24] = (8 + frame_len) >> 8;
+    ip[25] = (8 + frame_len) & 0xff;
+    // magic, rssi, fc, src mac, seq, csiconf, chanspec, chip
+    st16(frm, 0x1111);
+    frm[2] = (uint8_t) -50;
+    frm[3] = 0x88;
+    memcpy(frm + 4, "\x00\x11\x22\x33\x44\x55", 6);
+    st16(frm + 10, seq);
+    st16(frm + 14, 0x1006);
+    st16(frm + 16, 0x4345);
+    for (i = 0; i < n_tones * 2; i++) {
+        st16(frm + 70 + i * 2, (uint16_t) (seq + i));
+    }
+    return 16 + packet_len;
+}
+
+static int
+append(FILE *fp, const uint8_t *data, size_t len)
+{
+    return fwrite(data, 1, len, fp) == len && fflush(fp) == 0;
+}
+
+int
+main(void)
+{
+    static const size_t pieces[] = {1, 7, 23, 100, 333, 1000, 5};
+    char path[] = "/tmp/csi_stream_test.XXXXXX";
+    size_t ends[N_RECORDS + 1];         /* file offset behind the header and every record */
+    uint16_t seq[MAX_FRAMES];
+    struct csi_columns cols = { .seq_cnt = seq, .max_tones = MAX_TONES };
+    size_t len = 24, written = 0, p = 0, n_frames = 0;
+    int i, fd, ok = 1, order = 1;
+
+    uint8_t *capture = malloc(24 + N_RECORDS * (16 + 14 + 20 + 8 + 70 + MAX_TONES * 4));
+    uint8_t *big = calloc(1, 16 + 300000);
+    fd = mkstemp(path);
+    FILE *fp = fd < 0 ? NULL : fdopen(fd, "wb");
+    if (capture == NULL || big == NULL || fp == NULL) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 2;
+    }
+    st32(capture, 0xa1b2c3d4);
+    st32(capture + 4, 0x00040002);
+    st32(capture + 16, SNAPLEN);
+    st32(capture + 20, 1);
+    ends[0] = len;
+    for (i = 0; i < N_RECORDS; i++) {
+        len += build_record(capture + len, i, i % 2 ? 64 : MAX_TONES);
+        ends[i + 1] = len;
+    }
+
+    struct csi_stream *stream = csi_stream_open(path);
+    check(stream != NULL, "stream opened before the header is written");
+    while (written < len) {
+        size_t n = pieces[p++ % (sizeof(pieces) / sizeof(pieces[0]))];
+        if (n > len - written) {
+            n = len - written;
+        }
+        append(fp, capture + written, n);
+        written += n;
+
+        size_t got, expected_frames = 0, expected_offset = 0;
+        while ((got = csi_stream_poll(stream, &cols, MAX_FRAMES)) > 0) {
+            size_t f;
+            for (f = 0; f < got; f++) {
+                order &= seq[f] == n_frames + f;
+            }
+            n_frames += got;
+        }
+        for (i = 0; i <= N_RECORDS && ends[i] <= written; i++) {
+            expected_offset = ends[i];
+            expected_frames = i;
+        }
+        if (n_frames != expected_frames || csi_stream_offset(stream) != expected_offset) {
+            printf("%zu bytes written: %zu frames at offset %llu instead of %zu at %zu\n", written, n_frames,
+                (unsigned long long) csi_stream_offset(stream), expected_frames, expected_offset);
+            ok = 0;
+        }
+    }
+    check(ok, "partial records: frames and offset after every piece");
+    check(order && n_frames == N_RECORDS, "partial records: all frames in order");
+    check(!csi_stream_failed(stream), "partial records: stream did not fail");
+
+    // a record longer than the snaplen, only its header is written
+    st32(big + 8, SNAPLEN + 1);
+    st32(big + 12, SNAPLEN + 1);
+    append(fp, big, 16);
+    check(csi_stream_poll(stream, &cols, MAX_FRAMES) == 0 && csi_stream_failed(stream)
+        && csi_stream_offset(stream) == len, "record longer than the snaplen fails the stream");
+    csi_stream_close(stream);
+
+    // the same without a snaplen in the file header, stops at CAPTURE_MAX_BLOCK_LEN
+    st32(capture + 16, 0);
+    st32(big + 8, 300000);
+    st32(big + 12, 300000);
+    fclose(fp);
+    fp = fopen(path, "wb");
+    append(fp, capture, len);
+    stream = csi_stream_open(path);
+    while (csi_stream_poll(stream, &cols, MAX_FRAMES) > 0) {
+    }
+    append(fp, big, 16 + 300000);
+    check(csi_stream_poll(stream, &cols, MAX_FRAMES) == 0 && csi_stream_failed(stream)
+        && csi_stream_offset(stream) == len, "record longer than 256 KiB fails the stream");
+    csi_stream_close(stream);
+
+    fclose(fp);
+    unlink(path);
+    free(capture);
+    free(big);
+    printf("%s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
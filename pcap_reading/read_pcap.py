@@ -1,17 +1,42 @@
 import numpy as np
 import struct
 import os
+import ctypes
+import time
 import pandas as pd
 
 
+def unpack_csi14(packed, count):
+    """Unpacks csi sent with CSI_FLAG_PACKED14 into an int16 array of (real, imag) pairs.
+
+    Two tones are stored in 7 bytes, each tone as 28 bit little endian value with
+    the int14 real part in bits 14-27 and the int14 imag part in bits 0-13.
+    """
+    pairs = (count + 1) // 2
+    b = np.zeros(pairs * 7, dtype=np.uint32)
+    b[:min(len(packed), pairs * 7)] = packed[:pairs * 7]
+    b = b.reshape(-1, 7)
+    values = np.empty((pairs, 2), dtype=np.uint32)
+    values[:, 0] = b[:, 0] | (b[:, 1] << 8) | (b[:, 2] << 16) | ((b[:, 3] & 0x0f) << 24)
+    values[:, 1] = (b[:, 3] >> 4) | (b[:, 4] << 4) | (b[:, 5] << 12) | (b[:, 6] << 20)
+    values = values.reshape(-1)[:count]
+    csi = np.empty((count, 2), dtype=np.int16)
+    # sign extend int14 by shifting it to the top of an int32
+    csi[:, 0] = (((values >> 14) & 0x3fff) << 18).astype(np.int32) >> 18
+    csi[:, 1] = ((values & 0x3fff) << 18).astype(np.int32) >> 18
+    return csi
+
+
 class CSIDataPcapReader:
     CSI_TOOL_VERSION_ORIGINAL = 0
     CSI_TOOL_VERSION_INCLUDE_RSSI = 1
     CSI_TOOL_VERSION_TEST_PHYSTATUS = 2
     CSI_TOOL_VERSION_GAIN_RECOVERY = 3
     CSI_TOOL_VERSION_GAIN_RECOVERY_V2 = 4
+    CSI_TOOL_VERSION_GAIN_RECOVERY_COMPACT = 5
 
-    def __init__(self, pcap_file, bandwidth, csi_tool_ver=CSI_TOOL_VERSION_INCLUDE_RSSI):
+    def __init__(self, pcap_file, bandwidth=None, csi_tool_ver=None):
+        # without bandwidth and csi_tool_ver both are detected per frame, see CSIDataPcapFrame.detect_format
         self.pcap = CSIDataPcap(pcap_file, bandwidth, csi_tool_ver)
 
     def get_data_frame(self):
@@ -37,21 +62,73 @@ class CSIDataPcapFrame:
         CSIDataPcapReader.CSI_TOOL_VERSION_INCLUDE_RSSI: 22,
         CSIDataPcapReader.CSI_TOOL_VERSION_TEST_PHYSTATUS: 22,
         CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY: 30,
-        CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_V2: 70
+        CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_V2: 70,
+        CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_COMPACT: 70
+    }
+
+    CSI_TOOL_VER_BY_PAYLOAD_HEADER_LENGTH = {
+        18: CSIDataPcapReader.CSI_TOOL_VERSION_INCLUDE_RSSI,
+        22: CSIDataPcapReader.CSI_TOOL_VERSION_TEST_PHYSTATUS,
+        30: CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY,
+        70: CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_V2
+    }
+
+    BANDWIDTH_BY_CHANSPEC_BW = {
+        0x1000: 20,
+        0x1800: 40,
+        0x2000: 80
     }
+    CHANSPEC_BW_MASK = 0x3800
+
+    CSI_FRAME_MAGIC = 0x1111
+    CSI_FRAME_MAGIC_COMPACT = 0x1112
 
-    def __init__(self, data, offset, csi_tool_ver):
+    GAIN_RECORD_FIELDS = ["elna", "lna1", "lna2", "mix", "lpf0", "lpf1", "dvga", "trLoss"]
+
+    def __init__(self, data, offset, csi_tool_ver=None, bandwidth=None):
         self.data = data
         self.offset = offset
-        self.csi_tool_ver = csi_tool_ver
 
         self.header = self.read_header()
+        detected_ver, self.bandwidth = self.detect_format(
+            data[self.offset + self.UDP_HEADER_LENGTH:self.offset + self.header["incl_len"][0]],
+            self.header["orig_len"][0] - self.UDP_HEADER_LENGTH, bandwidth)
+        self.csi_tool_ver = detected_ver if csi_tool_ver is None else csi_tool_ver
+        if self.csi_tool_ver is None:
+            self.payload_header = dict()
+            self.payload = self.read_payload(data)
+            return
         self.payload_header = self.read_payload_header(data[self.offset + self.UDP_HEADER_LENGTH:
                                                             self.offset + self.UDP_HEADER_LENGTH
                                                             + self.PAYLOAD_HEADER_LENGTH_BY_CSI_TOOL_VER[
                                                                 self.csi_tool_ver]])
         self.payload = self.read_payload(data)
 
+    @classmethod
+    def detect_format(cls, payload, payload_length, bandwidth=None):
+        """Returns the csi tool version and the bandwidth of a csi udp payload of payload_length bytes.
+
+        The bandwidth is taken from the chanspec, the version from the magic and the length of the payload header,
+        which is what remains after the csi of all tones of the bandwidth. Either is None if it cannot be detected.
+        """
+        if len(payload) < 18:
+            return None, bandwidth
+        magic, chanspec = struct.unpack_from("H12xH", payload)
+        if bandwidth is None:
+            bandwidth = cls.BANDWIDTH_BY_CHANSPEC_BW.get(chanspec & cls.CHANSPEC_BW_MASK)
+        if magic == cls.CSI_FRAME_MAGIC_COMPACT:
+            return CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_COMPACT, bandwidth
+        if magic != cls.CSI_FRAME_MAGIC or bandwidth is None:
+            return None, bandwidth
+        csi_tool_ver = cls.CSI_TOOL_VER_BY_PAYLOAD_HEADER_LENGTH.get(int(payload_length) - int(bandwidth * 3.2) * 4)
+        if csi_tool_ver is None and len(payload) >= 70:
+            # tone reduced or packed csi and the header extension change the length, only v2 has flags for it
+            flags = struct.unpack_from("H", payload, 68)[0]
+            if flags and not flags & ~(CSIDataPcap.CSI_FLAG_TONE_SELECT | CSIDataPcap.CSI_FLAG_PACKED14
+                                       | CSIDataPcap.CSI_FLAG_EXT_HEADER):
+                csi_tool_ver = CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_V2
+        return csi_tool_ver, bandwidth
+
     def read_header(self):
         header = np.frombuffer(self.data[self.offset:self.offset + self.FRAME_HEADER_DTYPE.itemsize],
                                dtype=self.FRAME_HEADER_DTYPE)
@@ -92,8 +169,27 @@ class CSIDataPcapFrame:
                     "b", payload_data[18 + i + 36:19 + i + 36])[0]
                 header["trLoss" + column_name_extensions[i]] = struct.unpack(
                     "b", payload_data[18 + i + 42:19 + i + 42])[0]
+        elif self.csi_tool_ver == CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_COMPACT:
+            header["rssi"] = struct.unpack("b", payload_data[2:3])[0]
+            gain_type_mask, flags = struct.unpack("BB", payload_data[18:20])
+            header["gainTypeMask"] = gain_type_mask
+            header["nGainTypes"] = bin(gain_type_mask & 0x3f).count("1")
+            header["flags"] = flags
+            header["agcGain"] = struct.unpack("h", payload_data[20:22])[0]
+            column_name_extensions = CSIDataPcap.GAIN_RECOVERY_V2_COLUMN_NAME_EXT
+            record = 0
+            for i in range(0, 6):
+                if not gain_type_mask & (1 << i):
+                    continue
+                gains = struct.unpack("8b", payload_data[22 + record * 8:30 + record * 8])
+                for name, gain in zip(self.GAIN_RECORD_FIELDS, gains):
+                    header[name + column_name_extensions[i]] = gain
+                record += 1
+            return header
 
-        header["agcGain"] = struct.unpack("h", payload_data[66:68])[0]
+        if self.csi_tool_ver == CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_V2:
+            header["agcGain"] = struct.unpack("h", payload_data[66:68])[0]
+            header["flags"] = struct.unpack("H", payload_data[68:70])[0]
 
         return header
 
@@ -121,7 +217,8 @@ class CSIDataPcap:
         CSIDataPcapReader.CSI_TOOL_VERSION_INCLUDE_RSSI: 16,
         CSIDataPcapReader.CSI_TOOL_VERSION_TEST_PHYSTATUS: 17,
         CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY: 19,
-        CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_V2: 29
+        CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_V2: 29,
+        CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_COMPACT: 17
     }
 
     PCAP_HEADER_DTYPE = np.dtype([
@@ -150,75 +247,171 @@ class CSIDataPcap:
 
     GAIN_RECOVERY_V2_COLUMN_NAME_EXT = ["_1", "_2", "_3", "_4", "_9", "_10"]
 
-    def __init__(self, filename, bandwidth, csi_tool_ver=CSIDataPcapReader.CSI_TOOL_VERSION_ORIGINAL):
+    def __init__(self, filename, bandwidth=None, csi_tool_ver=CSIDataPcapReader.CSI_TOOL_VERSION_ORIGINAL):
+        # bandwidth and csi_tool_ver None are detected per frame, captures may then mix bandwidths and versions
         self.bandwidth = bandwidth
         self.csi_tool_ver = csi_tool_ver
-        self.nfft = int(bandwidth * 3.2)
-        self.data = open(filename, "rb").read()
+        self.data = self.split_batches(open(filename, "rb").read())
         self.header = np.frombuffer(self.data[:self.PCAP_HEADER_DTYPE.itemsize], dtype=self.PCAP_HEADER_DTYPE)
         self.frames = []
-        self.sc_count = self.SUBCARRIER_COUNT_BY_BW[bandwidth]
-        self.df = pd.DataFrame(columns=np.arange(self.sc_count))
+        if bandwidth is None:
+            # tone columns are added by the first frame of every bandwidth
+            self.df = pd.DataFrame()
+        else:
+            self.df = pd.DataFrame(columns=np.arange(self.SUBCARRIER_COUNT_BY_BW[bandwidth]))
+
+    CSI_FRAME_MAGIC_BATCH = 0x1113
+
+    CSI_FLAG_TONE_SELECT = 0x01
+    CSI_FLAG_PACKED14 = 0x02
+    CSI_FLAG_EXT_HEADER = 0x04
+    # set by the native decoder for frames of older tool versions, see csi_decode.h
+    CSI_FLAG_LEGACY = 0x8000
+    CSI_FLAG_LEGACY_PHYSTATUS = 0x4000
+    CSI_SWEEP_NONE = 0xffff
+    TONE_DESC_WORDS = 9
+
+    def split_batches(self, data):
+        # replaces every udp frame carrying a batch of csi frames with one record per csi frame
+        record_header_size = CSIDataPcapFrame.FRAME_HEADER_DTYPE.itemsize
+        udp_header_length = CSIDataPcapFrame.UDP_HEADER_LENGTH
+        chunks = [data[:self.PCAP_HEADER_DTYPE.itemsize]]
+        offset = self.PCAP_HEADER_DTYPE.itemsize
+        while offset + record_header_size <= len(data):
+            ts_sec, ts_usec, incl_len, orig_len = struct.unpack_from("IIII", data, offset)
+            payload = data[offset + record_header_size:offset + record_header_size + incl_len]
+            offset += record_header_size + incl_len
+            if incl_len < udp_header_length + 4 \
+                    or struct.unpack_from("H", payload, udp_header_length)[0] != self.CSI_FRAME_MAGIC_BATCH:
+                chunks.append(struct.pack("IIII", ts_sec, ts_usec, incl_len, orig_len))
+                chunks.append(payload)
+                continue
+            n_records = struct.unpack_from("H", payload, udp_header_length + 2)[0]
+            pos = udp_header_length + 4
+            for _ in range(n_records):
+                record_length = struct.unpack_from("H", payload, pos)[0]
+                record = payload[:udp_header_length] + payload[pos + 2:pos + 2 + record_length]
+                chunks.append(struct.pack("IIII", ts_sec, ts_usec, len(record), len(record)))
+                chunks.append(record)
+                pos += 2 + record_length
+        return b"".join(chunks)
 
     def read(self):
-        if self.csi_tool_ver == CSIDataPcapReader.CSI_TOOL_VERSION_TEST_PHYSTATUS:
-            rxpower = list()
-            lnagn = list()
-            pgagn = list()
-            foff = list()
+        # PhyRxStatus_2 of every frame, the fields are extracted for all frames at once
+        phy_rx_status_2 = list()
+        rows = list()
 
         offset = self.PCAP_HEADER_DTYPE.itemsize
         while offset < len(self.data):
-            nextFrame = CSIDataPcapFrame(self.data, offset, self.csi_tool_ver)
+            nextFrame = CSIDataPcapFrame(self.data, offset, self.csi_tool_ver, self.bandwidth)
             offset = nextFrame.offset
+            csi_tool_ver = nextFrame.csi_tool_ver
+            if csi_tool_ver is None or nextFrame.bandwidth is None:
+                print("Skipped frame with unknown format.")
+                continue
+            sc_count = self.SUBCARRIER_COUNT_BY_BW[nextFrame.bandwidth]
 
-            header_offset = self.HEADER_OFFSET_BY_CSI_TOOL_VER[self.csi_tool_ver]
-            if nextFrame.header["orig_len"][0] - (header_offset - 1) * 4 != self.nfft * 4:
+            header_offset = self.HEADER_OFFSET_BY_CSI_TOOL_VER[csi_tool_ver]
+            if csi_tool_ver == CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_COMPACT:
+                # each selected gain type adds 8 bytes to the header
+                header_offset += nextFrame.payload_header["nGainTypes"] * 2
+            if nextFrame.payload_header.get("flags", 0) & self.CSI_FLAG_EXT_HEADER:
+                # receive status of the frame, struct csi_ext_header
+                ext = nextFrame.payload[header_offset - 1:header_offset - 1 + 7]
+                ext_len = int((ext[0] >> 8) & 0xff)
+                nextFrame.payload_header["rxTsfTime"] = int(ext[0] >> 16)
+                nextFrame.payload_header["tsfL"] = int(ext[1])
+                for i in range(3):
+                    nextFrame.payload_header["phyRxStatus_%d" % (2 * i)] = int(ext[2 + i] & 0xffff)
+                    nextFrame.payload_header["phyRxStatus_%d" % (2 * i + 1)] = int(ext[2 + i] >> 16)
+                # version 2 adds the wraps of tsf_l
+                tsf_h = int(ext[5]) if ext_len >= 24 else 0
+                nextFrame.payload_header["tsf"] = (tsf_h << 32) | int(ext[1])
+                # version 3 adds the step of the firmware gain sweep (ioctl 512)
+                nextFrame.payload_header["sweepStep"] = int(ext[6] & 0xffff) if ext_len >= 28 else self.CSI_SWEEP_NONE
+                header_offset += ext_len // 4
+            tone_count = sc_count
+            tone_indices = np.arange(sc_count)
+            if nextFrame.payload_header.get("flags", 0) & self.CSI_FLAG_TONE_SELECT:
+                # only the tones marked in the tone descriptor are sent
+                desc = nextFrame.payload[header_offset - 1:header_offset - 1 + self.TONE_DESC_WORDS]
+                tone_count = int(desc[0] >> 16)
+                tone_mask = np.unpackbits(desc[1:].astype("<u4").view(np.uint8), bitorder="little")
+                tone_indices = np.flatnonzero(tone_mask[:sc_count])[:tone_count]
+                header_offset += self.TONE_DESC_WORDS
+            packed = nextFrame.payload_header.get("flags", 0) & self.CSI_FLAG_PACKED14
+            if packed:
+                csi_size = (((tone_count * 7 + 1) // 2) + 3) & ~3
+            else:
+                csi_size = tone_count * 4
+            if nextFrame.header["orig_len"][0] - (header_offset - 1) * 4 != csi_size:
                 print("Skipped frame with incorrect size.")
+                continue
+            self.frames.append(nextFrame)
+
+            if packed:
+                packed_csi = nextFrame.payload[header_offset - 1:]
+                csi_data = unpack_csi14(packed_csi.view(np.uint8), len(tone_indices))
+            else:
+                csi_data = nextFrame.payload[-len(tone_indices):]
+                csi_data.dtype = np.int16
+                csi_data = csi_data.reshape(-1, 2)
+            csi = np.zeros((sc_count,), dtype=complex)
+            csi[tone_indices[:len(csi_data)]] = csi_data[:, 0] + 1j * csi_data[:, 1]
+
+            if csi_tool_ver == CSIDataPcapReader.CSI_TOOL_VERSION_TEST_PHYSTATUS:
+                phy_rx_status_2.append(int(csi_data[29][0]) & 0xffff)
             else:
-                self.frames.append(nextFrame)
-
-            csi_data = nextFrame.payload[-self.sc_count:]
-            csi_data.dtype = np.int16
-            csi = np.zeros((self.sc_count,), dtype=np.complex)
-            csi_data = csi_data.reshape(-1, 2)
-            i = 0
-            for x in csi_data:
-                csi[i] = np.complex(x[0], x[1])
-                i += 1
-
-            if self.csi_tool_ver == CSIDataPcapReader.CSI_TOOL_VERSION_TEST_PHYSTATUS:
-                phy_rx_status_2_data = csi_data[29][0]
-                rxpower.append((phy_rx_status_2_data & self.PRXS2_ACPHY_RXPWR_ANT0_MASK)
-                               >> self.PRXS2_ACPHY_RXPWR_ANT0_SHIFT)
-                lnagn.append((phy_rx_status_2_data & self.PRXS2_LNAGN_MASK) >> self.PRXS2_LNAGN_SHIFT)
-                pgagn.append((phy_rx_status_2_data & self.PRXS2_PGAGN_MASK) >> self.PRXS2_PGAGN_SHIFT)
-                foff.append(phy_rx_status_2_data & self.PRXS2_FOFF_MASK)
-
-            self.df = self.df.append(pd.Series(csi), ignore_index=True)
-
-        if self.csi_tool_ver == CSIDataPcapReader.CSI_TOOL_VERSION_INCLUDE_RSSI \
-                or self.csi_tool_ver == CSIDataPcapReader.CSI_TOOL_VERSION_TEST_PHYSTATUS \
-                or self.csi_tool_ver == CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY \
-                or self.csi_tool_ver == CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_V2:
-            rssi = [f.payload_header["rssi"] for f in self.frames]
+                phy_rx_status_2.append(-1)
+
+            rows.append(csi)
+
+        # rows of different bandwidths are padded with nan
+        if rows:
+            self.df = pd.concat([self.df, pd.DataFrame(rows)], ignore_index=True)
+
+        # with detected versions, the columns of every version in the capture are added
+        if self.csi_tool_ver is None:
+            csi_tool_vers = set(f.csi_tool_ver for f in self.frames)
+        else:
+            csi_tool_vers = {self.csi_tool_ver}
+
+        if self.csi_tool_ver is None or self.bandwidth is None:
+            self.df["csiToolVer"] = [f.csi_tool_ver for f in self.frames]
+            self.df["bandwidth"] = [f.bandwidth for f in self.frames]
+
+        ext_header_fields = ["rxTsfTime", "tsfL"] + ["phyRxStatus_%d" % i for i in range(6)] + ["sweepStep"]
+        if any("tsfL" in f.payload_header for f in self.frames):
+            for name in ext_header_fields:
+                self.df[name] = [f.payload_header.get(name) for f in self.frames]
+            # the receive time taken by the chip is the first column, pcap timestamps include the host jitter
+            self.df.insert(0, "tsf", pd.array([f.payload_header.get("tsf") for f in self.frames], dtype="UInt64"))
+
+        if csi_tool_vers - {CSIDataPcapReader.CSI_TOOL_VERSION_ORIGINAL}:
+            rssi = [f.payload_header.get("rssi") for f in self.frames]
             self.df["RSSI"] = rssi
-        if self.csi_tool_ver == CSIDataPcapReader.CSI_TOOL_VERSION_TEST_PHYSTATUS:
-            self.df["rxpower"] = rxpower
-            self.df["lnagn"] = lnagn
-            self.df["pgagn"] = pgagn
-            self.df["foff"] = foff
-
-        if self.csi_tool_ver == CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY:
-            elna = [f.payload_header["elna"] for f in self.frames]
-            lna1 = [f.payload_header["lna1"] for f in self.frames]
-            lna2 = [f.payload_header["lna2"] for f in self.frames]
-            mix = [f.payload_header["mix"] for f in self.frames]
-            lpf0 = [f.payload_header["lpf0"] for f in self.frames]
-            lpf1 = [f.payload_header["lpf1"] for f in self.frames]
-            dvga = [f.payload_header["dvga"] for f in self.frames]
-            tr_loss = [f.payload_header["trLoss"] for f in self.frames]
-            agc_gain = [f.payload_header["agcGain"] for f in self.frames]
+        if CSIDataPcapReader.CSI_TOOL_VERSION_TEST_PHYSTATUS in csi_tool_vers:
+            words = np.array(phy_rx_status_2, dtype=np.int32)
+            fields = {
+                "rxpower": (words & self.PRXS2_ACPHY_RXPWR_ANT0_MASK) >> self.PRXS2_ACPHY_RXPWR_ANT0_SHIFT,
+                "lnagn": (words & self.PRXS2_LNAGN_MASK) >> self.PRXS2_LNAGN_SHIFT,
+                "pgagn": (words & self.PRXS2_PGAGN_MASK) >> self.PRXS2_PGAGN_SHIFT,
+                "foff": words & self.PRXS2_FOFF_MASK,
+            }
+            for name, values in fields.items():
+                # frames of other versions in a mixed capture have no phystatus
+                self.df[name] = values if np.all(words >= 0) else np.where(words >= 0, values, np.nan)
+
+        if CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY in csi_tool_vers:
+            elna = [f.payload_header.get("elna") for f in self.frames]
+            lna1 = [f.payload_header.get("lna1") for f in self.frames]
+            lna2 = [f.payload_header.get("lna2") for f in self.frames]
+            mix = [f.payload_header.get("mix") for f in self.frames]
+            lpf0 = [f.payload_header.get("lpf0") for f in self.frames]
+            lpf1 = [f.payload_header.get("lpf1") for f in self.frames]
+            dvga = [f.payload_header.get("dvga") for f in self.frames]
+            tr_loss = [f.payload_header.get("trLoss") for f in self.frames]
+            agc_gain = [f.payload_header.get("agcGain") for f in self.frames]
 
             self.df["elna"] = elna
             self.df["lna1"] = lna1
@@ -230,16 +423,16 @@ class CSIDataPcap:
             self.df["trLoss"] = tr_loss
             self.df["agcGain"] = agc_gain
 
-        if self.csi_tool_ver == CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_V2:
+        if CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_V2 in csi_tool_vers:
             for name_ext in self.GAIN_RECOVERY_V2_COLUMN_NAME_EXT:
-                elna = [f.payload_header["elna" + name_ext] for f in self.frames]
-                lna1 = [f.payload_header["lna1" + name_ext] for f in self.frames]
-                lna2 = [f.payload_header["lna2" + name_ext] for f in self.frames]
-                mix = [f.payload_header["mix" + name_ext] for f in self.frames]
-                lpf0 = [f.payload_header["lpf0" + name_ext] for f in self.frames]
-                lpf1 = [f.payload_header["lpf1" + name_ext] for f in self.frames]
-                dvga = [f.payload_header["dvga" + name_ext] for f in self.frames]
-                tr_loss = [f.payload_header["trLoss" + name_ext] for f in self.frames]
+                elna = [f.payload_header.get("elna" + name_ext) for f in self.frames]
+                lna1 = [f.payload_header.get("lna1" + name_ext) for f in self.frames]
+                lna2 = [f.payload_header.get("lna2" + name_ext) for f in self.frames]
+                mix = [f.payload_header.get("mix" + name_ext) for f in self.frames]
+                lpf0 = [f.payload_header.get("lpf0" + name_ext) for f in self.frames]
+                lpf1 = [f.payload_header.get("lpf1" + name_ext) for f in self.frames]
+                dvga = [f.payload_header.get("dvga" + name_ext) for f in self.frames]
+                tr_loss = [f.payload_header.get("trLoss" + name_ext) for f in self.frames]
 
                 self.df["elna" + name_ext] = elna
                 self.df["lna1" + name_ext] = lna1
@@ -250,7 +443,611 @@ class CSIDataPcap:
                 self.df["dvga" + name_ext] = dvga
                 self.df["trLoss" + name_ext] = tr_loss
 
-            agc_gain = [f.payload_header["agcGain"] for f in self.frames]
+            agc_gain = [f.payload_header.get("agcGain") for f in self.frames]
+            self.df["agcGain"] = agc_gain
+
+        if CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_COMPACT in csi_tool_vers:
+            # only gain types selected in the gain type mask are present
+            for name_ext in self.GAIN_RECOVERY_V2_COLUMN_NAME_EXT:
+                for name in CSIDataPcapFrame.GAIN_RECORD_FIELDS:
+                    if any(name + name_ext in f.payload_header for f in self.frames):
+                        self.df[name + name_ext] = [f.payload_header.get(name + name_ext) for f in self.frames]
+
+            agc_gain = [f.payload_header.get("agcGain") for f in self.frames]
             self.df["agcGain"] = agc_gain
 
         return self.df
+
+
+class CSIColumns(ctypes.Structure):
+    # mirrors struct csi_columns in csi_decode.h
+    _fields_ = [(name, ctypes.c_void_p) for name in
+                ["ts_usec", "src_mac", "seq_cnt", "fc", "csiconf", "chanspec", "chip", "rssi",
+                 "gain_type_mask", "gains", "agc_gain", "flags", "n_tones", "csi", "phystatus", "rx_tsf_time", "tsf",
+                 "sweep_step"]] \
+        + [("max_tones", ctypes.c_size_t)]
+
+
+class CSIGainCalibration(ctypes.Structure):
+    # mirrors struct csi_gain_calibration in csi_features.h
+    _fields_ = [("weight", ctypes.c_float * 8), ("offset", ctypes.c_float * 8)]
+
+
+class CSITxStats(ctypes.Structure):
+    # mirrors struct csi_tx_stats in csi_demux.h
+    _fields_ = [("mac", ctypes.c_uint8 * 6), ("last_seq", ctypes.c_uint16)] \
+        + [(name, ctypes.c_uint64) for name in
+           ["frames", "duplicates", "lost", "restarts", "first_ts_usec", "last_ts_usec"]]
+
+
+_csi_decode_libraries = {}
+
+
+def load_csi_decode_library(library=None):
+    """Loads libcsidecode.so (see Makefile), by default from the directory of this script."""
+    if library is None:
+        library = os.path.join(os.path.dirname(os.path.abspath(__file__)), "libcsidecode.so")
+    if library in _csi_decode_libraries:
+        return _csi_decode_libraries[library]
+    lib = ctypes.CDLL(library)
+    lib.csi_pcap_open.restype = ctypes.c_void_p
+    lib.csi_pcap_open.argtypes = [ctypes.c_char_p]
+    lib.csi_pcap_close.argtypes = [ctypes.c_void_p]
+    lib.csi_pcap_count_frames.restype = ctypes.c_size_t
+    lib.csi_pcap_count_frames.argtypes = [ctypes.c_void_p]
+    lib.csi_pcap_decode.restype = ctypes.c_size_t
+    lib.csi_pcap_decode.argtypes = [ctypes.c_void_p, ctypes.POINTER(CSIColumns), ctypes.c_size_t]
+    lib.csi_pcap_rewind.argtypes = [ctypes.c_void_p]
+    lib.csi_stream_open.restype = ctypes.c_void_p
+    lib.csi_stream_open.argtypes = [ctypes.c_char_p]
+    lib.csi_stream_close.argtypes = [ctypes.c_void_p]
+    lib.csi_stream_poll.restype = ctypes.c_size_t
+    lib.csi_stream_poll.argtypes = [ctypes.c_void_p, ctypes.POINTER(CSIColumns), ctypes.c_size_t]
+    lib.csi_stream_offset.restype = ctypes.c_uint64
+    lib.csi_stream_offset.argtypes = [ctypes.c_void_p]
+    lib.csi_stream_failed.argtypes = [ctypes.c_void_p]
+    lib.csi_features.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_size_t] + [ctypes.c_void_p] * 4
+    lib.csi_gain_calibration_default.argtypes = [ctypes.POINTER(CSIGainCalibration)]
+    lib.csi_gain_normalize.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+                                       ctypes.c_size_t, ctypes.c_int, ctypes.POINTER(CSIGainCalibration),
+                                       ctypes.c_void_p, ctypes.c_void_p]
+    lib.csi_features_isa.restype = ctypes.c_char_p
+    lib.csi_job_open.restype = ctypes.c_void_p
+    lib.csi_job_open.argtypes = [ctypes.POINTER(ctypes.c_char_p), ctypes.c_size_t, ctypes.c_size_t]
+    lib.csi_job_close.argtypes = [ctypes.c_void_p]
+    lib.csi_job_count_frames.restype = ctypes.c_size_t
+    lib.csi_job_count_frames.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.csi_job_decode.restype = ctypes.c_size_t
+    lib.csi_job_decode.argtypes = [ctypes.c_void_p, ctypes.POINTER(CSIColumns), ctypes.c_size_t, ctypes.c_void_p,
+                                   ctypes.c_int]
+    lib.csi_archive_from_pcap.restype = ctypes.c_long
+    lib.csi_archive_from_pcap.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_uint16, ctypes.c_uint32]
+    lib.csi_demux_new.restype = ctypes.c_void_p
+    lib.csi_demux_free.argtypes = [ctypes.c_void_p]
+    lib.csi_demux_process.restype = ctypes.c_size_t
+    lib.csi_demux_process.argtypes = [ctypes.c_void_p, ctypes.POINTER(CSIColumns), ctypes.c_size_t, ctypes.c_void_p]
+    lib.csi_demux_failed.argtypes = [ctypes.c_void_p]
+    lib.csi_demux_n_streams.restype = ctypes.c_uint32
+    lib.csi_demux_n_streams.argtypes = [ctypes.c_void_p]
+    lib.csi_demux_stats.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.POINTER(CSITxStats)]
+    lib.csi_phystatus_extract.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_void_p,
+                                          ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_void_p),
+                                          ctypes.c_void_p]
+    lib.csi_demux_order.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_uint32, ctypes.c_void_p,
+                                    ctypes.c_void_p]
+    _csi_decode_libraries[library] = lib
+    return lib
+
+
+def csi_features(csi, library=None, outputs=("csi", "mag", "db", "phase")):
+    """Computes complex csi, magnitude, power in dB and unwrapped phase of int16 (real, imag) csi.
+
+    csi has the shape (frames, tones, 2), e.g. columns["csi_raw"] of CSIDataPcapNativeReader.read.
+    Only the features named in outputs are computed, outputs=("csi",) just converts to complex.
+    Returns a dict of arrays with the shape (frames, tones).
+    """
+    lib = load_csi_decode_library(library)
+    csi = np.ascontiguousarray(csi, dtype=np.int16)
+    n_frames, n_tones = csi.shape[:2]
+    dtypes = {"csi": np.complex64, "mag": np.float32, "db": np.float32, "phase": np.float32}
+    features = {name: np.empty((n_frames, n_tones), dtype=dtypes[name]) for name in outputs}
+    lib.csi_features(csi.ctypes.data, n_frames, n_tones,
+                     *[features[name].ctypes.data if name in features else None for name in dtypes])
+    return features
+
+
+def normalize_csi_gain(columns, gain_type=10, offsets=None, weights=None, library=None):
+    """Scales the csi of every frame to the absolute received amplitude by its total rx gain.
+
+    columns is the dict returned by CSIDataPcapNativeReader.read. The gain of a stage in dB is
+    weight * gain + offset, offsets and weights are dicts by stage name (see GAIN_RECORD_FIELDS).
+    By default all stages count with weight 1 and trLoss with -1.
+    Returns the normalized csi (frames, tones) and the total gain in dB of each frame. Frames that do not
+    carry gain_type, e.g. compact frames of other gain types, are NaN in both.
+    """
+    lib = load_csi_decode_library(library)
+    cal = CSIGainCalibration()
+    lib.csi_gain_calibration_default(ctypes.byref(cal))
+    for s, name in enumerate(CSIDataPcapFrame.GAIN_RECORD_FIELDS):
+        if offsets and name in offsets:
+            cal.offset[s] = offsets[name]
+        if weights and name in weights:
+            cal.weight[s] = weights[name]
+
+    csi = np.ascontiguousarray(columns["csi_raw"], dtype=np.int16)
+    gains = np.ascontiguousarray(columns["gains"], dtype=np.int8)
+    gain_type_mask = np.ascontiguousarray(columns["gain_type_mask"], dtype=np.uint8)
+    n_frames, n_tones = csi.shape[:2]
+    gain_type_index = CSIDataPcap.GAIN_RECOVERY_V2_COLUMN_NAME_EXT.index("_%d" % gain_type)
+    normalized = np.empty((n_frames, n_tones), dtype=np.complex64)
+    gain_db = np.empty(n_frames, dtype=np.float32)
+    lib.csi_gain_normalize(csi.ctypes.data, gains.ctypes.data, gain_type_mask.ctypes.data, n_frames, n_tones,
+                           gain_type_index, ctypes.byref(cal), normalized.ctypes.data, gain_db.ctypes.data)
+    return normalized, gain_db
+
+
+# fields of enum csi_phystatus_field in csi_phystatus.h
+PHY_RX_STATUS_FIELDS = ["ft", "clip", "unsrate", "band5g", "lcrs", "shorth", "plcpfv", "plcphcf", "mfcrs", "accrs",
+                        "subband", "coremask", "antcfg", "rxpwr_ant0", "rxpwr_ant1", "rxpwr_ant2", "rxpwr_ant3",
+                        "cfo", "ffo", "ar", "lnagn", "pgagn", "foff"]
+
+
+def phystatus_columns(columns, fields=None, library=None):
+    """Extracts the PhyRxStatus_0..5 bitfields (see d11.h) from the header extension or the csi of every frame.
+
+    columns is the dict returned by CSIDataPcapNativeReader.read, fields a list of names from PHY_RX_STATUS_FIELDS
+    (all by default). Returns a dict of int16 arrays, "phystatus_valid" is False for frames with tone selection
+    or packed csi and without header extension, which carry no phystatus. Of the older tool versions only
+    CSI_TOOL_VERSION_TEST_PHYSTATUS carries phystatus (flag CSI_FLAG_LEGACY_PHYSTATUS).
+    """
+    lib = load_csi_decode_library(library)
+    csi = np.ascontiguousarray(columns["csi_raw"], dtype=np.int16)
+    chanspec = np.ascontiguousarray(columns["chanspec"], dtype=np.uint16)
+    flags = np.ascontiguousarray(columns["flags"], dtype=np.uint16)
+    phystatus = np.ascontiguousarray(columns["phystatus"], dtype=np.uint16)
+    n, max_tones = csi.shape[:2]
+    if fields is None:
+        fields = PHY_RX_STATUS_FIELDS
+    result = {name: np.zeros(n, dtype=np.int16) for name in fields}
+    pointers = (ctypes.c_void_p * len(PHY_RX_STATUS_FIELDS))(
+        *[result[name].ctypes.data if name in result else None for name in PHY_RX_STATUS_FIELDS])
+    valid = np.zeros(n, dtype=np.uint8)
+    lib.csi_phystatus_extract(csi.ctypes.data, max_tones, chanspec.ctypes.data, flags.ctypes.data,
+                              phystatus.ctypes.data, n, pointers, valid.ctypes.data)
+    result["phystatus_valid"] = valid.astype(bool)
+    return result
+
+
+class CSIDataPcapNativeReader:
+    """Decodes a pcap with libcsidecode.so (see Makefile) without copying the file into python.
+
+    Handles full, compact and batched frames as well as tone selection and packed csi in one pass. Frames of older
+    tool versions are marked with CSIDataPcap.CSI_FLAG_LEGACY in columns["flags"].
+    """
+    CSI_N_GAIN_TYPES = 6
+    CSI_N_GAIN_STAGES = 8
+
+    COLUMN_DTYPES = {
+        "ts_usec": np.uint64,
+        "seq_cnt": np.uint16,
+        "fc": np.uint8,
+        "csiconf": np.uint16,
+        "chanspec": np.uint16,
+        "chip": np.uint16,
+        "rssi": np.int8,
+        "gain_type_mask": np.uint8,
+        "agc_gain": np.int16,
+        "flags": np.uint16,
+        "n_tones": np.uint16,
+        "rx_tsf_time": np.uint16,
+        "tsf": np.uint64,
+        "sweep_step": np.uint16,
+    }
+    CSI_N_PHYSTATUS = 6
+
+    def __init__(self, pcap_file, max_tones=256, library=None):
+        self.library = library
+        self.lib = load_csi_decode_library(library)
+        self.pcap_file = pcap_file
+        self.max_tones = max_tones
+
+    def read(self, demux=None):
+        """Returns a dict of numpy arrays with one row per csi frame.
+
+        columns["csi"] is complex64 with the tones at their fft index, columns["csi_raw"] the int16 (real, imag) pairs.
+        With a CSIDemux duplicates are dropped in the same pass, columns["stream_id"] is the transmitter of every frame.
+        columns["tsf"] is the 64 bit receive time in us taken by the chip for frames with the header extension
+        (ioctl 511), it is more precise than the pcap timestamp columns["ts_usec"].
+        """
+        pcap = self.lib.csi_pcap_open(self.pcap_file.encode())
+        if not pcap:
+            raise IOError("cannot open %s" % self.pcap_file)
+        try:
+            n = self.lib.csi_pcap_count_frames(pcap)
+            columns, cols = self.allocate_columns(n, self.max_tones)
+            n = self.lib.csi_pcap_decode(pcap, ctypes.byref(cols), n)
+        finally:
+            self.lib.csi_pcap_close(pcap)
+        if demux is not None:
+            n = demux.process(columns, cols, n)
+        columns = {name: array[:n] for name, array in columns.items()}
+        columns["csi_raw"] = columns["csi"]
+        columns["csi"] = csi_features(columns["csi_raw"], self.library, ("csi",))["csi"]
+        return columns
+
+    @classmethod
+    def allocate_columns(cls, n, max_tones):
+        """Returns a dict of zeroed numpy columns for n frames and the CSIColumns pointing to them."""
+        columns = {name: np.zeros(n, dtype=dtype) for name, dtype in cls.COLUMN_DTYPES.items()}
+        columns["src_mac"] = np.zeros((n, 6), dtype=np.uint8)
+        columns["gains"] = np.zeros((n, cls.CSI_N_GAIN_STAGES, cls.CSI_N_GAIN_TYPES), dtype=np.int8)
+        columns["csi"] = np.zeros((n, max_tones, 2), dtype=np.int16)
+        columns["phystatus"] = np.zeros((n, cls.CSI_N_PHYSTATUS), dtype=np.uint16)
+        cols = CSIColumns(max_tones=max_tones, **{name: array.ctypes.data for name, array in columns.items()})
+        return columns, cols
+
+    def read_by_transmitter(self):
+        """Returns a dict of column dicts like read by source mac ("aa:bb:cc:dd:ee:ff") without duplicates and
+        the CSIDemux with the loss statistics of every transmitter."""
+        demux = CSIDemux(self.library)
+        return demux.split(self.read(demux)), demux
+
+    def get_data_frame(self):
+        columns = self.read()
+        df = pd.DataFrame(columns["csi"])
+        if np.any(columns["flags"] & CSIDataPcap.CSI_FLAG_EXT_HEADER):
+            # the receive time taken by the chip is the first column, pcap timestamps include the host jitter
+            df.insert(0, "tsf", pd.array(columns["tsf"], dtype="UInt64"))
+            df.loc[(columns["flags"] & CSIDataPcap.CSI_FLAG_EXT_HEADER) == 0, "tsf"] = pd.NA
+        if np.any(columns["sweep_step"] != CSIDataPcap.CSI_SWEEP_NONE):
+            # frames received while no gain sweep ran keep CSI_SWEEP_NONE
+            df["sweepStep"] = columns["sweep_step"]
+        df["RSSI"] = columns["rssi"]
+        for t, name_ext in enumerate(CSIDataPcap.GAIN_RECOVERY_V2_COLUMN_NAME_EXT):
+            if not np.any(columns["gain_type_mask"] & (1 << t)):
+                continue
+            for s, name in enumerate(CSIDataPcapFrame.GAIN_RECORD_FIELDS):
+                df[name + name_ext] = columns["gains"][:, s, t]
+        df["agcGain"] = columns["agc_gain"]
+        return df
+
+
+class CSIDataPcapStream:
+    """Follows a pcap or pcapng file that is still being written, e.g. by tcpdump -U -w.
+
+    Every batch is a dict of numpy columns like CSIDataPcapNativeReader.read with at most batch_size frames.
+    Memory use is bounded by batch_size, the file is read incrementally and never parsed twice.
+
+        stream = rp.CSIDataPcapStream(SOURCE_FILE)
+        for columns in stream:
+            ...
+    """
+
+    def __init__(self, pcap_file, batch_size=64, max_tones=256, poll_interval=0.005, demux=None, library=None):
+        self.library = library
+        self.demux = demux
+        self.lib = load_csi_decode_library(library)
+        self.stream = self.lib.csi_stream_open(pcap_file.encode())
+        if not self.stream:
+            raise IOError("cannot open %s" % pcap_file)
+        self.batch_size = batch_size
+        self.max_tones = max_tones
+        self.poll_interval = poll_interval
+        self.columns, self.cols = CSIDataPcapNativeReader.allocate_columns(batch_size, max_tones)
+
+    def close(self):
+        if self.stream:
+            self.lib.csi_stream_close(self.stream)
+            self.stream = None
+
+    def __del__(self):
+        self.close()
+
+    def poll(self):
+        """Returns the frames written since the last call (at most batch_size) or None."""
+        if self.lib.csi_stream_failed(self.stream):
+            raise IOError("corrupt capture at offset %d" % self.lib.csi_stream_offset(self.stream))
+        n = self.lib.csi_stream_poll(self.stream, ctypes.byref(self.cols), self.batch_size)
+        if n == 0:
+            return None
+        if self.demux is not None:
+            n = self.demux.process(self.columns, self.cols, n)
+        columns = {name: array[:n].copy() for name, array in self.columns.items()}
+        columns["csi_raw"] = columns["csi"]
+        columns["csi"] = csi_features(columns["csi_raw"], self.library, ("csi",))["csi"]
+        return columns
+
+    def __iter__(self):
+        while True:
+            columns = self.poll()
+            if columns is None:
+                time.sleep(self.poll_interval)
+                continue
+            yield columns
+
+    def run(self, callback, stop=None):
+        """Calls callback(columns) for every batch until stop() returns True."""
+        while stop is None or not stop():
+            columns = self.poll()
+            if columns is None:
+                time.sleep(self.poll_interval)
+                continue
+            callback(columns)
+
+
+class CSIRingReader:
+    """Reads the shared memory ring written by csicapture (see csi_ring.h).
+
+        reader = rp.CSIRingReader("/csi")
+        columns = reader.poll()     # frames written since the last call or None
+
+    Frames that were overwritten before they were read are counted in self.lost. With from_start=True the
+    first poll also returns the frames that are already in the ring, e.g. after csicapture -r has finished.
+    """
+    CSI_RING_MAGIC = 0x52495343
+    CSI_RING_VERSION = 3
+    RING_HEADER_DTYPE = np.dtype([
+        ("magic", np.uint32),
+        ("version", np.uint16),
+        ("max_tones", np.uint16),
+        ("n_slots", np.uint32),
+        ("pad", np.uint32),
+        ("write_begin", np.uint64),
+        ("write_count", np.uint64),
+        ("column_offset", np.uint64, 18),
+    ])
+    # order of enum csi_ring_column
+    COLUMNS = ["ts_usec", "src_mac", "seq_cnt", "fc", "csiconf", "chanspec", "chip", "rssi",
+               "gain_type_mask", "gains", "agc_gain", "flags", "n_tones", "csi", "phystatus", "rx_tsf_time", "tsf",
+               "sweep_step"]
+
+    def __init__(self, name="/csi", from_start=False):
+        import mmap
+        with open("/dev/shm/" + name.lstrip("/"), "rb") as f:
+            self.shm = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+        self.header = np.frombuffer(self.shm, dtype=self.RING_HEADER_DTYPE, count=1)
+        if self.header["magic"][0] != self.CSI_RING_MAGIC or self.header["version"][0] != self.CSI_RING_VERSION:
+            raise IOError("%s is no csi ring of version %d" % (name, self.CSI_RING_VERSION))
+        n_slots = int(self.header["n_slots"][0])
+        max_tones = int(self.header["max_tones"][0])
+        shapes = {
+            "src_mac": (n_slots, 6),
+            "gains": (n_slots, CSIDataPcapNativeReader.CSI_N_GAIN_STAGES, CSIDataPcapNativeReader.CSI_N_GAIN_TYPES),
+            "csi": (n_slots, max_tones, 2),
+            "phystatus": (n_slots, CSIDataPcapNativeReader.CSI_N_PHYSTATUS),
+        }
+        dtypes = dict(CSIDataPcapNativeReader.COLUMN_DTYPES, src_mac=np.uint8, gains=np.int8, csi=np.int16,
+                      phystatus=np.uint16)
+        self.ring = {}
+        for name, offset in zip(self.COLUMNS, self.header["column_offset"][0]):
+            shape = shapes.get(name, (n_slots,))
+            self.ring[name] = np.frombuffer(self.shm, dtype=dtypes[name], count=int(np.prod(shape)),
+                                            offset=int(offset)).reshape(shape)
+        self.n_slots = n_slots
+        self.next = 0 if from_start else int(self.header["write_count"][0])
+        self.lost = 0
+
+    def poll(self):
+        """Returns the frames written since the last call or None."""
+        write_count = int(self.header["write_count"][0])
+        start = max(self.next, write_count - self.n_slots)
+        if start >= write_count:
+            return None
+        slots = np.arange(start, write_count) % self.n_slots
+        columns = {name: array[slots] for name, array in self.ring.items()}
+        # frames that the writer may have overwritten while they were copied are dropped
+        valid_from = max(start, int(self.header["write_begin"][0]) - self.n_slots)
+        self.lost += valid_from - self.next
+        self.next = write_count
+        if valid_from >= write_count:
+            return None
+        columns = {name: array[valid_from - start:] for name, array in columns.items()}
+        columns["csi_raw"] = columns["csi"]
+        columns["csi"] = csi_features(columns["csi_raw"], outputs=("csi",))["csi"]
+        return columns
+
+
+class CSIDemux:
+    """Splits decoded frames by transmitter (source mac) and drops duplicates and retries (see csi_demux.h).
+
+    The state is kept across calls, so the batches of a CSIDataPcapStream can be passed one by one:
+
+        demux = rp.CSIDemux()
+        for columns in rp.CSIDataPcapStream(SOURCE_FILE, demux=demux):
+            for mac, frames in demux.split(columns).items():
+                ...
+        print(demux.stats())
+    """
+
+    def __init__(self, library=None):
+        self.lib = load_csi_decode_library(library)
+        self.demux = self.lib.csi_demux_new()
+        if not self.demux:
+            raise MemoryError()
+
+    def close(self):
+        if self.demux:
+            self.lib.csi_demux_free(self.demux)
+            self.demux = None
+
+    def __del__(self):
+        self.close()
+
+    def process(self, columns, cols, n):
+        """Compacts the first n frames of columns (allocated by CSIDataPcapNativeReader.allocate_columns) in place
+        and sets columns["stream_id"], returns the number of remaining frames."""
+        stream_id = np.zeros(n, dtype=np.uint32)
+        n = self.lib.csi_demux_process(self.demux, ctypes.byref(cols), n, stream_id.ctypes.data)
+        if self.lib.csi_demux_failed(self.demux):
+            raise MemoryError("cannot add a transmitter to the demux")
+        columns["stream_id"] = stream_id
+        return n
+
+    def split(self, columns):
+        """Returns a dict of column dicts by source mac for columns with a stream_id column."""
+        stream_id = np.ascontiguousarray(columns["stream_id"], dtype=np.uint32)
+        n_streams = self.lib.csi_demux_n_streams(self.demux)
+        order = np.zeros(len(stream_id), dtype=np.uint32)
+        start = np.zeros(n_streams + 1, dtype=np.uintp)
+        self.lib.csi_demux_order(stream_id.ctypes.data, len(stream_id), n_streams, order.ctypes.data,
+                                 start.ctypes.data)
+        streams = {}
+        for i in range(n_streams):
+            if start[i] == start[i + 1]:
+                continue
+            index = order[start[i]:start[i + 1]]
+            streams[self.stats(i)["mac"]] = {name: array[index] for name, array in columns.items()}
+        return streams
+
+    def stats(self, i=None):
+        """Returns the statistics of stream i or a list of the statistics of all streams."""
+        if i is None:
+            return [self.stats(i) for i in range(self.lib.csi_demux_n_streams(self.demux))]
+        s = CSITxStats()
+        if self.lib.csi_demux_stats(self.demux, i, ctypes.byref(s)) < 0:
+            raise IndexError(i)
+        stats = {name: getattr(s, name) for name, _ in CSITxStats._fields_ if name != "mac"}
+        stats["mac"] = ":".join("%02x" % b for b in s.mac)
+        return stats
+
+
+def read_pcaps_parallel(pcap_files, n_threads=None, max_tones=256, chunk_bytes=16 << 20, library=None):
+    """Decodes many pcap or pcapng files at once, large files are split into chunks of about chunk_bytes.
+
+    Returns a dict of numpy columns like CSIDataPcapNativeReader.read with the frames of all files merged in
+    timestamp order, columns["file_index"] is the index of the file in pcap_files of every frame.
+    """
+    lib = load_csi_decode_library(library)
+    if n_threads is None:
+        n_threads = os.cpu_count() or 1
+    names = (ctypes.c_char_p * len(pcap_files))(*[f.encode() for f in pcap_files])
+    job = lib.csi_job_open(names, len(pcap_files), chunk_bytes)
+    if not job:
+        raise IOError("cannot open %s" % ", ".join(pcap_files))
+    try:
+        n = lib.csi_job_count_frames(job, n_threads)
+        columns, cols = CSIDataPcapNativeReader.allocate_columns(n, max_tones)
+        columns["file_index"] = np.zeros(n, dtype=np.uint32)
+        n = lib.csi_job_decode(job, ctypes.byref(cols), n, columns["file_index"].ctypes.data, n_threads)
+    finally:
+        lib.csi_job_close(job)
+    columns = {name: array[:n] for name, array in columns.items()}
+    columns["csi_raw"] = columns["csi"]
+    columns["csi"] = csi_features(columns["csi_raw"], library, ("csi",))["csi"]
+    return columns
+
+
+def convert_pcap_to_archive(pcap_file, archive_file, max_tones=256, chunk_frames=4096, library=None):
+    """Converts a pcap or pcapng file to a csi archive (see csi_archive.h), returns the number of frames."""
+    lib = load_csi_decode_library(library)
+    n = lib.csi_archive_from_pcap(pcap_file.encode(), archive_file.encode(), max_tones, chunk_frames)
+    if n < 0:
+        raise IOError("cannot convert %s to %s" % (pcap_file, archive_file))
+    return n
+
+
+class CSIArchive:
+    """Maps a csi archive written by convert_pcap_to_archive and reads only the chunks that are needed.
+
+        archive = rp.CSIArchive(ARCHIVE_FILE)
+        columns = archive.read(ts_from=..., ts_to=..., src_mac="01:02:03:04:05:06")
+    """
+    CSI_ARCHIVE_MAGIC = 0x41495343
+    CSI_ARCHIVE_VERSION = 3
+    CHUNK_DTYPE = np.dtype([
+        ("offset", np.uint64),
+        ("ts_min", np.uint64),
+        ("ts_max", np.uint64),
+        ("n_frames", np.uint32),
+        ("column_offset", np.uint32, 18),
+        ("seq_min", np.uint16),
+        ("seq_max", np.uint16),
+        ("chanspec_min", np.uint16),
+        ("chanspec_max", np.uint16),
+        ("rssi_min", np.int8),
+        ("rssi_max", np.int8),
+        ("pad", np.uint8, 2),
+    ])
+    MAC_DTYPE = np.dtype([
+        ("mac", np.uint8, 6),
+        ("pad", np.uint8, 2),
+        ("first", np.uint32),
+        ("n_chunks", np.uint32),
+    ])
+    TRAILER_DTYPE = np.dtype([
+        ("chunk_table_offset", np.uint64),
+        ("n_chunks", np.uint32),
+        ("n_macs", np.uint32),
+        ("n_mac_chunks", np.uint32),
+        ("magic", np.uint32),
+    ])
+
+    def __init__(self, archive_file):
+        import mmap
+        with open(archive_file, "rb") as f:
+            self.data = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+        magic, version, self.max_tones = struct.unpack_from("<IHH", self.data, 0)
+        trailer = np.frombuffer(self.data, dtype=self.TRAILER_DTYPE, count=1,
+                                offset=len(self.data) - self.TRAILER_DTYPE.itemsize)[0]
+        if magic != self.CSI_ARCHIVE_MAGIC or trailer["magic"] != self.CSI_ARCHIVE_MAGIC \
+                or version != self.CSI_ARCHIVE_VERSION:
+            raise IOError("%s is no csi archive of version %d" % (archive_file, self.CSI_ARCHIVE_VERSION))
+        offset = int(trailer["chunk_table_offset"])
+        self.chunks = np.frombuffer(self.data, dtype=self.CHUNK_DTYPE, count=int(trailer["n_chunks"]), offset=offset)
+        offset += self.chunks.nbytes
+        self.macs = np.frombuffer(self.data, dtype=self.MAC_DTYPE, count=int(trailer["n_macs"]), offset=offset)
+        offset += self.macs.nbytes
+        self.mac_chunks = np.frombuffer(self.data, dtype=np.uint32, count=int(trailer["n_mac_chunks"]), offset=offset)
+
+    @staticmethod
+    def parse_mac(mac):
+        if isinstance(mac, str):
+            return bytes(int(x, 16) for x in mac.split(":"))
+        return bytes(mac)
+
+    def find_chunks(self, ts_from=0, ts_to=2 ** 64 - 1, src_mac=None):
+        """Ids of the chunks that may contain frames in [ts_from, ts_to] from src_mac."""
+        ids = np.arange(len(self.chunks))
+        if src_mac is not None:
+            match = np.flatnonzero((self.macs["mac"] == np.frombuffer(self.parse_mac(src_mac), np.uint8)).all(axis=1))
+            if len(match) == 0:
+                return ids[:0]
+            m = self.macs[match[0]]
+            ids = self.mac_chunks[m["first"]:m["first"] + m["n_chunks"]]
+        chunks = self.chunks[ids]
+        return ids[(chunks["ts_max"] >= ts_from) & (chunks["ts_min"] <= ts_to)]
+
+    def chunk_columns(self, i):
+        """Zero copy numpy views of the columns of chunk i."""
+        chunk = self.chunks[i]
+        n = int(chunk["n_frames"])
+        shapes = {
+            "src_mac": (n, 6),
+            "gains": (n, CSIDataPcapNativeReader.CSI_N_GAIN_STAGES, CSIDataPcapNativeReader.CSI_N_GAIN_TYPES),
+            "csi": (n, self.max_tones, 2),
+            "phystatus": (n, CSIDataPcapNativeReader.CSI_N_PHYSTATUS),
+        }
+        dtypes = dict(CSIDataPcapNativeReader.COLUMN_DTYPES, src_mac=np.uint8, gains=np.int8, csi=np.int16,
+                      phystatus=np.uint16)
+        columns = {}
+        for name, offset in zip(CSIRingReader.COLUMNS, chunk["column_offset"]):
+            shape = shapes.get(name, (n,))
+            columns[name] = np.frombuffer(self.data, dtype=dtypes[name], count=int(np.prod(shape)),
+                                          offset=int(chunk["offset"]) + int(offset)).reshape(shape)
+        return columns
+
+    def read(self, ts_from=0, ts_to=2 ** 64 - 1, src_mac=None):
+        """Returns the frames in [ts_from, ts_to] (us) from src_mac as dict of numpy columns, None if there are none."""
+        parts = []
+        for i in self.find_chunks(ts_from, ts_to, src_mac):
+            columns = self.chunk_columns(i)
+            keep = (columns["ts_usec"] >= ts_from) & (columns["ts_usec"] <= ts_to)
+            if src_mac is not None:
+                keep &= (columns["src_mac"] == np.frombuffer(self.parse_mac(src_mac), np.uint8)).all(axis=1)
+            parts.append({name: array[keep] for name, array in columns.items()})
+        if not parts:
+            return None
+        columns = {name: np.concatenate([p[name] for p in parts]) for name in parts[0]}
+        columns["csi_raw"] = columns["csi"]
+        columns["csi"] = csi_features(columns["csi_raw"], outputs=("csi",))["csi"]
+        return columns
@@ -152,17 +152,119 @@ struct csi_udp_frame {
     int8 dvga[6];
     int8 trLoss[6];
     int16 agcGain;
-    int16 placeholder1;
+    uint16 flags;                       /* CSI_FLAG_* */
     uint32 csi_values[];
 } __attribute__((packed));
 
+// gains of one gain type as carried in csi_udp_frame_compact
+struct csi_gain_record {
+    int8 elnaGain;
+    int8 lna1Gain;
+    int8 lna2Gain;
+    int8 mixGain;
+    int8 lpf0;
+    int8 lpf1;
+    int8 dvga;
+    int8 trLoss;
+} __attribute__((packed));
+
+// compact variant only carrying the gain types selected in gainTypeMask,
+// fields up to chip are laid out exactly as in csi_udp_frame
+struct csi_udp_frame_compact {
+    struct ethernet_ip_udp_header hdrs;
+    uint16 kk1;
+    int8 rssi;
+    uint8 fc; //frame control
+    uint8 SrcMac[6];
+    uint16 seqCnt;
+    uint16 csiconf;
+    uint16 chanspec;
+    uint16 chip;
+    uint8 gainTypeMask;                 /* bit n set: gain type gain_types[n] is included */
+    uint8 flags;                        /* CSI_FLAG_* */
+    int16 agcGain;
+    struct csi_gain_record gains[];     /* one record per bit set in gainTypeMask, followed by csi values */
+} __attribute__((packed));
+
+// header flags
+#define CSI_FLAG_TONE_SELECT        0x01    /* csi_tone_desc follows the header, only selected tones are sent */
+#define CSI_FLAG_PACKED14           0x02    /* csi values are packed int14 real/imag pairs, 7 bytes per 2 tones */
+#define CSI_FLAG_EXT_HEADER         0x04    /* csi_ext_header follows the header, phystatus is not inserted into the csi */
+
+// receive status of the frame that triggered the csi, carried in frames with CSI_FLAG_EXT_HEADER.
+// later versions only append fields, hosts skip len bytes to get to the tone descriptor or the csi
+#define CSI_EXT_HEADER_VERSION      3
+struct csi_ext_header {
+    uint8 version;                      /* CSI_EXT_HEADER_VERSION */
+    uint8 len;                          /* sizeof(struct csi_ext_header) */
+    uint16 RxTSFTime;                   /* d11rxhdr RxTSFTime */
+    uint32 tsf_l;                       /* TSF_L when the frame was received */
+    uint16 phystatus[6];                /* d11rxhdr PhyRxStatus_0..5 */
+    uint32 tsf_h;                       /* version 2: wraps of tsf_l, tsf_h:tsf_l is the 64 bit tsf in us */
+    uint16 sweepStep;                   /* version 3: gain sweep step the frame was received with, GAIN_SWEEP_NONE */
+    uint16 PAD;
+} __attribute__((packed));
+
+// describes which tones are carried in a frame with CSI_FLAG_TONE_SELECT
+struct csi_tone_desc {
+    uint8 decimation;                   /* every n-th non-null tone is sent */
+    uint8 PAD;
+    uint16 nTones;                      /* number of csi values in this frame */
+    uint32 toneMask[8];                 /* bit t set: tone t is included */
+} __attribute__((packed));
+
+#define CSI_FRAME_MAGIC             0x1111
+#define CSI_FRAME_MAGIC_COMPACT     0x1112
+#define CSI_FRAME_MAGIC_BATCH       0x1113
+
+// several csi frames sent in one udp frame, each record is a uint16 length
+// followed by a csi_udp_frame (or csi_udp_frame_compact) without hdrs
+struct csi_udp_batch {
+    struct ethernet_ip_udp_header hdrs;
+    uint16 kk1;
+    uint16 nRecords;
+    uint8 records[];
+} __attribute__((packed));
+
+#define CSI_BATCH_MAX_BYTES         8192
+
 struct int14 {signed int val:14;} __attribute__((packed));
 
-uint16 missing_csi_frames = 0;
-uint16 inserted_csi_values = 0;
-struct sk_buff *p_csi = 0;
+// csi frames of different cores and spatial streams can be reassembled in parallel
+#define CSI_N_SLOTS             4
+#define CSI_MAX_TONES           256
+
+struct csi_slot {
+    struct sk_buff *p;                  /* csi frame under reassembly, 0 if slot is free */
+    uint16 csiconf;                     /* core and spatial stream of this csi */
+    uint16 missing;                     /* number of chunks still missing */
+    uint16 inserted;                    /* number of csi values inserted so far */
+    uint16 tone;                        /* number of tones received so far */
+    uint16 hdr_len;                     /* csi_hdr_len at the time the frame was created */
+    uint16 flags;                       /* header flags of the csi frame */
+    uint32 age;                         /* value of csi_slot_clock when the frame was created */
+    uint32 tone_mask[CSI_MAX_TONES / 32];   /* tone_mask at the time the frame was created */
+} csi_slots[CSI_N_SLOTS];
+uint32 csi_slot_clock = 0;
+
+// statistics returned by ioctl 508
+struct csi_reassembly_stats {
+    uint32 completed;                   /* csi frames sent to the host */
+    uint32 restarted;                   /* new csi for a csiconf whose old csi was incomplete */
+    uint32 evicted;                     /* incomplete csi dropped because all slots were in use */
+    uint32 unexpected;                  /* chunks without a matching new csi */
+    uint32 mismatch;                    /* chunks with an unexpected number of missing chunks */
+    uint32 no_buffer;                   /* new csi dropped because no frame buffer was available */
+} __attribute__((packed)) csi_reassembly_stats = { 0 };
 int8 last_rssi = 0;
 uint16 phystatus[6] = {0,0,0,0, 0, 0};
+uint16 last_rx_tsf_time = 0;
+uint32 last_tsf_l = 0;
+uint32 last_tsf_h = 0;
+
+// tsf_l of every received frame is extended to 64 bit by counting its wraps (every 71.6 minutes)
+uint32 tsf_h = 0;
+uint32 prev_tsf_l = 0;
 
 int8 elna_gain = 0;
 int8 lna1_gain = 0;
@@ -183,26 +285,582 @@ int8 last_dvga_gain[6] = {0,0,0,0,0,0};
 int8 last_tr_loss[6] = {0,0,0,0,0,0};
 int16 last_agc_gain = 0;
 
+// gain types in the order of the 6 element gain arrays of csi_udp_frame
+#define N_GAIN_TYPES            6
+#define GAIN_TYPE_CONST_INDEX   4       /* gain type 9 uses constant gain codes */
+static const uint8 gain_types[N_GAIN_TYPES] = {1, 2, 3, 4, 9, 10};
+
+uint8 gain_type_mask = 0x3f;            /* bit n selects gain_types[n], set by ioctl 504 */
+uint8 use_compact_frame = 0;            /* send csi_udp_frame_compact instead of csi_udp_frame */
+uint16 csi_hdr_len = sizeof(struct csi_udp_frame);
+
+// header extension configured by ioctl 511
+uint8 use_ext_header = 0;
+
+// gain sweep configured by ioctl 512, the gain ids index the default gain tables in ioctl.c
+struct gain_sweep_step {
+    uint8 lna1;
+    uint8 lna2;
+    uint8 tia;
+    uint8 PAD;
+} __attribute__((packed));
+
+#define GAIN_SWEEP_MAX_STEPS    512     /* enough for every lna1, lna2 and tia combination */
+#define GAIN_SWEEP_NONE         0xffff  /* sweep step of frames received while no sweep runs */
+#define GAIN_SWEEP_N_LNA1       6
+#define GAIN_SWEEP_N_LNA2       7
+#define GAIN_SWEEP_N_TIA        12
+struct gain_sweep_step sweep_steps[GAIN_SWEEP_MAX_STEPS];
+uint16 sweep_n_steps = 0;
+uint16 sweep_step = GAIN_SWEEP_NONE;    /* step whose gains are applied */
+uint8 sweep_dwell_us = 0;               /* dwell is in us of the tsf instead of frames */
+uint8 sweep_repeat = 0;                 /* start again after the last step */
+uint32 sweep_dwell = 0;
+uint32 sweep_frames = 0;                /* frames received with the current step */
+uint32 sweep_step_start = 0;            /* tsf_l of the first frame received with the current step */
+uint16 last_sweep_step = GAIN_SWEEP_NONE;  /* sweep step of the frame that triggered the last csi */
+
+extern void set_lna1_gain(struct phy_info *pi, uint8 gain_id);
+extern void set_lna2_gain(struct phy_info *pi, uint8 gain_id);
+extern void set_tia_gain(struct phy_info *pi, uint8 gain_id);
+
+// tone selection configured by ioctl 509
+uint8 tone_select = 0;
+uint8 tone_decimation = 1;
+uint32 tone_mask[CSI_MAX_TONES / 32];   /* tones that are sent when tone_select is set */
+
+// csi value format configured by ioctl 510
+#if ((NEXMON_CHIP == CHIP_VER_BCM4339) || (NEXMON_CHIP == CHIP_VER_BCM43455c0))
+uint8 csi_packed14 = 0;
+#else
+#define csi_packed14 0                  /* csi is already forwarded in its hardware format */
+#endif
+
+// returns the header flags describing the current csi format
+uint16
+csi_frame_flags(void)
+{
+    return (tone_select ? CSI_FLAG_TONE_SELECT : 0) | (csi_packed14 ? CSI_FLAG_PACKED14 : 0)
+        | (use_ext_header ? CSI_FLAG_EXT_HEADER : 0);
+}
+
+// stores the 28 bit int14 real/imag pair of a tone at tone index n of a packed csi array
+static inline void
+pack_csi14(uint8 *dst, uint16 n, uint32 csi)
+{
+    uint8 *b = dst + ((n >> 1) * 7);
+    csi &= 0x0fffffff;
+    if ((n & 1) == 0) {
+        b[0] = csi & 0xff;
+        b[1] = (csi >> 8) & 0xff;
+        b[2] = (csi >> 16) & 0xff;
+        b[3] = (csi >> 24) & 0x0f;
+    } else {
+        b[3] |= (csi & 0x0f) << 4;
+        b[4] = (csi >> 4) & 0xff;
+        b[5] = (csi >> 12) & 0xff;
+        b[6] = (csi >> 20) & 0xff;
+    }
+}
+
+// shadow copy of the gain entries of phy table 0x44 that are used by get_rx_gains
+#define GAIN_TBL_ELNA_OFFSET    0x00
+#define GAIN_TBL_ELNA_LEN       2
+#define GAIN_TBL_LNA1_OFFSET    0x08
+#define GAIN_TBL_LNA1_LEN       8
+#define GAIN_TBL_MIX_OFFSET     0x20
+#define GAIN_TBL_MIX_LEN        16
+#define GAIN_TBL_LPF1_OFFSET    0x70
+#define GAIN_TBL_LPF1_LEN       8
+
+int8 gain_tbl_elna[GAIN_TBL_ELNA_LEN];
+int8 gain_tbl_lna1[GAIN_TBL_LNA1_LEN];
+int8 gain_tbl_mix[GAIN_TBL_MIX_LEN];
+int8 gain_tbl_lpf1[GAIN_TBL_LPF1_LEN];
+uint8 gain_tbl_cache_valid = 0;
+uint16 gain_tbl_chanspec = 0;           /* chanspec the shadow copy was read on */
+
+void get_rx_gains(struct phy_info *pi, uint8 gain_type);
+void assign_rx_gains(uint8 index);
+
+// has to be called between wlc_phyreg_enter and wlc_phyreg_exit whenever table 0x44 was rewritten
+void
+refresh_gain_table_cache(struct phy_info *pi)
+{
+    wlc_phy_table_read_acphy_rp(pi, 0x44, GAIN_TBL_ELNA_LEN, GAIN_TBL_ELNA_OFFSET, 8, gain_tbl_elna);
+    wlc_phy_table_read_acphy_rp(pi, 0x44, GAIN_TBL_LNA1_LEN, GAIN_TBL_LNA1_OFFSET, 8, gain_tbl_lna1);
+    wlc_phy_table_read_acphy_rp(pi, 0x44, GAIN_TBL_MIX_LEN, GAIN_TBL_MIX_OFFSET, 8, gain_tbl_mix);
+    wlc_phy_table_read_acphy_rp(pi, 0x44, GAIN_TBL_LPF1_LEN, GAIN_TBL_LPF1_OFFSET, 8, gain_tbl_lpf1);
+    gain_tbl_cache_valid = 1;
+
+    // gain type 9 only depends on the gain tables apart from its tr loss, so it is not evaluated per frame
+    if (gain_type_mask & (1 << GAIN_TYPE_CONST_INDEX)) {
+        get_rx_gains(pi, gain_types[GAIN_TYPE_CONST_INDEX]);
+        assign_rx_gains(GAIN_TYPE_CONST_INDEX);
+    }
+}
+
+// the phy reloads its gain tables on channel and band changes, the next frame refreshes the cache
+void
+invalidate_gain_table_cache(void)
+{
+    gain_tbl_cache_valid = 0;
+}
+
+// copy of the ucode frame filter configured by ioctl 500
+struct csi_filter {
+    uint8  csi_collect;
+    uint8  use_pkt_filter;
+    uint8  first_pkt_byte;
+    uint8  n_mac_addr;
+    uint16 src_mac[4][3];               /* mac addresses as 16 bit shm words */
+} csi_filter = { 0 };
+
+// received frames start with the plcp header after the (extended) rx header
+#define HWRXOFF                 ((RXE_RXHDR_LEN * 2) + RXE_RXHDR_EXTRA)
+#define RXS_PBPRES              0x0004  /* RxStatus1: 2 pad bytes before the plcp header */
+#define PLCP_HDR_LEN            6
+#define MIN_FRAME_LEN           (PLCP_HDR_LEN + 24)
+
+void
+update_csi_filter(uint8 csi_collect, uint8 use_pkt_filter, uint8 first_pkt_byte, uint16 n_mac_addr, uint16 *src_mac)
+{
+    csi_filter.csi_collect = csi_collect;
+    csi_filter.use_pkt_filter = use_pkt_filter;
+    csi_filter.first_pkt_byte = first_pkt_byte;
+    csi_filter.n_mac_addr = n_mac_addr > 4 ? 4 : n_mac_addr;
+    memcpy(csi_filter.src_mac, src_mac, sizeof(csi_filter.src_mac));
+}
+
+// applies the same checks as the ucode to decide whether csi will be extracted for this frame
+int
+frame_triggers_csi(struct sk_buff *p)
+{
+    struct d11rxhdr *rxh = (struct d11rxhdr *) p->data;
+    uint16 pad = (rxh->RxStatus1 & RXS_PBPRES) ? 2 : 0;
+
+    // the ucode only extracts csi while csi_collect is exactly 1
+    if (csi_filter.csi_collect != 1 || p->len < HWRXOFF + pad + MIN_FRAME_LEN) {
+        return 0;
+    }
+
+    uint8 *frm = (uint8 *) p->data + HWRXOFF + pad + PLCP_HDR_LEN;
+
+    if (csi_filter.use_pkt_filter && frm[0] != csi_filter.first_pkt_byte) {
+        return 0;
+    }
+
+    if (csi_filter.n_mac_addr == 0) {
+        return 1;
+    }
+
+    // transmitter address
+    uint16 src0 = frm[10] | (frm[11] << 8);
+    uint16 src1 = frm[12] | (frm[13] << 8);
+    uint16 src2 = frm[14] | (frm[15] << 8);
+    int i;
+    for (i = 0; i < csi_filter.n_mac_addr; i++) {
+        if (csi_filter.src_mac[i][0] == src0 && csi_filter.src_mac[i][1] == src1 && csi_filter.src_mac[i][2] == src2) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// pools of preallocated frame buffers. the frame pool is filled on the first ioctl the host sends while it
+// brings the interface up, the batch pool by ioctl 506. both are refilled from a timer after buffers were
+// sent, never from the receive path, and ioctl 513 sets their sizes
+#define CSI_POOL_MAX_SIZE       64
+// up to CSI_N_SLOTS buffers are held by the reassembly, the others cover the frames of one refill period
+#define CSI_FRAME_POOL_SIZE     16
+// the largest frame has the full header, the header extension, the tone descriptor and 256 unpacked tones
+#define CSI_POOL_BUF_LEN        (sizeof(struct csi_udp_frame) + sizeof(struct csi_ext_header) \
+                                 + sizeof(struct csi_tone_desc) + CSI_MAX_TONES * sizeof(uint32))
+#define CSI_BATCH_POOL_SIZE     4
+#define CSI_POOL_REFILL_MS      1
+
+// statistics returned by ioctl 507, first of the frame pool then of the batch pool
+struct csi_pool_stats {
+    uint16 size;
+    uint16 free;
+    uint16 high_water;                  /* maximum number of pool buffers in use at the same time */
+    uint16 PAD;
+    uint32 exhausted;                   /* requests that found the pool empty */
+    uint32 alloc_failures;              /* requests that could not be served at all */
+    uint32 refill_failures;             /* allocations that failed while refilling the pool */
+} __attribute__((packed));
+
+struct csi_pool {
+    struct sk_buff *bufs[CSI_POOL_MAX_SIZE];
+    uint16 buf_len;                     /* every buffer handed out is at least buf_len bytes */
+    struct csi_pool_stats stats;        /* stats.size buffers are kept, stats.free are in bufs */
+};
+
+struct csi_pool csi_frame_pool = { { 0 }, CSI_POOL_BUF_LEN, { CSI_FRAME_POOL_SIZE, 0, 0, 0, 0, 0, 0 } };
+struct csi_pool csi_batch_pool = { { 0 }, 0, { 0, 0, 0, 0, 0, 0, 0 } };  /* sized by configure_csi_batching */
+uint16 csi_batch_pool_size = CSI_BATCH_POOL_SIZE;  /* buffers of the batch pool while batching is on */
+uint8 csi_pool_refill_pending = 0;
+uint8 csi_pools_reserved = 0;
+
+static void
+fill_csi_pool(struct osl_info *osh, struct csi_pool *pool)
+{
+    while (pool->stats.free < pool->stats.size) {
+        struct sk_buff *p = pkt_buf_get_skb(osh, pool->buf_len);
+        if (p == 0) {
+            pool->stats.refill_failures++;
+            break;
+        }
+        pool->bufs[pool->stats.free++] = p;
+    }
+}
+
+// frees all buffers and keeps size buffers of buf_len bytes from now on
+static void
+resize_csi_pool(struct osl_info *osh, struct csi_pool *pool, uint16 size, uint16 buf_len)
+{
+    while (pool->stats.free > 0) {
+        pkt_buf_free_skb(osh, pool->bufs[--pool->stats.free], 0);
+    }
+    pool->stats.size = size;
+    pool->stats.high_water = 0;
+    pool->buf_len = buf_len;
+    fill_csi_pool(osh, pool);
+}
+
+void
+csi_pool_refill(struct osl_info *osh)
+{
+    fill_csi_pool(osh, &csi_frame_pool);
+    fill_csi_pool(osh, &csi_batch_pool);
+}
+
+// reserves the frame pool once, before csi can be switched on
+void
+csi_pool_init(struct osl_info *osh)
+{
+    if (csi_pools_reserved) {
+        return;
+    }
+    csi_pools_reserved = 1;
+    csi_pool_refill(osh);
+}
+
 void
+csi_pool_timer(struct hndrte_timer *t)
+{
+    csi_pool_refill_pending = 0;
+    csi_pool_refill(((struct wl_info *) t->context)->wlc->osh);
+    hndrte_free_timer(t);
+}
+
+// called after a pool buffer was passed to xmit
+static void
+schedule_csi_pool_refill(struct wl_info *wl)
+{
+    if (csi_pool_refill_pending) {
+        return;
+    }
+    if (schedule_work(wl, 0, csi_pool_timer, CSI_POOL_REFILL_MS, 0) != 0) {
+        csi_pool_refill_pending = 1;
+    }
+}
+
+struct sk_buff *
+csi_pool_get(struct osl_info *osh, struct csi_pool *pool, int len)
+{
+    struct sk_buff *p = 0;
+    if (len <= pool->buf_len && pool->stats.free > 0) {
+        p = pool->bufs[--pool->stats.free];
+        uint16 used = pool->stats.size - pool->stats.free;
+        if (used > pool->stats.high_water) {
+            pool->stats.high_water = used;
+        }
+    } else {
+        if (len <= pool->buf_len) {
+            pool->stats.exhausted++;
+        }
+        p = pkt_buf_get_skb(osh, len < pool->buf_len ? pool->buf_len : len);
+        if (p == 0) {
+            pool->stats.alloc_failures++;
+        }
+    }
+    if (p != 0) {
+        p->len = len;
+    }
+    return p;
+}
+
+int
+get_csi_pool_stats(char *buf, int len)
+{
+    if (len < sizeof(struct csi_pool_stats)) {
+        return 0;
+    }
+    memcpy(buf, &csi_frame_pool.stats, sizeof(struct csi_pool_stats));
+    if (len < 2 * sizeof(struct csi_pool_stats)) {
+        return sizeof(struct csi_pool_stats);
+    }
+    memcpy(buf + sizeof(struct csi_pool_stats), &csi_batch_pool.stats, sizeof(struct csi_pool_stats));
+    return 2 * sizeof(struct csi_pool_stats);
+}
+
+// for buffers that were not passed to xmit
+void
+csi_pool_put(struct osl_info *osh, struct csi_pool *pool, struct sk_buff *p)
+{
+    if (pool->stats.free < pool->stats.size) {
+        pool->bufs[pool->stats.free++] = p;
+    } else {
+        pkt_buf_free_skb(osh, p, 0);
+    }
+}
+
+// batching of csi frames configured by ioctl 506
+uint16 batch_max_records = 0;           /* 0 or 1: every csi frame is sent on its own */
+uint16 batch_max_bytes = 1400;          /* byte budget for the records of one batch */
+uint16 batch_timeout_ms = 10;           /* flush incomplete batches after this time */
+struct sk_buff *p_batch = 0;
+uint16 batch_used = 0;                  /* bytes used in p_batch including the header */
+uint32 batch_seq = 0;                   /* incremented on every flush to invalidate old timers */
+
+void
+xmit_csi_frame(struct wl_info *wl, struct sk_buff *p)
+{
+    skb_pull(p, sizeof(struct ethernet_ip_udp_header));
+    prepend_ethernet_ipv4_udp_header(p);
+    wl->dev->chained->funcs->xmit(wl->dev, wl->dev->chained, p);
+}
+
+void
+flush_csi_batch(struct wl_info *wl)
+{
+    if (p_batch == 0) {
+        return;
+    }
+    p_batch->len = batch_used;
+    xmit_csi_frame(wl, p_batch);
+    schedule_csi_pool_refill(wl);
+    p_batch = 0;
+    batch_used = 0;
+    batch_seq++;
+}
+
+void
+csi_batch_timer(struct hndrte_timer *t)
+{
+    // the batch this timer was started for might already be flushed
+    if ((uint32) t->data == batch_seq) {
+        flush_csi_batch((struct wl_info *) t->context);
+    }
+    hndrte_free_timer(t);
+}
+
+void
+configure_csi_batching(struct wl_info *wl, uint16 max_records, uint16 max_bytes, uint16 timeout_ms)
+{
+    flush_csi_batch(wl);
+    batch_max_records = max_records;
+    batch_max_bytes = max_bytes > CSI_BATCH_MAX_BYTES ? CSI_BATCH_MAX_BYTES : max_bytes;
+    batch_timeout_ms = timeout_ms;
+    // batch buffers are only kept while batching is on
+    if (batch_max_records < 2) {
+        resize_csi_pool(wl->wlc->osh, &csi_batch_pool, 0, 0);
+    } else {
+        resize_csi_pool(wl->wlc->osh, &csi_batch_pool, csi_batch_pool_size, sizeof(struct csi_udp_batch) + batch_max_bytes);
+    }
+}
+
+// sizes of the frame and the batch pool, at most CSI_POOL_MAX_SIZE buffers each
+void
+configure_csi_pools(struct wl_info *wl, uint16 frame_pool_size, uint16 batch_pool_size)
+{
+    csi_batch_pool_size = batch_pool_size > CSI_POOL_MAX_SIZE ? CSI_POOL_MAX_SIZE : batch_pool_size;
+    resize_csi_pool(wl->wlc->osh, &csi_frame_pool, frame_pool_size > CSI_POOL_MAX_SIZE ? CSI_POOL_MAX_SIZE : frame_pool_size,
+        CSI_POOL_BUF_LEN);
+    if (batch_max_records >= 2) {
+        resize_csi_pool(wl->wlc->osh, &csi_batch_pool, csi_batch_pool_size, csi_batch_pool.buf_len);
+    }
+    csi_pools_reserved = 1;
+}
+
+// takes ownership of the completed csi frame p
+void
+send_csi_frame(struct wl_info *wl, struct sk_buff *p)
+{
+    struct osl_info *osh = wl->wlc->osh;
+    uint16 rec_len = p->len - sizeof(struct ethernet_ip_udp_header);
+
+    if (batch_max_records < 2 || sizeof(uint16) + rec_len > batch_max_bytes) {
+        flush_csi_batch(wl);
+        xmit_csi_frame(wl, p);
+        schedule_csi_pool_refill(wl);
+        return;
+    }
+
+    if (p_batch != 0 && batch_used + sizeof(uint16) + rec_len > sizeof(struct csi_udp_batch) + batch_max_bytes) {
+        flush_csi_batch(wl);
+    }
+
+    if (p_batch == 0) {
+        p_batch = csi_pool_get(osh, &csi_batch_pool, sizeof(struct csi_udp_batch) + batch_max_bytes);
+        if (p_batch == 0) {
+            xmit_csi_frame(wl, p);
+            schedule_csi_pool_refill(wl);
+            return;
+        }
+        struct csi_udp_batch *batch = (struct csi_udp_batch *) p_batch->data;
+        batch->kk1 = CSI_FRAME_MAGIC_BATCH;
+        batch->nRecords = 0;
+        batch_used = sizeof(struct csi_udp_batch);
+        if (batch_timeout_ms > 0) {
+            schedule_work(wl, (void *) batch_seq, csi_batch_timer, batch_timeout_ms, 0);
+        }
+    }
+
+    struct csi_udp_batch *batch = (struct csi_udp_batch *) p_batch->data;
+    uint8 *rec = (uint8 *) p_batch->data + batch_used;
+    rec[0] = rec_len & 0xff;
+    rec[1] = rec_len >> 8;
+    memcpy(rec + sizeof(uint16), (uint8 *) p->data + sizeof(struct ethernet_ip_udp_header), rec_len);
+    batch_used += sizeof(uint16) + rec_len;
+    batch->nRecords++;
+    csi_pool_put(osh, &csi_frame_pool, p);
+
+    if (batch->nRecords >= batch_max_records) {
+        flush_csi_batch(wl);
+    }
+}
+
+int
+get_csi_reassembly_stats(char *buf, int len)
+{
+    if (len < sizeof(csi_reassembly_stats)) {
+        return 0;
+    }
+    memcpy(buf, &csi_reassembly_stats, sizeof(csi_reassembly_stats));
+    return sizeof(csi_reassembly_stats);
+}
+
+struct csi_slot *
+find_csi_slot(uint16 csiconf)
+{
+    int i;
+    for (i = 0; i < CSI_N_SLOTS; i++) {
+        if (csi_slots[i].p != 0 && csi_slots[i].csiconf == csiconf) {
+            return &csi_slots[i];
+        }
+    }
+    return 0;
+}
+
+// returns a free slot, evicting the oldest incomplete csi if necessary
+struct csi_slot *
+get_free_csi_slot(struct osl_info *osh)
+{
+    struct csi_slot *oldest = &csi_slots[0];
+    int i;
+    for (i = 0; i < CSI_N_SLOTS; i++) {
+        if (csi_slots[i].p == 0) {
+            return &csi_slots[i];
+        }
+        // the clock wraps, so compare the distance
+        if ((int32) (csi_slots[i].age - oldest->age) < 0) {
+            oldest = &csi_slots[i];
+        }
+    }
+    printf("no free csi slot, clearing oldest\n");
+    csi_reassembly_stats.evicted++;
+    csi_pool_put(osh, &csi_frame_pool, oldest->p);
+    oldest->p = 0;
+    return oldest;
+}
+
+// the extension header comes right before the tone descriptor
+void
+fill_csi_ext_header(struct sk_buff *p_csi)
+{
+    if (!use_ext_header) {
+        return;
+    }
+    uint16 offset = csi_hdr_len - sizeof(struct csi_ext_header) - (tone_select ? sizeof(struct csi_tone_desc) : 0);
+    struct csi_ext_header *ext = (struct csi_ext_header *) ((uint8 *) p_csi->data + offset);
+    ext->version = CSI_EXT_HEADER_VERSION;
+    ext->len = sizeof(struct csi_ext_header);
+    ext->RxTSFTime = last_rx_tsf_time;
+    ext->tsf_l = last_tsf_l;
+    ext->tsf_h = last_tsf_h;
+    ext->sweepStep = last_sweep_step;
+    ext->PAD = 0;
+    memcpy(ext->phystatus, phystatus, sizeof(ext->phystatus));
+}
+
+// the tone descriptor is the last part of the header
+void
+fill_csi_tone_desc(struct sk_buff *p_csi)
+{
+    if (!tone_select) {
+        return;
+    }
+    struct csi_tone_desc *desc = (struct csi_tone_desc *) ((uint8 *) p_csi->data + csi_hdr_len - sizeof(struct csi_tone_desc));
+    desc->decimation = tone_decimation;
+    desc->PAD = 0;
+    desc->nTones = 0;
+    memcpy(desc->toneMask, tone_mask, sizeof(desc->toneMask));
+}
+
+struct sk_buff *
 create_new_csi_frame(struct wl_info *wl, uint16 csiconf, int length)
 {
     struct osl_info *osh = wl->wlc->osh;
+    struct sk_buff *p_csi;
+    int i;
     // create new csi udp frame
-    p_csi = pkt_buf_get_skb(osh, sizeof(struct csi_udp_frame) + length);
+    p_csi = csi_pool_get(osh, &csi_frame_pool, csi_hdr_len + length);
     if (p_csi == 0) {
-        return;
+        return 0;
     }
     // fill header
+    if (use_compact_frame) {
+        struct csi_udp_frame_compact *udpfrm = (struct csi_udp_frame_compact *) p_csi->data;
+        udpfrm->kk1 = CSI_FRAME_MAGIC_COMPACT;
+        udpfrm->rssi = last_rssi;
+        udpfrm->fc = 0;
+        udpfrm->seqCnt = 0;
+        udpfrm->csiconf = csiconf;
+        udpfrm->chanspec = get_chanspec(wl->wlc);
+        udpfrm->chip = NEXMON_CHIP;
+        udpfrm->gainTypeMask = gain_type_mask;
+        udpfrm->flags = csi_frame_flags();
+        udpfrm->agcGain = last_agc_gain;
+        uint8 n = 0;
+        for (i = 0; i < N_GAIN_TYPES; i++) {
+            if (!(gain_type_mask & (1 << i))) {
+                continue;
+            }
+            udpfrm->gains[n].elnaGain = last_elna_gain[i];
+            udpfrm->gains[n].lna1Gain = last_lna1_gain[i];
+            udpfrm->gains[n].lna2Gain = last_lna2_gain[i];
+            udpfrm->gains[n].mixGain = last_mix_gain[i];
+            udpfrm->gains[n].lpf0 = last_lpf0_gain[i];
+            udpfrm->gains[n].lpf1 = last_lpf1_gain[i];
+            udpfrm->gains[n].dvga = last_dvga_gain[i];
+            udpfrm->gains[n].trLoss = last_tr_loss[i];
+            n++;
+        }
+        fill_csi_ext_header(p_csi);
+        fill_csi_tone_desc(p_csi);
+        return p_csi;
+    }
     struct csi_udp_frame *udpfrm = (struct csi_udp_frame *) p_csi->data;
     // add magic bytes, csi config and chanspec to new udp frame
-    udpfrm->kk1 = 0x1111;
+    udpfrm->kk1 = CSI_FRAME_MAGIC;
     udpfrm->rssi = last_rssi;
     udpfrm->fc = 0;
     udpfrm->seqCnt = 0;
     udpfrm->csiconf = csiconf;
     udpfrm->chanspec = get_chanspec(wl->wlc);
     udpfrm->chip = NEXMON_CHIP;
-    int i;
     for (i = 0; i < 6; i ++) {
         udpfrm->elnaGain[i] = last_elna_gain[i];
         udpfrm->lna1Gain[i] = last_lna1_gain[i];
@@ -214,7 +872,10 @@ create_new_csi_frame(struct wl_info *wl, uint16 csiconf, int length)
         udpfrm->trLoss[i] = last_tr_loss[i];
     }
     udpfrm->agcGain = last_agc_gain;
-    udpfrm->placeholder1 = 0;
+    udpfrm->flags = csi_frame_flags();
+    fill_csi_ext_header(p_csi);
+    fill_csi_tone_desc(p_csi);
+    return p_csi;
 }
 
 void
@@ -252,11 +913,12 @@ get_rx_gains(struct phy_info *pi, uint8 gain_type){
         code_B = ((0xffff000 & (code_B << 10)) & 0xf378) | ((code_B & 1) << 3) | ((code_A >> 0xe) << 8) | ((code_A >> 7) & 0x70); // questionable 
     }
 
+    // lna1 bypass enable and bypass values share one register
+    uint8 lna1BypVals = 0;
     uint8 lna1Byp = (code_B >> 1) & 1;
     if(lna1Byp != 0){   // if code_B indicates lna1 Bypass, check in lna1BypVals if it is enabled
-        uint8 lna1BypEn = phy_utils_read_phyreg(pi, 0x6fa);
-        lna1BypEn = lna1BypEn & 1;
-        if(lna1BypEn == 0){
+        lna1BypVals = phy_utils_read_phyreg(pi, 0x6fa);
+        if((lna1BypVals & 1) == 0){
             lna1Byp = 0;
         }
     }
@@ -265,7 +927,6 @@ get_rx_gains(struct phy_info *pi, uint8 gain_type){
     if(lna1Byp == 0){
         lna1_code = (code_A >> 1) & 7;
     }else{
-        uint8 lna1BypVals = phy_utils_read_phyreg(pi, 0x6fa);
         lna1_code = (lna1BypVals & 0xe) >> 1;
     }
 
@@ -276,28 +937,26 @@ get_rx_gains(struct phy_info *pi, uint8 gain_type){
     uint8 dvga_code = (code_B >> 0xc) & 0xf;
     uint8 tr_tx_index = (code_B >> 3) & 1;
 
-    // read elna
-    wlc_phy_table_read_acphy_rp(pi, 0x44, 1, (0x0 + (code_A & 0x1)), 8, &elna_gain);
+    // gain values are looked up in the shadow copy of table 0x44
+    elna_gain = gain_tbl_elna[code_A & 0x1];
 
     // read lna1
     if(lna1Byp == 0){
-        wlc_phy_table_read_acphy_rp(pi, 0x44, 1, (0x8 + lna1_code), 8, &lna1_gain);
+        lna1_gain = gain_tbl_lna1[lna1_code];
     }
     else{
-        uint8 lna1BypVals = phy_utils_read_phyreg(pi, 0x6fa);
         lna1_gain = (lna1BypVals >> 4) & 0xff;
     }
     
     lna2_gain = lna2_code; // This is only the lna2 gain code. Todo: read lna2 gain from pi_ac gaintable
     
-    // read mix
-    wlc_phy_table_read_acphy_rp(pi, 0x44, 1, (0x20 + mix_code), 8, &mix_gain);
+    mix_gain = gain_tbl_mix[mix_code];
 
     lpf0_gain = lpf0_code * 3;
     if(gain_type < 10){
         lpf1_gain = lpf1_code * 3;
     } else{
-        wlc_phy_table_read_acphy_rp(pi, 0x44, 1, (0x70 + lpf1_code), 8, &lpf1_gain);
+        lpf1_gain = gain_tbl_lpf1[lpf1_code];
     }
 
     dvga_gain = dvga_code * 3;
@@ -321,6 +980,171 @@ void assign_rx_gains(uint8 index){
     last_tr_loss[index] = tr_loss;
 }
 
+void
+clear_rx_gains(uint8 index){
+    last_elna_gain[index] = 0;
+    last_lna1_gain[index] = 0;
+    last_lna2_gain[index] = 0;
+    last_mix_gain[index] = 0;
+    last_lpf0_gain[index] = 0;
+    last_lpf1_gain[index] = 0;
+    last_dvga_gain[index] = 0;
+    last_tr_loss[index] = 0;
+}
+
+void
+update_csi_hdr_len(void)
+{
+    int i;
+    if (use_compact_frame) {
+        uint8 n = 0;
+        for (i = 0; i < N_GAIN_TYPES; i++) {
+            if (gain_type_mask & (1 << i)) n++;
+        }
+        csi_hdr_len = sizeof(struct csi_udp_frame_compact) + n * sizeof(struct csi_gain_record);
+    } else {
+        csi_hdr_len = sizeof(struct csi_udp_frame);
+    }
+    if (use_ext_header) {
+        csi_hdr_len += sizeof(struct csi_ext_header);
+    }
+    if (tone_select) {
+        csi_hdr_len += sizeof(struct csi_tone_desc);
+    }
+}
+
+// null_mask has a bit set for every guard, dc or other tone that should never be sent
+void
+configure_tone_select(uint8 decimation, uint32 *null_mask)
+{
+    int t;
+    int n = 0;
+    tone_decimation = decimation > 0 ? decimation : 1;
+    memset(tone_mask, 0, sizeof(tone_mask));
+    tone_select = 0;
+    for (t = 0; t < CSI_MAX_TONES; t++) {
+        if (null_mask[t >> 5] & (1 << (t & 31))) {
+            tone_select = 1;
+            continue;
+        }
+        if ((n++ % tone_decimation) == 0) {
+            tone_mask[t >> 5] |= 1 << (t & 31);
+        }
+    }
+    if (tone_decimation > 1) {
+        tone_select = 1;
+    }
+    update_csi_hdr_len();
+}
+
+void
+configure_csi_ext_header(uint8 enable)
+{
+    use_ext_header = enable ? 1 : 0;
+    update_csi_hdr_len();
+}
+
+void
+configure_csi_format(uint8 packed14)
+{
+#if ((NEXMON_CHIP == CHIP_VER_BCM4339) || (NEXMON_CHIP == CHIP_VER_BCM43455c0))
+    csi_packed14 = packed14;
+#endif
+}
+
+// has to be called between wlc_phyreg_enter and wlc_phyreg_exit
+void
+configure_gain_types(struct phy_info *pi, uint8 mask, uint8 compact)
+{
+    int i;
+    gain_type_mask = mask & ((1 << N_GAIN_TYPES) - 1);
+    use_compact_frame = compact;
+    update_csi_hdr_len();
+    // unselected gain types are reported as zero in csi_udp_frame
+    for (i = 0; i < N_GAIN_TYPES; i++) {
+        if (!(gain_type_mask & (1 << i))) {
+            clear_rx_gains(i);
+        }
+    }
+    refresh_gain_table_cache(pi);
+}
+
+// has to be called between wlc_phyreg_enter and wlc_phyreg_exit
+static void
+apply_sweep_step(struct phy_info *pi, uint16 step)
+{
+    set_lna1_gain(pi, sweep_steps[step].lna1);
+    set_lna2_gain(pi, sweep_steps[step].lna2);
+    set_tia_gain(pi, sweep_steps[step].tia);
+    sweep_step = step;
+    sweep_frames = 0;
+}
+
+// has to be called between wlc_phyreg_enter and wlc_phyreg_exit, n_steps 0 stops a running sweep.
+// the step is carried in the header extension, so starting a sweep enables it
+int
+configure_gain_sweep(struct phy_info *pi, uint16 n_steps, uint8 dwell_us, uint8 repeat, uint32 dwell, uint8 *steps)
+{
+    struct gain_sweep_step *step = (struct gain_sweep_step *) steps;
+    int i;
+    if (n_steps == 0) {
+        sweep_n_steps = 0;
+        sweep_step = GAIN_SWEEP_NONE;
+        return 1;
+    }
+    if (n_steps > GAIN_SWEEP_MAX_STEPS || dwell == 0) {
+        return 0;
+    }
+    for (i = 0; i < n_steps; i++) {
+        if (step[i].lna1 >= GAIN_SWEEP_N_LNA1 || step[i].lna2 >= GAIN_SWEEP_N_LNA2 || step[i].tia >= GAIN_SWEEP_N_TIA) {
+            return 0;
+        }
+    }
+    memcpy(sweep_steps, steps, n_steps * sizeof(struct gain_sweep_step));
+    sweep_n_steps = n_steps;
+    sweep_dwell_us = dwell_us;
+    sweep_repeat = repeat;
+    sweep_dwell = dwell;
+    configure_csi_ext_header(1);
+    apply_sweep_step(pi, 0);
+    return 1;
+}
+
+// has to be called between wlc_phyreg_enter and wlc_phyreg_exit after the gains of a frame that triggers csi
+// were read. the frame still counts for the current step, the next step applies to the frames after it
+static void
+advance_gain_sweep(struct phy_info *pi, uint32 tsf_l)
+{
+    if (sweep_step == GAIN_SWEEP_NONE) {
+        return;
+    }
+    // a dwell in us starts with the first frame of the step
+    if (sweep_frames++ == 0) {
+        sweep_step_start = tsf_l;
+    }
+    if (sweep_dwell_us ? (tsf_l - sweep_step_start < sweep_dwell) : (sweep_frames < sweep_dwell)) {
+        return;
+    }
+    if (sweep_step + 1 < sweep_n_steps) {
+        apply_sweep_step(pi, sweep_step + 1);
+    } else if (sweep_repeat) {
+        apply_sweep_step(pi, 0);
+    } else {
+        // the gains of the last step stay applied
+        sweep_step = GAIN_SWEEP_NONE;
+    }
+}
+
+static inline void
+track_tsf(uint32 tsf_l)
+{
+    // only a step from the top to the bottom quarter is a wrap, small steps back come from tsf adjustments
+    if (tsf_l < prev_tsf_l && (prev_tsf_l >> 30) == 3 && (tsf_l >> 30) == 0) {
+        tsf_h++;
+    }
+    prev_tsf_l = tsf_l;
+}
+
 void
 process_frame_hook(struct sk_buff *p, struct wlc_d11rxhdr *wlc_rxhdr, struct wlc_hw_info *wlc_hw, int tsf_l)
 {
@@ -332,6 +1156,7 @@ process_frame_hook(struct sk_buff *p, struct wlc_d11rxhdr *wlc_rxhdr, struct wlc
         int missing = ucodecsifrm->NexmonCSICfg & 0xff;
         int tones = CSIDATA_PER_CHUNK>>2;
         uint16 csiconf = ucodecsifrm->csiconf;
+        struct csi_slot *slot;
 #define NEWCSI	0x8000
         // check this is a new frame
         if (ucodecsifrm->start & NEWCSI) {
@@ -341,49 +1166,78 @@ process_frame_hook(struct sk_buff *p, struct wlc_d11rxhdr *wlc_rxhdr, struct wlc
         int missing = ucodecsifrm->NexmonCSICfg & 0xff;
         int tones = ucodecsifrm->NexmonCSILen;
         uint16 csiconf = (ucodecsifrm->NexmonCSICfg >> 8)&0x3f;
+        struct csi_slot *slot;
 #define CSIDATA_PER_CHUNK   56
 #define NEWCSI	0x4000
         // check this is a new frame
         if (ucodecsifrm->NexmonCSICfg & NEWCSI) {
 #endif
-            if (p_csi != 0) {
+            slot = find_csi_slot(csiconf);
+            if (slot != 0) {
                 printf("unexpected new csi, clearing old\n");
-                pkt_buf_free_skb(osh, p_csi, 0);
+                csi_reassembly_stats.restarted++;
+                csi_pool_put(osh, &csi_frame_pool, slot->p);
+                slot->p = 0;
+            } else {
+                slot = get_free_csi_slot(osh);
             }
-            create_new_csi_frame(wl, csiconf, missing * CSIDATA_PER_CHUNK);
-            if (p_csi == 0) {
+            slot->p = create_new_csi_frame(wl, csiconf, missing * CSIDATA_PER_CHUNK);
+            if (slot->p == 0) {
                 printf("unable to allocate csi frame\n");
+                csi_reassembly_stats.no_buffer++;
                 pkt_buf_free_skb(osh, p, 0);
                 return;
             }
-            missing_csi_frames = missing;
-            inserted_csi_values = 0;
+            slot->csiconf = csiconf;
+            slot->missing = missing;
+            slot->inserted = 0;
+            slot->tone = 0;
+            slot->hdr_len = csi_hdr_len;
+            slot->flags = csi_frame_flags();
+            slot->age = csi_slot_clock++;
+            // ioctl 509 may change the mask before the last chunk arrives, the frame keeps the one in its descriptor
+            if (slot->flags & CSI_FLAG_TONE_SELECT) {
+                memcpy(slot->tone_mask, tone_mask, sizeof(slot->tone_mask));
+            }
         }
-        else if (p_csi == 0) {
+        else if ((slot = find_csi_slot(csiconf)) == 0) {
             printf("unexpected csi data\n");
+            csi_reassembly_stats.unexpected++;
             pkt_buf_free_skb(osh, p, 0);
             return;
         }
-        else if (missing != missing_csi_frames) {
+        else if (missing != slot->missing) {
             printf("number of missing frames mismatch\n");
+            csi_reassembly_stats.mismatch++;
             pkt_buf_free_skb(osh, p, 0);
-            pkt_buf_free_skb(osh, p_csi, 0);
-            p_csi = 0;
+            csi_pool_put(osh, &csi_frame_pool, slot->p);
+            slot->p = 0;
             return;
         }
 
+        struct sk_buff *p_csi = slot->p;
         struct csi_udp_frame *udpfrm = (struct csi_udp_frame *) p_csi->data;
+        uint32 *csi_values = (uint32 *) ((uint8 *) p_csi->data + slot->hdr_len);
 
         int i;
-        for (i = 0; i < tones; i ++) {
+        for (i = 0; i < tones; i ++, slot->tone++) {
+            // skip tones that are not selected before doing any conversion
+            if ((slot->flags & CSI_FLAG_TONE_SELECT) && (slot->tone >= CSI_MAX_TONES || !(slot->tone_mask[slot->tone >> 5] & (1 << (slot->tone & 31))))) {
+                continue;
+            }
 #if ((NEXMON_CHIP == CHIP_VER_BCM4339) || (NEXMON_CHIP == CHIP_VER_BCM43455c0))
             // csi format is 4bit null, int14 real, int14 imag
+            if (slot->flags & CSI_FLAG_PACKED14) {
+                // keep the int14 values and drop the null bits
+                pack_csi14((uint8 *) csi_values, slot->inserted++, ucodecsifrm->csi[i]);
+                continue;
+            }
             // convert to int16 real, int16 imag
             struct int14 sint14;
             sint14.val = (ucodecsifrm->csi[i] >> 14) & 0x3fff;
-            udpfrm->csi_values[inserted_csi_values] = (uint32)((int16)(sint14.val)) & 0xffff;
+            csi_values[slot->inserted] = (uint32)((int16)(sint14.val)) & 0xffff;
             sint14.val = ucodecsifrm->csi[i] & 0x3fff;
-            udpfrm->csi_values[inserted_csi_values] |= ((uint32)((int16)(sint14.val))) << 16;
+            csi_values[slot->inserted] |= ((uint32)((int16)(sint14.val))) << 16;
 #elif ((NEXMON_CHIP == CHIP_VER_BCM4358) || (NEXMON_CHIP == CHIP_VER_BCM4366c0))
             // csi format
             // for bcm4358:
@@ -391,15 +1245,15 @@ process_frame_hook(struct sk_buff *p, struct wlc_d11rxhdr *wlc_rxhdr, struct wlc
             // for bcm4366c0:
             // sign(1bit) real(12bit) sign(1bit) imag(12bit) exp(6bit)
             // forward as uint32 and unpack in user application
-            udpfrm->csi_values[inserted_csi_values] = ucodecsifrm->csi[i];
+            csi_values[slot->inserted] = ucodecsifrm->csi[i];
 #endif
-            inserted_csi_values++;
+            slot->inserted++;
         }
 
-        missing_csi_frames --;
+        slot->missing--;
 
         // send csi udp to host
-        if (missing_csi_frames == 0) {
+        if (slot->missing == 0) {
 #if NEXMON_CHIP == CHIP_VER_BCM4366c0
             memcpy(udpfrm->SrcMac, &(ucodecsifrm->src), sizeof(udpfrm->SrcMac));
             udpfrm->seqCnt = ucodecsifrm->seqcnt;
@@ -408,48 +1262,86 @@ process_frame_hook(struct sk_buff *p, struct wlc_d11rxhdr *wlc_rxhdr, struct wlc
             udpfrm->seqCnt = *((uint16*)(&(ucodecsifrm->csi[tones]))+(sizeof(udpfrm->SrcMac)>>1)); // last csifrm also contains seqN
             udpfrm->fc = (*((uint16*)(&(ucodecsifrm->csi[tones]))+(sizeof(udpfrm->SrcMac)>>1)+1)); // last csifrm also contains frame control field
 #endif
-            uint8 bw = (udpfrm->chanspec & 0x3800) >> 11;
-	    //BW 2 (20Mhz) ->  payload 28:36 are unused (tested on BCM4358 (Nexus 6P) and BCM43455c0 (Raspberry PI))
-            uint8 offset = (bw == 2) ? 28 : 0; 
-	    //Description of the bits: https://github.com/MerlinRdev/86u-merlin/blob/master/release/src-rt-5.02hnd/bcmdrivers/broadcom/net/wl/impl51/4365/src/include/d11.h#L2935
-            memcpy(&udpfrm->csi_values[offset], phystatus, sizeof(phystatus));
-
-            p_csi->len = sizeof(struct csi_udp_frame) + inserted_csi_values * sizeof(uint32);
-            skb_pull(p_csi, sizeof(struct ethernet_ip_udp_header));
-            prepend_ethernet_ipv4_udp_header(p_csi);
-            wl->dev->chained->funcs->xmit(wl->dev, wl->dev->chained, p_csi);
-            p_csi = 0;
+            if (slot->flags & CSI_FLAG_TONE_SELECT) {
+                struct csi_tone_desc *desc = (struct csi_tone_desc *) ((uint8 *) csi_values - sizeof(struct csi_tone_desc));
+                desc->nTones = slot->inserted;
+            }
+            // phystatus is not inserted if it is in the header or the unused tones are not sent or not word aligned
+            if (!(slot->flags & (CSI_FLAG_TONE_SELECT | CSI_FLAG_PACKED14 | CSI_FLAG_EXT_HEADER))) {
+                uint8 bw = (udpfrm->chanspec & 0x3800) >> 11;
+                //BW 2 (20Mhz) ->  payload 28:36 are unused (tested on BCM4358 (Nexus 6P) and BCM43455c0 (Raspberry PI))
+                uint8 offset = (bw == 2) ? 28 : 0; 
+                //Description of the bits: https://github.com/MerlinRdev/86u-merlin/blob/master/release/src-rt-5.02hnd/bcmdrivers/broadcom/net/wl/impl51/4365/src/include/d11.h#L2935
+                memcpy(&csi_values[offset], phystatus, sizeof(phystatus));
+            }
+
+            if (slot->flags & CSI_FLAG_PACKED14) {
+                // 3.5 bytes per tone, padded to whole words with zeros instead of what the buffer held before
+                uint16 packed_len = (slot->inserted * 7 + 1) >> 1;
+                uint16 padded_len = (packed_len + 3) & ~3;
+                memset((uint8 *) csi_values + packed_len, 0, padded_len - packed_len);
+                p_csi->len = slot->hdr_len + padded_len;
+            } else {
+                p_csi->len = slot->hdr_len + slot->inserted * sizeof(uint32);
+            }
+            send_csi_frame(wl, p_csi);
+            slot->p = 0;
+            csi_reassembly_stats.completed++;
         }
         pkt_buf_free_skb(osh, p, 0);
         return;
     }
 
+    // the filter has to look at the frame before wlc_recv modifies it
+    int snapshot = frame_triggers_csi(p);
+
     wlc_rxhdr->tsf_l = tsf_l;
+    track_tsf(tsf_l);
     wlc_phy_rssi_compute(wlc_hw->band->pi, wlc_rxhdr);
+
+    // gains are only needed for frames the ucode extracts csi for
+    if (!snapshot) {
+        wlc_recv(wlc_hw->wlc, p);
+        return;
+    }
+
     last_rssi = wlc_rxhdr->rssi;
     struct d11rxhdr  * rxh = &wlc_rxhdr->rxhdr;
     memcpy(phystatus, &rxh->PhyRxStatus_0, sizeof(phystatus));
+    last_rx_tsf_time = rxh->RxTSFTime;
+    last_tsf_l = tsf_l;
+    last_tsf_h = tsf_h;
+    last_sweep_step = sweep_step;
 
     wlc_phyreg_enter(wlc_hw->band->pi);
     wlc_phy_stay_in_carriersearch_acphy(wlc_hw->band->pi, 1);
 
-    // rx gains for different gain modes
-    get_rx_gains(wlc_hw->band->pi, 1);
-    assign_rx_gains(0);
-    get_rx_gains(wlc_hw->band->pi, 2);
-    assign_rx_gains(1);
-    get_rx_gains(wlc_hw->band->pi, 3);
-    assign_rx_gains(2);
-    get_rx_gains(wlc_hw->band->pi, 4);
-    assign_rx_gains(3);
-    get_rx_gains(wlc_hw->band->pi, 9);
-    assign_rx_gains(4);
-    get_rx_gains(wlc_hw->band->pi, 10);
-    assign_rx_gains(5);
+    // channel changes of the firmware itself (scans, roaming) do not go through our ioctls
+    uint16 chanspec = get_chanspec(wlc_hw->wlc);
+    if (!gain_tbl_cache_valid || chanspec != gain_tbl_chanspec) {
+        refresh_gain_table_cache(wlc_hw->band->pi);
+        gain_tbl_chanspec = chanspec;
+    }
+
+    // rx gains for the selected gain modes
+    int i;
+    for (i = 0; i < N_GAIN_TYPES; i++) {
+        if (i == GAIN_TYPE_CONST_INDEX || !(gain_type_mask & (1 << i))) {
+            continue;
+        }
+        get_rx_gains(wlc_hw->band->pi, gain_types[i]);
+        assign_rx_gains(i);
+    }
+    // the tr loss of gain type 9 is a register and changes per frame
+    if (gain_type_mask & (1 << GAIN_TYPE_CONST_INDEX)) {
+        last_tr_loss[GAIN_TYPE_CONST_INDEX] = phy_utils_read_phyreg(wlc_hw->band->pi, 0x289) & 0x7f;
+    }
 
     // agc Gain
     last_agc_gain = phy_utils_read_phyreg(wlc_hw->band->pi, 0x3b3) & 0x1f;
 
+    advance_gain_sweep(wlc_hw->band->pi, tsf_l);
+
     wlc_phy_stay_in_carriersearch_acphy(wlc_hw->band->pi, 0);
     wlc_phyreg_exit(wlc_hw->band->pi);
 
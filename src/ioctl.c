@@ -116,6 +116,23 @@
 #define COREMASK                0x8a7
 #endif
 
+extern void refresh_gain_table_cache(struct phy_info *pi);
+extern void invalidate_gain_table_cache(void);
+extern void configure_gain_types(struct phy_info *pi, uint8 mask, uint8 compact);
+extern uint8 gain_type_mask;
+extern uint8 use_compact_frame;
+extern void configure_csi_batching(struct wl_info *wl, uint16 max_records, uint16 max_bytes, uint16 timeout_ms);
+extern void csi_pool_refill(struct osl_info *osh);
+extern void csi_pool_init(struct osl_info *osh);
+extern void configure_csi_pools(struct wl_info *wl, uint16 frame_pool_size, uint16 batch_pool_size);
+extern int get_csi_pool_stats(char *buf, int len);
+extern void configure_tone_select(uint8 decimation, uint32 *null_mask);
+extern void configure_csi_format(uint8 packed14);
+extern void configure_csi_ext_header(uint8 enable);
+extern int configure_gain_sweep(struct phy_info *pi, uint16 n_steps, uint8 dwell_us, uint8 repeat, uint32 dwell, uint8 *steps);
+extern int get_csi_reassembly_stats(char *buf, int len);
+extern void update_csi_filter(uint8 csi_collect, uint8 use_pkt_filter, uint8 first_pkt_byte, uint16 n_mac_addr, uint16 *src_mac);
+
 static const int8 lna1_default_gain_tbl[] = {-2, 4, 10, 16, 23, 28};
 static const int8 lna2_default_gain_tbl[] = {0, 0, 0, 0, 0, 0, 0};
 static const int8 tia_default_gain_tbl[] = {10, 13, 16, 19, 22, 25, 28, 31, 34, 37, 37, 37};
@@ -192,6 +209,8 @@ void set_lna1_gain(struct phy_info *pi, uint8 gain_id){
 
     wlc_phy_table_write_acphy_rp(pi, 0x44, 6, 8, 8, lna1_gaintbl);
     wlc_phy_table_write_acphy_rp(pi, 0x45, 6, 8, 8, lna1_gainbitstbl);
+
+    refresh_gain_table_cache(pi);
 }
 
 void set_lna2_gain(struct phy_info *pi, uint8 gain_id){
@@ -217,6 +236,8 @@ void set_lna2_gain(struct phy_info *pi, uint8 gain_id){
 
     wlc_phy_table_write_acphy_rp(pi, 0x44, 7, 16, 8, lna2_gaintbl);
     wlc_phy_table_write_acphy_rp(pi, 0x45, 7, 16, 8, lna2_gainbitstbl);
+
+    refresh_gain_table_cache(pi);
 }
 
 void set_tia_gain(struct phy_info *pi, uint8 gain_id){
@@ -231,6 +252,91 @@ void set_tia_gain(struct phy_info *pi, uint8 gain_id){
 
     wlc_phy_table_write_acphy_rp(pi, 0x44, 0xc, 32, 8, tia_gaintbl);
     wlc_phy_table_write_acphy_rp(pi, 0x45, 0xc, 32, 8, tia_gainbitstbl);
+
+    refresh_gain_table_cache(pi);
+}
+
+#define PHY_BATCH_READ          0   // value = register addr
+#define PHY_BATCH_WRITE         1   // register addr = value
+#define PHY_BATCH_MOD           2   // bits in mask of register addr = value, value = register addr afterwards
+#define PHY_BATCH_TABLE_READ    3   // len entries from offset of table addr into the data of the op
+#define PHY_BATCH_TABLE_WRITE   4   // len entries from the data of the op to offset of table addr
+
+struct phy_batch_op {
+    uint8  op;
+    uint8  width;               // table ops: bits per entry (8, 16 or 32)
+    uint16 addr;                // register address or table id
+    uint16 mask;
+    uint16 value;
+    uint16 offset;              // table ops: first entry
+    uint16 len;                 // table ops: number of entries, the data follows the op and is padded to 4 bytes
+};
+
+struct phy_batch {
+    uint16 n_ops;
+    uint16 n_done;              // set by the ioctl: number of ops that were run
+    // struct phy_batch_op with their data follow
+};
+
+// runs all ops of the batch in buf under one phyreg bracket, stops at the first invalid op
+static int
+run_phy_batch(struct phy_info *pi, char *buf, int len)
+{
+    struct phy_batch *batch = (struct phy_batch *) buf;
+    int pos = sizeof(struct phy_batch);
+    int refresh = 0;
+    int i;
+
+    wlc_phyreg_enter(pi);
+    wlc_phy_stay_in_carriersearch_acphy(pi, 1);
+
+    for (i = 0; i < batch->n_ops; i++) {
+        struct phy_batch_op *op = (struct phy_batch_op *) (buf + pos);
+        int data_len = 0;
+
+        if (pos + (int) sizeof(struct phy_batch_op) > len) {
+            break;
+        }
+        if (op->op == PHY_BATCH_TABLE_READ || op->op == PHY_BATCH_TABLE_WRITE) {
+            if (op->width != 8 && op->width != 16 && op->width != 32) {
+                break;
+            }
+            data_len = (op->len * (op->width / 8) + 3) & ~3;
+            if (pos + (int) sizeof(struct phy_batch_op) + data_len > len) {
+                break;
+            }
+        }
+
+        if (op->op == PHY_BATCH_READ) {
+            op->value = phy_utils_read_phyreg(pi, op->addr);
+        } else if (op->op == PHY_BATCH_WRITE) {
+            phy_reg_write(pi, op->addr, op->value);
+        } else if (op->op == PHY_BATCH_MOD) {
+            phy_utils_mod_phyreg(pi, op->addr, op->mask, op->value);
+            op->value = phy_utils_read_phyreg(pi, op->addr);
+        } else if (op->op == PHY_BATCH_TABLE_READ) {
+            wlc_phy_table_read_acphy_rp(pi, op->addr, op->len, op->offset, op->width, op + 1);
+        } else if (op->op == PHY_BATCH_TABLE_WRITE) {
+            wlc_phy_table_write_acphy_rp(pi, op->addr, op->len, op->offset, op->width, op + 1);
+            // the cached gain tables are read from table 0x44
+            if (op->addr == 0x44) {
+                refresh = 1;
+            }
+        } else {
+            break;
+        }
+        pos += sizeof(struct phy_batch_op) + data_len;
+    }
+
+    if (refresh) {
+        refresh_gain_table_cache(pi);
+    }
+
+    wlc_phy_stay_in_carriersearch_acphy(pi, 0);
+    wlc_phyreg_exit(pi);
+
+    batch->n_done = i;
+    return i;
 }
 
 int 
@@ -241,6 +347,9 @@ wlc_ioctl_hook(struct wlc_info *wlc, int cmd, char *arg, int len, void *wlc_if)
 
     struct phy_info *pi = wlc->hw->band->pi;
 
+    // the host sends ioctls while it brings the interface up, long before csi can be switched on
+    csi_pool_init(wlc->osh);
+
     switch(cmd) {
         case 500:   // set csi_collect
         {
@@ -272,6 +381,7 @@ wlc_ioctl_hook(struct wlc_info *wlc, int cmd, char *arg, int len, void *wlc_if)
             set_mpc(wlc, 0);
             // set the channel
             set_chanspec(wlc, params->chanspec);
+            invalidate_gain_table_cache();
             // write shared memory
             if (wlc->hw->up && len > 1) {
                 wlc_bmac_write_shm(wlc->hw, SHM_CSI_COLLECT * 2, params->csi_collect);
@@ -293,6 +403,11 @@ wlc_ioctl_hook(struct wlc_info *wlc, int cmd, char *arg, int len, void *wlc_if)
                 wlc_bmac_write_shm(wlc->hw, CMP_SRC_MAC_3_1 * 2, params->cmp_src_mac_3_1);
                 wlc_bmac_write_shm(wlc->hw, CMP_SRC_MAC_3_2 * 2, params->cmp_src_mac_3_2);
                 wlc_bmac_write_shm(wlc->hw, FIFODELAY * 2, params->delay);
+                // mirror the filter so that process_frame_hook only reads gains for frames with csi
+                update_csi_filter(params->csi_collect, params->use_pkt_filter, params->first_pkt_byte,
+                    params->n_mac_addr, &params->cmp_src_mac_0_0);
+                // replace csi frame buffers that could not be reserved before
+                csi_pool_refill(wlc->osh);
                 ret = IOCTL_SUCCESS;
             }
             break;
@@ -321,6 +436,131 @@ wlc_ioctl_hook(struct wlc_info *wlc, int cmd, char *arg, int len, void *wlc_if)
             }
                 break;
         }
+        case 504:   // set gain types to extract
+        {
+            struct params {
+                uint8 gain_type_mask;       // bit 0-5: gain_type 1, 2, 3, 4, 9, 10
+                uint8 compact;              // send csi_udp_frame_compact with selected gain types only (1: on, 0: off)
+            };
+            struct params *params = (struct params *) arg;
+            if (wlc->hw->up && len >= sizeof(struct params)) {
+                wlc_phyreg_enter(pi);
+                wlc_phy_stay_in_carriersearch_acphy(pi, 1);
+
+                configure_gain_types(pi, params->gain_type_mask, params->compact);
+
+                wlc_phy_stay_in_carriersearch_acphy(pi, 0);
+                wlc_phyreg_exit(pi);
+                ret = IOCTL_SUCCESS;
+            }
+            break;
+        }
+        case 505:   // get gain types to extract
+        {
+            if (len >= 2) {
+                arg[0] = gain_type_mask;
+                arg[1] = use_compact_frame;
+                ret = IOCTL_SUCCESS;
+            }
+            break;
+        }
+        case 506:   // set csi batching
+        {
+            struct params {
+                uint16 max_records;         // number of csi frames per udp frame (0 or 1: off)
+                uint16 max_bytes;           // byte budget for the csi frames of one udp frame
+                uint16 timeout_ms;          // send incomplete batches after this time (0: never)
+            };
+            struct params *params = (struct params *) arg;
+            if (len >= sizeof(struct params)) {
+                configure_csi_batching(wlc->wl, params->max_records, params->max_bytes, params->timeout_ms);
+                ret = IOCTL_SUCCESS;
+            }
+            break;
+        }
+        case 507:   // get csi frame and batch pool statistics
+        {
+            if (get_csi_pool_stats(arg, len)) {
+                ret = IOCTL_SUCCESS;
+            }
+            break;
+        }
+        case 508:   // get csi reassembly statistics
+        {
+            if (get_csi_reassembly_stats(arg, len)) {
+                ret = IOCTL_SUCCESS;
+            }
+            break;
+        }
+        case 509:   // set csi tone selection
+        {
+            struct params {
+                uint8  decimation;          // send every n-th tone that is not masked (0 or 1: all)
+                uint8  PAD[3];
+                uint32 null_mask[8];        // bit t set: never send tone t (guard and dc tones)
+            };
+            struct params *params = (struct params *) arg;
+            if (len >= sizeof(struct params)) {
+                configure_tone_select(params->decimation, params->null_mask);
+                ret = IOCTL_SUCCESS;
+            }
+            break;
+        }
+        case 510:   // set csi value format
+        {
+            // arg[0]: 1 packs the int14 real/imag values into 28 bits per tone, 0 sends int16 real/imag
+            if (len >= 1) {
+                configure_csi_format(arg[0]);
+                ret = IOCTL_SUCCESS;
+            }
+            break;
+        }
+        case 511:   // set csi header extension
+        {
+            // arg[0]: 1 adds csi_ext_header (phystatus, RxTSFTime, 64 bit tsf, gain sweep step) to the header instead
+            // of inserting phystatus into the csi
+            if (len >= 1) {
+                configure_csi_ext_header(arg[0]);
+                ret = IOCTL_SUCCESS;
+            }
+            break;
+        }
+        case 512:   // set gain sweep
+        {
+            struct params {
+                uint16 n_steps;             // number of steps (0: stop the running sweep)
+                uint8  dwell_unit;          // 0: dwell is in frames that trigger csi, 1: in us
+                uint8  repeat;              // start again after the last step (1: on, 0: off)
+                uint32 dwell;               // frames or us per step
+                uint8  steps[];             // n_steps x (lna1, lna2, tia, 0) gain ids as for ioctls 550-552
+            };
+            struct params *params = (struct params *) arg;
+            if (wlc->hw->up && len >= sizeof(struct params) && len >= sizeof(struct params) + params->n_steps * 4) {
+                wlc_phyreg_enter(pi);
+                wlc_phy_stay_in_carriersearch_acphy(pi, 1);
+
+                if (configure_gain_sweep(pi, params->n_steps, params->dwell_unit, params->repeat, params->dwell, params->steps)) {
+                    ret = IOCTL_SUCCESS;
+                }
+
+                wlc_phy_stay_in_carriersearch_acphy(pi, 0);
+                wlc_phyreg_exit(pi);
+            }
+            break;
+        }
+        case 513:   // set csi pool sizes
+        {
+            struct params {
+                uint16 frame_pool_size;     // csi frame buffers (default 16, at most 64)
+                uint16 batch_pool_size;     // batch buffers while batching is on (default 4, at most 64)
+            };
+            struct params *params = (struct params *) arg;
+            if (len >= sizeof(struct params)) {
+                configure_csi_pools(wlc->wl, params->frame_pool_size, params->batch_pool_size);
+                ret = IOCTL_SUCCESS;
+            }
+            break;
+        }
         case NEX_READ_OBJMEM:
         {
             set_mpc(wlc, 0);
@@ -445,6 +685,7 @@ wlc_ioctl_hook(struct wlc_info *wlc, int cmd, char *arg, int len, void *wlc_if)
 
             wlc_phy_table_write_acphy_rp(pi, 0x44, 3, 0x70, 8, bq1_gaintbl);
             wlc_phy_table_write_acphy_rp(pi, 0x45, 3, 0x70, 8, bq1_gainbitstbl);
+            refresh_gain_table_cache(pi);
 
             //wlc_phy_table_write_acphy_rp(pi, 0x44, 0xc, 0x80, 8, dvga_gaintbl);
             //wlc_phy_table_write_acphy_rp(pi, 0x45, 0xc, 0x80, 8, dvga_gainbitstbl);
@@ -549,6 +790,16 @@ wlc_ioctl_hook(struct wlc_info *wlc, int cmd, char *arg, int len, void *wlc_if)
             ret = IOCTL_SUCCESS;
             break;
         }
+        case 614:
+        {
+            // runs a struct phy_batch of register and table reads/writes, results are written back to arg
+            if (wlc->hw->up && len >= sizeof(struct phy_batch)) {
+                if (run_phy_batch(pi, arg, len) == ((struct phy_batch *) arg)->n_ops) {
+                    ret = IOCTL_SUCCESS;
+                }
+            }
+            break;
+        }
 
         default:
             ret = wlc_ioctl(wlc, cmd, arg, len, wlc_if);
@@ -0,0 +1,3 @@
+#ifndef CAPABILITIES_H
+#define CAPABILITIES_H
+#endif /*CAPABILITIES_H*/
@@ -0,0 +1,3 @@
+#ifndef CHANNELS_H
+#define CHANNELS_H
+#endif /*CHANNELS_H*/
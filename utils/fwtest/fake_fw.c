@@ -0,0 +1,408 @@
+// just enough of the firmware around src/csi_extractor.c to run it on the host
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wrapper.h>
+#include <local_wrapper.h>
+#include <helper.h>
+#include "fake_fw.h"
+
+#define HWRXOFF             ((RXE_RXHDR_LEN * 2) + RXE_RXHDR_EXTRA)
+#define CSI_UDP_PORT        5500
+#define FAKE_MAX_TIMERS     64
+#define TONES_PER_CHUNK     56
+#define NEWCSI              0x4000
+
+uint16 fake_phyreg[FAKE_N_PHYREGS];
+int8 fake_tbl44[FAKE_TBL44_LEN];
+uint32 fake_phy_accesses = 0;
+uint32 fake_phy_access_ns = 0;
+uint16 fake_chanspec = 0x1006;
+
+uint8 fake_lna1_gain_id = 0;
+uint8 fake_lna2_gain_id = 0;
+uint8 fake_tia_gain_id = 0;
+
+uint32 fake_phyreg_enters = 0;
+uint32 fake_received = 0;
+uint32 fake_sent = 0;
+int fake_skbs = 0;
+uint32 fake_allocs = 0;
+
+void (*fake_xmit_hook)(struct sk_buff *p) = 0;
+void (*fake_chunk_hook)(int chunk) = 0;
+
+static struct phy_info pi;
+static struct wlc_band band = { &pi };
+static struct wlc_info wlc;
+static struct wlc_hw_info wlc_hw;
+static struct wl_info wl;
+static struct hndrte_devfuncs bus_funcs;
+static struct hndrte_dev bus_dev = { 0, &bus_funcs };
+static struct hndrte_dev wl_dev = { &bus_dev, 0 };
+
+struct wlc_hw_info *fake_wlc_hw = &wlc_hw;
+struct wl_info *fake_wl = &wl;
+struct phy_info *fake_pi = &pi;
+
+static struct hndrte_timer *timers[FAKE_MAX_TIMERS];
+static int n_timers = 0;
+
+static FILE *pcap = 0;
+
+uint64
+fake_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+phy_access(void)
+{
+    fake_phy_accesses++;
+    if (fake_phy_access_ns) {
+        uint64 end = fake_time_ns() + fake_phy_access_ns;
+        while (fake_time_ns() < end) {
+        }
+    }
+}
+
+int
+phy_utils_read_phyreg(void *p, int addr)
+{
+    phy_access();
+    return fake_phyreg[addr & (FAKE_N_PHYREGS - 1)];
+}
+
+void
+phy_utils_mod_phyreg(void *p, unsigned short addr, unsigned short mask, unsigned short val)
+{
+    phy_access();
+    uint16 *reg = &fake_phyreg[addr & (FAKE_N_PHYREGS - 1)];
+    *reg = (*reg & ~mask) | (val & mask);
+}
+
+// only table 0x44 with 8 bit entries is backed, other tables read as zero
+void
+wlc_phy_table_read_acphy_rp(void *p, unsigned int id, unsigned int len, unsigned int offset, unsigned int width, void *data)
+{
+    unsigned int i;
+    phy_access();
+    for (i = 0; i < len; i++) {
+        ((int8 *) data)[i] = (id == 0x44 && width == 8 && offset + i < FAKE_TBL44_LEN) ? fake_tbl44[offset + i] : 0;
+    }
+}
+
+void
+wlc_phy_table_write_acphy_rp(void *p, unsigned int id, unsigned int len, unsigned int offset, unsigned int width, const void *data)
+{
+    unsigned int i;
+    phy_access();
+    for (i = 0; i < len; i++) {
+        if (id == 0x44 && width == 8 && offset + i < FAKE_TBL44_LEN) {
+            fake_tbl44[offset + i] = ((const int8 *) data)[i];
+        }
+    }
+}
+
+void
+set_lna1_gain(struct phy_info *p, uint8 gain_id)
+{
+    phy_access();
+    fake_lna1_gain_id = gain_id;
+}
+
+void
+set_lna2_gain(struct phy_info *p, uint8 gain_id)
+{
+    phy_access();
+    fake_lna2_gain_id = gain_id;
+}
+
+void
+set_tia_gain(struct phy_info *p, uint8 gain_id)
+{
+    phy_access();
+    fake_tia_gain_id = gain_id;
+}
+
+struct sk_buff *
+pkt_buf_get_skb(struct osl_info *osh, unsigned int len)
+{
+    struct sk_buff *p = malloc(sizeof(struct sk_buff) + len);
+    if (p == 0) {
+        return 0;
+    }
+    p->data = p + 1;
+    p->len = len;
+    // firmware buffers are not cleared
+    memset(p->data, 0xa5, len);
+    fake_skbs++;
+    fake_allocs++;
+    return p;
+}
+
+void
+pkt_buf_free_skb(struct osl_info *osh, struct sk_buff *p, int send)
+{
+    fake_skbs--;
+    free(p);
+}
+
+void *
+skb_pull(struct sk_buff *p, unsigned int len)
+{
+    p->data = (uint8 *) p->data + len;
+    p->len -= len;
+    return p->data;
+}
+
+void *
+skb_push(struct sk_buff *p, unsigned int len)
+{
+    p->data = (uint8 *) p->data - len;
+    p->len += len;
+    return p->data;
+}
+
+static uint16
+ip_checksum(const uint8 *hdr, int len)
+{
+    uint32 sum = 0;
+    int i;
+    for (i = 0; i < len; i += 2) {
+        sum += (hdr[i] << 8) | hdr[i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return ~sum;
+}
+
+// broadcast from 10.10.10.10 to the csi port, as sent by the firmware
+void
+prepend_ethernet_ipv4_udp_header(struct sk_buff *p)
+{
+    struct ethernet_ip_udp_header *hdr = skb_push(p, sizeof(struct ethernet_ip_udp_header));
+    uint16 ip_len = p->len - sizeof(hdr->ethernet);
+    uint16 udp_len = ip_len - sizeof(hdr->ip);
+    memset(hdr, 0, sizeof(*hdr));
+    memset(hdr->ethernet, 0xff, 6);
+    memcpy(hdr->ethernet + 6, "\x4e\x45\x58\x4d\x4f\x4e", 6);
+    hdr->ethernet[12] = 0x08;
+    hdr->ip[0] = 0x45;
+    hdr->ip[2] = ip_len >> 8;
+    hdr->ip[3] = ip_len & 0xff;
+    hdr->ip[8] = 1;
+    hdr->ip[9] = 17;
+    memset(hdr->ip + 12, 10, 4);
+    memset(hdr->ip + 16, 0xff, 4);
+    uint16 sum = ip_checksum(hdr->ip, sizeof(hdr->ip));
+    hdr->ip[10] = sum >> 8;
+    hdr->ip[11] = sum & 0xff;
+    hdr->udp[0] = hdr->udp[2] = CSI_UDP_PORT >> 8;
+    hdr->udp[1] = hdr->udp[3] = CSI_UDP_PORT & 0xff;
+    hdr->udp[4] = udp_len >> 8;
+    hdr->udp[5] = udp_len & 0xff;
+}
+
+int
+fake_pcap_open(const char *path)
+{
+    // pcap file header: magic, version 2.4, no time zone, snaplen, ethernet
+    uint32 hdr[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1 };
+    pcap = fopen(path, "wb");
+    if (pcap == 0) {
+        return 0;
+    }
+    fwrite(hdr, sizeof(hdr), 1, pcap);
+    return 1;
+}
+
+void
+fake_pcap_close(void)
+{
+    if (pcap != 0) {
+        fclose(pcap);
+        pcap = 0;
+    }
+}
+
+static void
+pcap_write(struct sk_buff *p)
+{
+    uint64 ns = fake_time_ns();
+    uint32 rec[4] = { ns / 1000000000ull, (ns / 1000) % 1000000, p->len, p->len };
+    fwrite(rec, sizeof(rec), 1, pcap);
+    fwrite(p->data, p->len, 1, pcap);
+}
+
+void
+fake_pcap_write_udp(const void *payload, int len)
+{
+    struct sk_buff *p = pkt_buf_get_skb(0, sizeof(struct ethernet_ip_udp_header) + len);
+    if (p == 0) {
+        return;
+    }
+    fake_allocs--;
+    skb_pull(p, sizeof(struct ethernet_ip_udp_header));
+    memcpy(p->data, payload, len);
+    prepend_ethernet_ipv4_udp_header(p);
+    if (pcap != 0) {
+        pcap_write(p);
+    }
+    pkt_buf_free_skb(0, p, 0);
+}
+
+static int
+bus_xmit(struct hndrte_dev *src, struct hndrte_dev *dev, struct sk_buff *p)
+{
+    fake_sent++;
+    if (pcap != 0) {
+        pcap_write(p);
+    }
+    if (fake_xmit_hook != 0) {
+        fake_xmit_hook(p);
+    }
+    // the header was pulled and pushed again, so p is still the start of the allocation
+    pkt_buf_free_skb(0, p, 1);
+    return 0;
+}
+
+unsigned short
+get_chanspec(struct wlc_info *w)
+{
+    return fake_chanspec;
+}
+
+void
+wlc_phy_rssi_compute(struct phy_info *p, void *ctx)
+{
+    // rssi of struct wlc_d11rxhdr
+    ((int8 *) ctx)[0x1c] = -42;
+}
+
+void
+wlc_phyreg_enter(struct phy_info *p)
+{
+    fake_phyreg_enters++;
+}
+
+void
+wlc_phyreg_exit(struct phy_info *p)
+{
+}
+
+void
+wlc_phy_stay_in_carriersearch_acphy(struct phy_info *p, bool enable)
+{
+}
+
+void
+wlc_recv(struct wlc_info *w, struct sk_buff *p)
+{
+    fake_received++;
+    pkt_buf_free_skb(0, p, 0);
+}
+
+struct hndrte_timer *
+schedule_work(void *context, void *data, void *mainfn, int ms, int periodic)
+{
+    struct hndrte_timer *t;
+    if (n_timers == FAKE_MAX_TIMERS || (t = calloc(1, sizeof(*t))) == 0) {
+        return 0;
+    }
+    t->context = context;
+    t->data = data;
+    t->mainfn = mainfn;
+    t->interval = ms;
+    t->periodic = periodic;
+    t->set = 1;
+    timers[n_timers++] = t;
+    return t;
+}
+
+void
+hndrte_free_timer(struct hndrte_timer *t)
+{
+    free(t);
+}
+
+void
+fake_run_timers(void)
+{
+    int n = n_timers;
+    int i;
+    struct hndrte_timer *run[FAKE_MAX_TIMERS];
+    memcpy(run, timers, n * sizeof(run[0]));
+    n_timers = 0;
+    for (i = 0; i < n; i++) {
+        run[i]->mainfn(run[i]);
+    }
+}
+
+struct sk_buff *
+fake_rx_frame(uint16 len)
+{
+    struct sk_buff *p = pkt_buf_get_skb(0, HWRXOFF + len);
+    if (p != 0) {
+        memset(p->data, 0, p->len);
+        fake_allocs--;
+    }
+    return p;
+}
+
+void
+fake_csi_rx(uint16 csiconf, const uint32 *csi, int n_tones, const uint8 *src_mac, uint16 seq, uint16 fc)
+{
+    fake_csi_rx_chunks(csiconf, csi, n_tones, src_mac, seq, fc, 0, n_tones);
+}
+
+void
+fake_csi_rx_chunks(uint16 csiconf, const uint32 *csi, int n_tones, const uint8 *src_mac, uint16 seq, uint16 fc,
+    int first, int n)
+{
+    int chunks = (n_tones + TONES_PER_CHUNK - 1) / TONES_PER_CHUNK;
+    int c;
+    for (c = first; c < chunks && c < first + n; c++) {
+        int tones = n_tones - c * TONES_PER_CHUNK;
+        if (tones > TONES_PER_CHUNK) {
+            tones = TONES_PER_CHUNK;
+        }
+        if (fake_chunk_hook != 0) {
+            fake_chunk_hook(c);
+        }
+        struct sk_buff *p = fake_rx_frame(8 + tones * 4 + 10);
+        uint16 *hdr = p->data;
+        // RxFrameSize, NexmonExt, NexmonCSICfg, NexmonCSILen
+        hdr[0] = 2;
+        hdr[2] = (chunks - c) | ((csiconf & 0x3f) << 8) | (c == 0 ? NEWCSI : 0);
+        hdr[3] = tones;
+        memcpy(hdr + 4, csi + c * TONES_PER_CHUNK, tones * 4);
+        if (c == chunks - 1) {
+            uint8 *tail = (uint8 *) (hdr + 4) + tones * 4;
+            memcpy(tail, src_mac, 6);
+            memcpy(tail + 6, &seq, 2);
+            memcpy(tail + 8, &fc, 2);
+        }
+        process_frame_hook(p, p->data, fake_wlc_hw, 0);
+    }
+}
+
+void
+fake_fw_init(void)
+{
+    wlc.wl = &wl;
+    wlc.hw = &wlc_hw;
+    wlc.band = &band;
+    wlc_hw.wlc = &wlc;
+    wlc_hw.band = &band;
+    wlc_hw.up = 1;
+    wl.wlc = &wlc;
+    wl.dev = &wl_dev;
+    bus_funcs.xmit = bus_xmit;
+}
@@ -0,0 +1,76 @@
+#ifndef FAKE_FW_H
+#define FAKE_FW_H
+
+#include <structs.h>
+
+// phy of the fake firmware, every register access and every table access counts as one phy access
+#define FAKE_N_PHYREGS      0x1000
+#define FAKE_TBL44_LEN      0x100
+
+extern uint16 fake_phyreg[FAKE_N_PHYREGS];
+extern int8 fake_tbl44[FAKE_TBL44_LEN];
+extern uint32 fake_phy_accesses;
+extern uint32 fake_phy_access_ns;   /* busy wait of every phy access */
+extern uint16 fake_chanspec;        /* returned by get_chanspec */
+
+// gains applied by set_lna1_gain, set_lna2_gain and set_tia_gain
+extern uint8 fake_lna1_gain_id;
+extern uint8 fake_lna2_gain_id;
+extern uint8 fake_tia_gain_id;
+
+extern struct wlc_hw_info *fake_wlc_hw;
+extern struct wl_info *fake_wl;
+extern struct phy_info *fake_pi;
+
+extern uint32 fake_phyreg_enters;   /* calls of wlc_phyreg_enter */
+extern uint32 fake_received;        /* frames passed to wlc_recv */
+extern uint32 fake_sent;            /* frames passed to xmit */
+extern int fake_skbs;               /* buffers allocated and not freed */
+extern uint32 fake_allocs;          /* buffers allocated by the firmware, not by fake_rx_frame */
+
+// called with every frame passed to xmit before it is freed, data starts with the ethernet header
+extern void (*fake_xmit_hook)(struct sk_buff *p);
+
+void fake_fw_init(void);
+uint64 fake_time_ns(void);
+
+// runs the timers of schedule_work in the order they were started
+void fake_run_timers(void);
+
+// frames passed to xmit are also written to the pcap file until it is closed
+int fake_pcap_open(const char *path);
+void fake_pcap_close(void);
+// writes a udp frame to the csi port with this payload to the pcap file, e.g. the frame of an older firmware
+void fake_pcap_write_udp(const void *payload, int len);
+
+// received frame with an empty rx header of RXE_RXHDR_LEN * 2 + RXE_RXHDR_EXTRA bytes followed by len bytes
+struct sk_buff *fake_rx_frame(uint16 len);
+
+// passes the csi of one frame to process_frame_hook in chunks of up to 56 tones like the ucode,
+// a tone is 4 null bits, int14 real and int14 imag. the last chunk carries src_mac, seq and fc
+void fake_csi_rx(uint16 csiconf, const uint32 *csi, int n_tones, const uint8 *src_mac, uint16 seq, uint16 fc);
+
+// passes only the chunks first..first+n-1 of the same frame, e.g. to leave a frame incomplete
+void fake_csi_rx_chunks(uint16 csiconf, const uint32 *csi, int n_tones, const uint8 *src_mac, uint16 seq, uint16 fc,
+    int first, int n);
+
+// called by fake_csi_rx before every chunk
+extern void (*fake_chunk_hook)(int chunk);
+
+// firmware entry points that the tests drive
+struct wlc_d11rxhdr;
+void process_frame_hook(struct sk_buff *p, struct wlc_d11rxhdr *wlc_rxhdr, struct wlc_hw_info *wlc_hw, int tsf_l);
+void update_csi_filter(uint8 csi_collect, uint8 use_pkt_filter, uint8 first_pkt_byte, uint16 n_mac_addr, uint16 *src_mac);
+void configure_gain_types(struct phy_info *pi, uint8 mask, uint8 compact);
+void configure_tone_select(uint8 decimation, uint32 *null_mask);
+void configure_csi_format(uint8 packed14);
+void configure_csi_ext_header(uint8 enable);
+void configure_csi_batching(struct wl_info *wl, uint16 max_records, uint16 max_bytes, uint16 timeout_ms);
+void csi_pool_refill(struct osl_info *osh);
+void csi_pool_init(struct osl_info *osh);
+void configure_csi_pools(struct wl_info *wl, uint16 frame_pool_size, uint16 batch_pool_size);
+int get_csi_pool_stats(char *buf, int len);
+int get_csi_reassembly_stats(char *buf, int len);
+extern uint32 csi_slot_clock;
+
+#endif /*FAKE_FW_H*/
@@ -0,0 +1,121 @@
+// replays a mix of received frames through process_frame_hook with and without a transmitter filter.
+// half of the frames carry the 2 pad bytes of RXS_PBPRES, and only frames of one transmitter match
+// the filter. checks the number of gain snapshots and reports phy accesses and time per frame
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fake_fw.h"
+
+#define HWRXOFF             ((RXE_RXHDR_LEN * 2) + RXE_RXHDR_EXTRA)
+#define RXS_PBPRES          0x0004
+#define PLCP_HDR_LEN        6
+#define FRAME_LEN           (2 + PLCP_HDR_LEN + 64)
+#define N_FRAMES            4096
+#define N_TRANSMITTERS      8
+#define ROUNDS              8
+
+struct rx_frame {
+    uint8 data[HWRXOFF + FRAME_LEN];
+    uint16 len;
+    int matches;                    /* carries the first pkt byte and the transmitter of the filter */
+};
+
+static struct rx_frame frames[N_FRAMES];
+static const uint8 first_pkt_byte = 0x88;
+
+static void
+transmitter(int n, uint8 *mac)
+{
+    static const uint8 base[6] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x00};
+    memcpy(mac, base, sizeof(base));
+    mac[5] = n;
+}
+
+static void
+build_frames(void)
+{
+    int i;
+    for (i = 0; i < N_FRAMES; i++) {
+        struct rx_frame *f = &frames[i];
+        int pad = (rand() & 1) ? 2 : 0;
+        int tx = rand() % N_TRANSMITTERS;
+        uint8 fc = (rand() % 4) ? first_pkt_byte : 0x80;
+        memset(f->data, 0, sizeof(f->data));
+        f->len = HWRXOFF + FRAME_LEN - 2 + pad;
+        // RxFrameSize, RxStatus1
+        *(uint16 *) f->data = f->len - HWRXOFF;
+        *(uint16 *) (f->data + 0x10) = pad ? RXS_PBPRES : 0;
+        uint8 *frm = f->data + HWRXOFF + pad + PLCP_HDR_LEN;
+        frm[0] = fc;
+        transmitter(tx, frm + 10);
+        f->matches = fc == first_pkt_byte && tx == 0;
+    }
+}
+
+static void
+set_filter(int n_mac_addr)
+{
+    uint16 src_mac[4][3];
+    uint8 mac[6];
+    memset(src_mac, 0, sizeof(src_mac));
+    transmitter(0, mac);
+    src_mac[0][0] = mac[0] | (mac[1] << 8);
+    src_mac[0][1] = mac[2] | (mac[3] << 8);
+    src_mac[0][2] = mac[4] | (mac[5] << 8);
+    update_csi_filter(1, n_mac_addr > 0, first_pkt_byte, n_mac_addr, &src_mac[0][0]);
+}
+
+// returns 1 if the number of gain snapshots is the expected one
+static int
+replay(const char *name, int expected)
+{
+    uint32 snapshots = fake_phyreg_enters;
+    uint32 accesses = fake_phy_accesses;
+    uint64 start = fake_time_ns();
+    int r, i;
+    for (r = 0; r < ROUNDS; r++) {
+        for (i = 0; i < N_FRAMES; i++) {
+            struct sk_buff *p = fake_rx_frame(frames[i].len - HWRXOFF);
+            memcpy(p->data, frames[i].data, frames[i].len);
+            process_frame_hook(p, p->data, fake_wlc_hw, r * N_FRAMES + i);
+        }
+    }
+    uint64 ns = fake_time_ns() - start;
+    snapshots = (fake_phyreg_enters - snapshots) / ROUNDS;
+    accesses = fake_phy_accesses - accesses;
+    printf("%-12s %6u of %d frames read gains, %6.2f phy accesses/frame, %8.1f ns/frame%s\n", name, snapshots, N_FRAMES,
+        (double) accesses / (ROUNDS * N_FRAMES), (double) ns / (ROUNDS * N_FRAMES),
+        snapshots == expected ? "" : "  WRONG");
+    return snapshots == expected;
+}
+
+int
+main(int argc, char **argv)
+{
+    int ok = 1;
+    int matches = 0;
+    int i;
+
+    // cost of one phy register or table access, a few hundred ns on the chip
+    fake_phy_access_ns = argc > 1 ? atoi(argv[1]) : 200;
+
+    srand(3);
+    fake_fw_init();
+    build_frames();
+    for (i = 0; i < N_FRAMES; i++) {
+        matches += frames[i].matches;
+    }
+    configure_gain_types(fake_pi, 0x3f, 0);
+    printf("%d frames, %d of them from the filtered transmitter, %u ns per phy access\n", N_FRAMES, matches, fake_phy_access_ns);
+
+    update_csi_filter(1, 0, 0, 0, (uint16 [12]) {0});
+    ok &= replay("no filter", N_FRAMES);
+    set_filter(1);
+    ok &= replay("mac filter", matches);
+    update_csi_filter(0, 0, 0, 0, (uint16 [12]) {0});
+    ok &= replay("csi off", 0);
+
+    printf("%s\n", ok ? "passed" : "FAILED");
+    return !ok;
+}
@@ -0,0 +1,17 @@
+#ifndef FIRMWARE_VERSION_H
+#define FIRMWARE_VERSION_H
+
+// chip and firmware ids of the nexmon framework, only compared with each other on the host
+#define CHIP_VER_ALL                        0
+#define CHIP_VER_BCM4339                    1
+#define CHIP_VER_BCM43455c0                 2
+#define CHIP_VER_BCM4358                    3
+#define CHIP_VER_BCM4366c0                  4
+
+#define FW_VER_ALL                          0
+#define FW_VER_6_37_32_RC23_34_43_r639704   1
+#define FW_VER_7_45_189                     2
+#define FW_VER_7_112_300_14                 3
+#define FW_VER_10_10_122_20                 4
+
+#endif /*FIRMWARE_VERSION_H*/
@@ -0,0 +1,215 @@
+// compares the gains process_frame_hook reports from the cached copy of phy table 0x44 with the
+// uncached get_rx_gains of the original firmware, also across channel changes that reload the table
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <local_wrapper.h>
+#include "fake_fw.h"
+
+#define N_GAIN_TYPES    6
+#define N_FRAMES        20000
+#define RX_FRAME_LEN    64
+
+static const uint8 gain_types[N_GAIN_TYPES] = {1, 2, 3, 4, 9, 10};
+
+extern int8 last_elna_gain[6];
+extern int8 last_lna1_gain[6];
+extern int8 last_lna2_gain[6];
+extern int8 last_mix_gain[6];
+extern int8 last_lpf0_gain[6];
+extern int8 last_lpf1_gain[6];
+extern int8 last_dvga_gain[6];
+extern int8 last_tr_loss[6];
+void invalidate_gain_table_cache(void);
+
+struct gains {
+    int8 elna, lna1, lna2, mix, lpf0, lpf1, dvga, tr_loss;
+};
+
+// get_rx_gains as it was before the cache, reading table 0x44 for every lookup
+static void
+get_rx_gains_uncached(struct phy_info *pi, uint8 gain_type, struct gains *g)
+{
+    uint16 code_A = 0;
+    uint16 code_B = 0;
+
+    if (gain_type == 4) {
+        code_A = phy_utils_read_phyreg(pi, 0x6e2);
+        code_B = phy_utils_read_phyreg(pi, 0x6e3);
+    } else if (gain_type == 3) {
+        code_A = phy_utils_read_phyreg(pi, 0x6e0);
+        code_B = phy_utils_read_phyreg(pi, 0x6e1);
+    } else if (gain_type == 2) {
+        code_A = phy_utils_read_phyreg(pi, 0x6de);
+        code_B = phy_utils_read_phyreg(pi, 0x6df);
+    } else if (gain_type == 1) {
+        code_A = phy_utils_read_phyreg(pi, 0x6dc);
+        code_B = phy_utils_read_phyreg(pi, 0x6dd);
+    } else if (gain_type == 9) {
+        code_A = 0x16a;
+        code_B = 0x554;
+    } else if (gain_type == 10) {
+        code_A = phy_utils_read_phyreg(pi, 0x692);
+        code_A = (code_A & 0x7fff) << 1;
+        code_B = phy_utils_read_phyreg(pi, 0x691);
+        code_B = ((0xffff000 & (code_B << 10)) & 0xf378) | ((code_B & 1) << 3) | ((code_A >> 0xe) << 8) | ((code_A >> 7) & 0x70);
+    }
+
+    uint8 lna1Byp = (code_B >> 1) & 1;
+    if (lna1Byp != 0) {
+        uint8 lna1BypEn = phy_utils_read_phyreg(pi, 0x6fa);
+        if ((lna1BypEn & 1) == 0) {
+            lna1Byp = 0;
+        }
+    }
+
+    uint8 lna1_code = 0;
+    if (lna1Byp == 0) {
+        lna1_code = (code_A >> 1) & 7;
+    } else {
+        uint8 lna1BypVals = phy_utils_read_phyreg(pi, 0x6fa);
+        lna1_code = (lna1BypVals & 0xe) >> 1;
+    }
+
+    uint8 lna2_code = (code_A >> 4) & 7;
+    uint8 mix_code = (code_A >> 7) & 0xf;
+    uint8 lpf0_code = (code_B >> 4) & 7;
+    uint8 lpf1_code = (code_B >> 8) & 7;
+    uint8 dvga_code = (code_B >> 0xc) & 0xf;
+
+    wlc_phy_table_read_acphy_rp(pi, 0x44, 1, (0x0 + (code_A & 0x1)), 8, &g->elna);
+    if (lna1Byp == 0) {
+        wlc_phy_table_read_acphy_rp(pi, 0x44, 1, (0x8 + lna1_code), 8, &g->lna1);
+    } else {
+        uint8 lna1BypVals = phy_utils_read_phyreg(pi, 0x6fa);
+        g->lna1 = (lna1BypVals >> 4) & 0xff;
+    }
+    g->lna2 = lna2_code;
+    wlc_phy_table_read_acphy_rp(pi, 0x44, 1, (0x20 + mix_code), 8, &g->mix);
+    g->lpf0 = lpf0_code * 3;
+    if (gain_type < 10) {
+        g->lpf1 = lpf1_code * 3;
+    } else {
+        wlc_phy_table_read_acphy_rp(pi, 0x44, 1, (0x70 + lpf1_code), 8, &g->lpf1);
+    }
+    g->dvga = dvga_code * 3;
+    if (gain_type == 4) {
+        g->tr_loss = phy_utils_read_phyreg(pi, 0x6f9);
+    } else {
+        g->tr_loss = phy_utils_read_phyreg(pi, 0x289);
+    }
+    g->tr_loss &= 0x7f;
+}
+
+static void
+randomize_gain_regs(void)
+{
+    static const uint16 regs[] = {0x6dc, 0x6dd, 0x6de, 0x6df, 0x6e0, 0x6e1, 0x6e2, 0x6e3, 0x691, 0x692, 0x6f9, 0x289, 0x3b3};
+    int i;
+    for (i = 0; i < sizeof(regs) / sizeof(regs[0]); i++) {
+        fake_phyreg[regs[i]] = rand() & 0xffff;
+    }
+    // lna1 bypass enabled in half of the frames
+    fake_phyreg[0x6fa] = rand() & 0xff;
+}
+
+static void
+reload_gain_table(void)
+{
+    int i;
+    for (i = 0; i < FAKE_TBL44_LEN; i++) {
+        fake_tbl44[i] = (rand() % 64) - 16;
+    }
+}
+
+static void
+receive_frame(uint32 tsf)
+{
+    struct sk_buff *p = fake_rx_frame(RX_FRAME_LEN);
+    *(uint16 *) p->data = RX_FRAME_LEN;
+    process_frame_hook(p, p->data, fake_wlc_hw, tsf);
+}
+
+// number of gain types whose reported gains differ from the uncached lookup
+static int
+compare_gains(void)
+{
+    int mismatches = 0;
+    int i;
+    for (i = 0; i < N_GAIN_TYPES; i++) {
+        struct gains g;
+        get_rx_gains_uncached(fake_pi, gain_types[i], &g);
+        if (g.elna != last_elna_gain[i] || g.lna1 != last_lna1_gain[i] || g.lna2 != last_lna2_gain[i]
+                || g.mix != last_mix_gain[i] || g.lpf0 != last_lpf0_gain[i] || g.lpf1 != last_lpf1_gain[i]
+                || g.dvga != last_dvga_gain[i] || g.tr_loss != last_tr_loss[i]) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+int
+main(void)
+{
+    uint16 src_mac[12] = {0};
+    int failed = 0;
+    int mismatches = 0;
+    int channel_changes = 0;
+    int i;
+
+    srand(1);
+    fake_fw_init();
+    reload_gain_table();
+    update_csi_filter(1, 0, 0, 0, src_mac);
+    configure_gain_types(fake_pi, 0x3f, 0);
+
+    // the firmware reloads table 0x44 on every channel change
+    for (i = 0; i < N_FRAMES; i++) {
+        if (rand() % 50 == 0) {
+            fake_chanspec = (fake_chanspec & 0xff00) | ((fake_chanspec + 4) & 0xff);
+            reload_gain_table();
+            channel_changes++;
+        }
+        randomize_gain_regs();
+        receive_frame(i);
+        mismatches += compare_gains();
+    }
+    printf("channel changes: %d frames, %d channel changes, %d mismatches\n", N_FRAMES, channel_changes, mismatches);
+    failed |= mismatches != 0;
+
+    // ioctl 500 can reload the table without changing the channel
+    reload_gain_table();
+    invalidate_gain_table_cache();
+    randomize_gain_regs();
+    receive_frame(N_FRAMES);
+    mismatches = compare_gains();
+    printf("invalidated: %d mismatches\n", mismatches);
+    failed |= mismatches != 0;
+
+    // without a channel change or invalidation the stale copy has to show, or the test proves nothing
+    reload_gain_table();
+    mismatches = 0;
+    for (i = 0; i < 100; i++) {
+        randomize_gain_regs();
+        receive_frame(N_FRAMES + 1 + i);
+        mismatches += compare_gains();
+    }
+    printf("stale copy: %d mismatches (expected > 0)\n", mismatches);
+    failed |= mismatches == 0;
+
+    // phy accesses of the gain lookups per frame, cached and uncached
+    uint32 start = fake_phy_accesses;
+    receive_frame(N_FRAMES + 200);
+    uint32 cached = fake_phy_accesses - start;
+    start = fake_phy_accesses;
+    compare_gains();
+    printf("phy accesses per frame: %u cached, %u uncached\n", cached, fake_phy_accesses - start);
+
+    if (fake_skbs != 0) {
+        printf("%d buffers leaked\n", fake_skbs);
+        failed = 1;
+    }
+    printf("%s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
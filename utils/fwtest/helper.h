@@ -0,0 +1,7 @@
+#ifndef HELPER_H
+#define HELPER_H
+
+// the timer runs when the test calls fake_run_timers
+struct hndrte_timer *schedule_work(void *context, void *data, void *mainfn, int ms, int periodic);
+
+#endif /*HELPER_H*/
@@ -0,0 +1,10 @@
+#ifndef LOCAL_WRAPPER_H
+#define LOCAL_WRAPPER_H
+
+// same prototypes as src/local_wrapper.c, implemented by the fake phy in fake_fw.c
+int phy_utils_read_phyreg(void *pi, int addr);
+void phy_utils_mod_phyreg(void *pi, unsigned short addr, unsigned short mask, unsigned short val);
+void wlc_phy_table_read_acphy_rp(void *pi, unsigned int id, unsigned int len, unsigned int offset, unsigned int width, void *data);
+void wlc_phy_table_write_acphy_rp(void *pi, unsigned int id, unsigned int len, unsigned int offset, unsigned int width, const void *data);
+
+#endif /*LOCAL_WRAPPER_H*/
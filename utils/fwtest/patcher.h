@@ -0,0 +1,11 @@
+#ifndef PATCHER_H
+#define PATCHER_H
+
+// nothing is patched on the host, the patches become unused variables and the arm hooks lose their asm
+#define GenericPatch1(name, val)    unsigned char name##_patch = (val);
+#define GenericPatch2(name, val)    unsigned short name##_patch = (val);
+#define GenericPatch4(name, val)    unsigned int name##_patch = (val);
+#define BPatch(name, func)          unsigned int name##_patch = (func);
+#define asm(...)
+
+#endif /*PATCHER_H*/
@@ -0,0 +1,113 @@
+// checks that sending csi frames and batches takes buffers from the pools without allocating in the
+// receive path, and that the timer refills the pools after the buffers were sent
+
+#include <stdio.h>
+#include <string.h>
+#include "fake_fw.h"
+
+#define N_TONES         64
+#define N_BURSTS        50
+
+struct csi_pool_stats {
+    uint16 size;
+    uint16 free;
+    uint16 high_water;
+    uint16 PAD;
+    uint32 exhausted;
+    uint32 alloc_failures;
+    uint32 refill_failures;
+} __attribute__((packed));
+
+static uint32 csi[N_TONES];
+static const uint8 src_mac[6] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+static int failed = 0;
+
+static void
+check(int ok, const char *what)
+{
+    printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+    failed |= !ok;
+}
+
+// receives bursts of frames without running the timers in between and returns the allocations of the firmware
+static uint32
+receive_bursts(int frames_per_burst)
+{
+    uint32 allocs = 0;
+    int b, f;
+    for (b = 0; b < N_BURSTS; b++) {
+        uint32 start = fake_allocs;
+        for (f = 0; f < frames_per_burst; f++) {
+            fake_csi_rx(0, csi, N_TONES, src_mac, b * frames_per_burst + f, 0x88);
+        }
+        allocs += fake_allocs - start;
+        fake_run_timers();
+    }
+    return allocs;
+}
+
+int
+main(void)
+{
+    struct csi_pool_stats stats[2];
+    uint32 sent;
+    int i;
+
+    fake_fw_init();
+    for (i = 0; i < N_TONES; i++) {
+        csi[i] = (i << 14) | i;
+    }
+
+    // the first ioctl fills the frame pool
+    csi_pool_init(fake_wlc_hw->wlc->osh);
+    get_csi_pool_stats((char *) stats, sizeof(stats));
+    check(stats[0].free == stats[0].size && stats[0].size >= 16, "frame pool is filled at init");
+    check(stats[1].size == 0, "no batch pool while batching is off");
+
+    sent = fake_sent;
+    check(receive_bursts(stats[0].size) == 0, "single frames: no allocation while receiving");
+    check(fake_sent - sent == N_BURSTS * stats[0].size, "single frames: all frames sent");
+    get_csi_pool_stats((char *) stats, sizeof(stats));
+    check(stats[0].free == stats[0].size && stats[0].exhausted == 0, "single frames: the timer refilled the pool");
+
+    // ioctl 506 sizes the batch pool, 4 frames per batch
+    configure_csi_batching(fake_wl, 4, 4096, 10);
+    get_csi_pool_stats((char *) stats, sizeof(stats));
+    check(stats[1].size > 0 && stats[1].free == stats[1].size, "batch pool is filled");
+
+    sent = fake_sent;
+    check(receive_bursts(4 * stats[1].size) == 0, "batches: no allocation while receiving");
+    check(fake_sent - sent == N_BURSTS * stats[1].size, "batches: all batches sent");
+    get_csi_pool_stats((char *) stats, sizeof(stats));
+    check(stats[1].free == stats[1].size && stats[1].exhausted == 0 && stats[1].high_water == stats[1].size,
+        "batches: the timer refilled the batch pool");
+
+    // the timeout sends an incomplete batch
+    sent = fake_sent;
+    fake_csi_rx(0, csi, N_TONES, src_mac, 0, 0x88);
+    fake_run_timers();
+    check(fake_sent - sent == 1, "batches: the timeout sent an incomplete batch");
+    fake_run_timers();
+
+    configure_csi_batching(fake_wl, 0, 0, 0);
+    get_csi_pool_stats((char *) stats, sizeof(stats));
+    check(stats[1].size == 0 && fake_skbs == stats[0].size, "batch pool is freed when batching is turned off");
+
+    // ioctl 513: a larger frame pool takes longer bursts without allocating
+    configure_csi_pools(fake_wl, 48, 4);
+    get_csi_pool_stats((char *) stats, sizeof(stats));
+    check(stats[0].size == 48 && stats[0].free == 48, "ioctl 513 resizes the frame pool");
+    sent = fake_sent;
+    check(receive_bursts(44) == 0, "resized pool: bursts of 44 frames without allocation");
+    get_csi_pool_stats((char *) stats, sizeof(stats));
+    check(stats[0].exhausted == 0 && fake_sent - sent == N_BURSTS * 44, "resized pool: never exhausted");
+    configure_csi_pools(fake_wl, 1000, 4);
+    get_csi_pool_stats((char *) stats, sizeof(stats));
+    check(stats[0].size == 64, "pool size is limited to 64");
+
+    // a short buffer only gets the frame pool stats
+    check(get_csi_pool_stats((char *) stats, sizeof(stats[0]) + 4) == sizeof(stats[0]), "short buffer gets the frame pool stats only");
+
+    printf("%s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
@@ -0,0 +1,44 @@
+# replays the pcap written by roundtrip_test with csicapture -r into a shared memory ring and compares every
+# column of the ring with CSIDataPcapNativeReader
+# usage: python3 replay_check.py <pcap file> [shm name]
+
+import os
+import subprocess
+import sys
+
+import numpy as np
+
+PCAP_READING = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "pcap_reading")
+sys.path.insert(0, PCAP_READING)
+from read_pcap import CSIDataPcapNativeReader, CSIRingReader
+
+
+def main():
+    pcap_file = sys.argv[1]
+    shm_name = sys.argv[2] if len(sys.argv) > 2 else "/csitest"
+
+    subprocess.run([os.path.join(PCAP_READING, "csicapture"), "-r", pcap_file, "-s", shm_name], check=True)
+    try:
+        ring = CSIRingReader(shm_name, from_start=True).poll()
+    finally:
+        os.unlink("/dev/shm/" + shm_name.lstrip("/"))
+    expected = CSIDataPcapNativeReader(pcap_file).read()
+
+    ok = ring is not None and len(ring["seq_cnt"]) == len(expected["seq_cnt"])
+    if not ok:
+        print("%d of %d frames in the ring" % (0 if ring is None else len(ring["seq_cnt"]), len(expected["seq_cnt"])))
+    else:
+        for name in CSIRingReader.COLUMNS + ["csi_raw"]:
+            if name == "csi" or name not in expected:
+                continue
+            # the ring always has 256 tones, the reader as many as the widest frame
+            decoded = ring[name][:, :expected[name].shape[1]] if name == "csi_raw" else ring[name]
+            if not np.array_equal(decoded, expected[name]):
+                print("%-16s differs" % name)
+                ok = False
+    print("replay   %d frames %s" % (len(expected["seq_cnt"]), "ok" if ok else "FAILED"))
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
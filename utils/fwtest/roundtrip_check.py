@@ -0,0 +1,84 @@
+# decodes the pcap written by roundtrip_test with the python and the native reader of pcap_reading,
+# compares every tone with the values roundtrip_test sent and the headers of both readers frame by frame
+# usage: python3 roundtrip_check.py <pcap file> <expected values file>
+
+import os
+import sys
+
+import numpy as np
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "pcap_reading"))
+from read_pcap import CSIDataPcap, CSIDataPcapFrame, CSIDataPcapReader, CSIDataPcapNativeReader
+
+LEGACY_VERSIONS = (CSIDataPcapReader.CSI_TOOL_VERSION_INCLUDE_RSSI, CSIDataPcapReader.CSI_TOOL_VERSION_TEST_PHYSTATUS,
+                   CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY)
+
+
+def compare(name, decoded, expected, n_frames):
+    # decoded has one row of complex values per frame with the tones at their fft index, unsent tones are 0
+    ok = decoded.shape[0] == n_frames
+    if not ok:
+        print("%-8s %d of %d frames decoded" % (name, decoded.shape[0], n_frames))
+    sent = np.zeros(decoded.shape, dtype=bool)
+    for frame, tone, real, imag in expected:
+        sent[frame, tone] = True
+        if decoded[frame, tone] != complex(real, imag):
+            print("%-8s frame %d tone %d: %s instead of %d%+dj" % (name, frame, tone, decoded[frame, tone], real, imag))
+            ok = False
+    if np.any(decoded[~sent] != 0):
+        print("%-8s values on tones that were not sent" % name)
+        ok = False
+    print("%-8s %d frames, %d tones %s" % (name, decoded.shape[0], len(expected), "ok" if ok else "FAILED"))
+    return ok
+
+
+def agree(df, cols):
+    # the header fields both readers decode are equal in every frame, fields the python reader leaves out are NaN
+    ok = len(df) == len(cols["flags"])
+    for i in range(len(df) if ok else 0):
+        row = df.iloc[i]
+        version = int(row["csiToolVer"].real)
+        bw = cols["chanspec"][i] & CSIDataPcapFrame.CHANSPEC_BW_MASK
+        same = row["bandwidth"] == CSIDataPcapFrame.BANDWIDTH_BY_CHANSPEC_BW.get(bw)
+        same &= bool(cols["flags"][i] & CSIDataPcap.CSI_FLAG_LEGACY) == (version in LEGACY_VERSIONS)
+        same &= bool(cols["flags"][i] & CSIDataPcap.CSI_FLAG_LEGACY_PHYSTATUS) == (
+            version == CSIDataPcapReader.CSI_TOOL_VERSION_TEST_PHYSTATUS)
+        if not np.isnan(row["RSSI"]):
+            same &= row["RSSI"] == cols["rssi"][i]
+        if not np.isnan(row["agcGain"]):
+            same &= row["agcGain"] == cols["agc_gain"][i]
+        for s, name in enumerate(CSIDataPcapFrame.GAIN_RECORD_FIELDS):
+            if version == CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY:
+                same &= row[name] == cols["gains"][i, s, 5]
+            elif version == CSIDataPcapReader.CSI_TOOL_VERSION_GAIN_RECOVERY_V2:
+                for t, ext in enumerate(CSIDataPcap.GAIN_RECOVERY_V2_COLUMN_NAME_EXT):
+                    same &= row[name + ext] == cols["gains"][i, s, t]
+        if not same:
+            print("agree    frame %d (version %d, %s MHz) differs" % (i, version, row["bandwidth"]))
+            ok = False
+    versions = sorted(set(int(v.real) for v in df["csiToolVer"]))
+    print("agree    %d frames of versions %s %s" % (len(df), versions, "ok" if ok else "FAILED"))
+    return ok
+
+
+def main():
+    pcap_file, expected_file = sys.argv[1:3]
+    expected = np.loadtxt(expected_file, dtype=int, ndmin=2)
+    n_frames = expected[:, 0].max() + 1
+
+    # frames of all bandwidths and tool versions in one capture, bandwidth and format are detected per frame
+    df = CSIDataPcapReader(pcap_file).get_data_frame()
+    tones = df[[c for c in df.columns if isinstance(c, (int, np.integer))]].to_numpy(dtype=complex)
+    ok = compare("python", np.nan_to_num(tones, nan=0), expected, n_frames)
+
+    cols = CSIDataPcapNativeReader(pcap_file).read()
+    raw = cols["csi_raw"]
+    ok &= compare("native", raw[:, :, 0] + 1j * raw[:, :, 1].astype(complex), expected, n_frames)
+    ok &= agree(df, cols)
+
+    print("passed" if ok else "FAILED")
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
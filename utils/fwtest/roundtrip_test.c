@@ -0,0 +1,219 @@
+// sends csi of known values through the firmware with packed int14 values (ioctl 510) into a pcap file
+// and writes the values every frame has to decode to, one "frame tone real imag" line per tone.
+// between them it writes frames with the 18, 22 and 30 byte headers of older tool versions, so the
+// capture mixes bandwidths and formats. roundtrip_check.py decodes the pcap with the python and the
+// native reader and compares. the padding after the packed values is checked here
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fake_fw.h"
+
+#define UDP_HEADER_LEN      42
+#define FRAME_HEADER_LEN    70
+#define TONE_DESC_LEN       36
+#define FLAG_TONE_SELECT    0x01
+#define FLAG_PACKED14       0x02
+
+struct roundtrip_case {
+    const char *name;
+    uint16 chanspec;
+    uint16 n_tones;                 /* tones of the bandwidth */
+    uint8 decimation;               /* every n-th tone that is not null is sent */
+    uint8 n_null;                   /* tones 0..n_null-1 and the last one are never sent */
+};
+
+static const struct roundtrip_case cases[] = {
+    { "20 MHz, 64 tones", 0x1006, 64, 1, 0 },
+    { "20 MHz, 57 tones", 0x1006, 64, 1, 6 },
+    { "20 MHz, decimation 5, 13 tones", 0x1006, 64, 5, 0 },
+    { "40 MHz, decimation 3, 41 tones", 0xd826, 128, 3, 5 },
+    { "80 MHz, 245 tones", 0xe02a, 256, 1, 10 },
+    { "80 MHz, 256 tones", 0xe02a, 256, 1, 0 },
+};
+#define N_CASES (sizeof(cases) / sizeof(cases[0]))
+#define ROUNDS  4
+
+// header lengths of CSI_TOOL_VERSION_INCLUDE_RSSI, _TEST_PHYSTATUS and _GAIN_RECOVERY, followed by int16 csi
+static const int legacy_hdr_lens[] = {18, 22, 30};
+#define N_LEGACY (sizeof(legacy_hdr_lens) / sizeof(legacy_hdr_lens[0]))
+// chanspec and tones of 20, 40 and 80 MHz
+static const uint16 bandwidths[3][2] = {
+    {0x1006, 64},
+    {0xd826, 128},
+    {0xe02a, 256},
+};
+
+// alternating transmitters, for the source mac index of the archive
+static const uint8 src_macs[2][6] = {
+    {0x00, 0x11, 0x22, 0x33, 0x44, 0x55},
+    {0x00, 0x11, 0x22, 0x33, 0x44, 0x66},
+};
+static FILE *expected;
+static int frames = 0;
+static int failed = 0;
+
+static int16 values[256][2];
+static uint32 null_mask[8];
+static uint8 tone_sent[256];
+
+// the packed values end with zeros up to the next word
+static void
+check_padding(struct sk_buff *p)
+{
+    const uint8 *frm = (const uint8 *) p->data + UDP_HEADER_LEN;
+    int len = p->len - UDP_HEADER_LEN;
+    uint16 flags, n;
+    int hdr_len = FRAME_HEADER_LEN;
+    int i;
+
+    memcpy(&flags, frm + FRAME_HEADER_LEN - 2, 2);
+    if (!(flags & FLAG_PACKED14)) {
+        printf("frame %d: not packed\n", frames);
+        failed = 1;
+        return;
+    }
+    if (flags & FLAG_TONE_SELECT) {
+        memcpy(&n, frm + FRAME_HEADER_LEN + 2, 2);
+        hdr_len += TONE_DESC_LEN;
+    } else {
+        n = cases[frames % N_CASES].n_tones;
+    }
+    int packed_len = (n * 7 + 1) >> 1;
+    if (len != hdr_len + ((packed_len + 3) & ~3)) {
+        printf("frame %d: %d bytes for %d tones\n", frames, len, n);
+        failed = 1;
+        return;
+    }
+    for (i = hdr_len + packed_len; i < len; i++) {
+        if (frm[i] != 0) {
+            printf("frame %d: padding byte %d after %d tones is 0x%02x\n", frames, i - hdr_len - packed_len, n, frm[i]);
+            failed = 1;
+        }
+    }
+    frames++;
+}
+
+static void
+send_case(const struct roundtrip_case *c, int frame)
+{
+    uint32 csi[256];
+    int t, n = 0;
+
+    static const int16 extremes[] = {8191, -8191, -8192, 0, 1, -1};
+    memset(null_mask, 0, sizeof(null_mask));
+    for (t = 0; t < c->n_null; t++) {
+        null_mask[t >> 5] |= 1u << (t & 31);
+    }
+    if (c->n_null) {
+        null_mask[(c->n_tones - 1) >> 5] |= 1u << ((c->n_tones - 1) & 31);
+    }
+    configure_tone_select(c->decimation, null_mask);
+    // same selection as configure_tone_select
+    for (t = 0; t < c->n_tones; t++) {
+        int null = null_mask[t >> 5] & (1u << (t & 31));
+        tone_sent[t] = !null && (n++ % c->decimation) == 0;
+    }
+    // the extremes of int14 on the first tones that are sent, random values on the others
+    for (t = 0, n = 0; t < c->n_tones; t++) {
+        if (tone_sent[t] && n < 3) {
+            values[t][0] = extremes[2 * n];
+            values[t][1] = extremes[2 * n + 1];
+            n++;
+        } else {
+            values[t][0] = (rand() % 16384) - 8192;
+            values[t][1] = (rand() % 16384) - 8192;
+        }
+        csi[t] = ((values[t][0] & 0x3fff) << 14) | (values[t][1] & 0x3fff);
+    }
+    fake_chanspec = c->chanspec;
+    fake_csi_rx(0, csi, c->n_tones, src_macs[frame % 2], frame, 0x88);
+    for (t = 0; t < c->n_tones; t++) {
+        if (tone_sent[t]) {
+            fprintf(expected, "%d %d %d %d\n", frame, t, values[t][0], values[t][1]);
+        }
+    }
+}
+
+static void
+send_legacy(int hdr_len, const uint16 *bandwidth, int frame)
+{
+    uint8 frm[30 + 256 * 4];
+    uint16 seq = frame, csiconf = 0, chip = 0x4345;
+    int16 agc_gain = -17 - frame;
+    int8 rssi = -40 - frame % 20;
+    int i;
+
+    memset(frm, 0, hdr_len);
+    // magic, rssi, fc, src mac, seq, csiconf, chanspec, chip
+    frm[0] = 0x11;
+    frm[1] = 0x11;
+    frm[2] = rssi;
+    frm[3] = 0x88;
+    memcpy(frm + 4, src_macs[frame % 2], 6);
+    memcpy(frm + 10, &seq, 2);
+    memcpy(frm + 12, &csiconf, 2);
+    memcpy(frm + 14, &bandwidth[0], 2);
+    memcpy(frm + 16, &chip, 2);
+    if (hdr_len == 22) {
+        // the phystatus bytes of CSI_TOOL_VERSION_TEST_PHYSTATUS
+        for (i = 18; i < 22; i++) {
+            frm[i] = rand();
+        }
+    } else if (hdr_len == 30) {
+        // 8 gain stages of gain_type 10 and the agc gain
+        for (i = 18; i < 26; i++) {
+            frm[i] = rand() % 40;
+        }
+        memcpy(frm + 26, &agc_gain, 2);
+    }
+    for (i = 0; i < bandwidth[1]; i++) {
+        int16 v[2] = { (rand() % 16384) - 8192, (rand() % 16384) - 8192 };
+        memcpy(frm + hdr_len + i * 4, v, 4);
+        fprintf(expected, "%d %d %d %d\n", frame, i, v[0], v[1]);
+    }
+    fake_pcap_write_udp(frm, hdr_len + bandwidth[1] * 4);
+}
+
+int
+main(int argc, char **argv)
+{
+    int r, i, written = 0;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: roundtrip_test <pcap file> <expected values file>\n");
+        return 2;
+    }
+    expected = fopen(argv[2], "w");
+    if (expected == 0 || !fake_pcap_open(argv[1])) {
+        fprintf(stderr, "cannot write %s or %s\n", argv[1], argv[2]);
+        return 2;
+    }
+
+    srand(8);
+    fake_fw_init();
+    csi_pool_refill(fake_wlc_hw->wlc->osh);
+    configure_csi_format(1);
+    fake_xmit_hook = check_padding;
+
+    for (r = 0; r < ROUNDS; r++) {
+        for (i = 0; i < N_CASES; i++) {
+            send_case(&cases[i], written++);
+            // the timer refills the pool with buffers that held older frames
+            fake_run_timers();
+            // every older header with every bandwidth within three rounds
+            if (i < N_LEGACY) {
+                send_legacy(legacy_hdr_lens[i], bandwidths[(r + i) % 3], written++);
+            }
+        }
+    }
+    fake_pcap_close();
+    fclose(expected);
+
+    if (frames != ROUNDS * N_CASES) {
+        printf("%d of %d frames sent\n", frames, (int) (ROUNDS * N_CASES));
+        failed = 1;
+    }
+    printf("%d frames, padding %s\n", frames, failed ? "FAILED" : "passed");
+    return failed;
+}
@@ -0,0 +1,64 @@
+// opens more incomplete csi frames than there are reassembly slots while the slot clock wraps and
+// checks that the frame that was created first is the one that is evicted
+
+#include <stdio.h>
+#include <string.h>
+#include "fake_fw.h"
+
+#define UDP_HEADER_LEN      42
+#define CSICONF_OFFSET      12
+#define N_SLOTS             4
+#define N_TONES             256
+
+static uint32 csi[N_TONES];
+static const uint8 src_mac[6] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+static int sent[N_SLOTS + 1];
+static int failed = 0;
+
+static void
+count_sent(struct sk_buff *p)
+{
+    uint16 csiconf;
+    memcpy(&csiconf, (uint8 *) p->data + UDP_HEADER_LEN + CSICONF_OFFSET, 2);
+    if (csiconf <= N_SLOTS) {
+        sent[csiconf]++;
+    }
+}
+
+static void
+check(int ok, const char *what)
+{
+    printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+    failed |= !ok;
+}
+
+int
+main(void)
+{
+    uint16 c;
+
+    fake_fw_init();
+    csi_pool_init(fake_wlc_hw->wlc->osh);
+    fake_xmit_hook = count_sent;
+
+    // the first two frames get ages before the wrap, the others after it
+    csi_slot_clock = 0xfffffffe;
+    for (c = 0; c < N_SLOTS; c++) {
+        fake_csi_rx_chunks(c, csi, N_TONES, src_mac, c, 0x88, 0, 1);
+    }
+    // needs a slot, the frame of csiconf 0 is the oldest
+    fake_csi_rx(N_SLOTS, csi, N_TONES, src_mac, N_SLOTS, 0x88);
+    for (c = 0; c < N_SLOTS; c++) {
+        fake_csi_rx_chunks(c, csi, N_TONES, src_mac, c, 0x88, 1, N_TONES);
+    }
+
+    check(sent[N_SLOTS] == 1, "new frame is sent");
+    check(sent[0] == 0, "oldest frame is evicted across the clock wrap");
+    for (c = 1; c < N_SLOTS; c++) {
+        char what[64];
+        snprintf(what, sizeof(what), "frame %d created after the oldest is completed", c);
+        check(sent[c] == 1, what);
+    }
+    printf("%s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
@@ -0,0 +1,77 @@
+#ifndef STRUCTS_H
+#define STRUCTS_H
+
+// only the members the csi extractor uses, the layout does not have to match the firmware
+
+typedef unsigned char uint8;
+typedef signed char int8;
+typedef unsigned short uint16;
+typedef signed short int16;
+typedef unsigned int uint32;
+typedef signed int int32;
+typedef unsigned long long uint64;
+typedef signed long long int64;
+typedef unsigned char bool;
+
+struct sk_buff {
+    void *data;
+    uint16 len;
+};
+
+struct osl_info;
+
+struct phy_info {
+    void *pi_ac;
+};
+
+struct hndrte_dev;
+
+struct hndrte_devfuncs {
+    int (*xmit)(struct hndrte_dev *src, struct hndrte_dev *dev, struct sk_buff *p);
+};
+
+struct hndrte_dev {
+    struct hndrte_dev *chained;
+    struct hndrte_devfuncs *funcs;
+};
+
+struct wl_info {
+    struct wlc_info *wlc;
+    struct hndrte_dev *dev;
+};
+
+struct wlc_band {
+    struct phy_info *pi;
+};
+
+struct wlc_hw_info {
+    struct wlc_info *wlc;
+    struct wlc_band *band;
+    int up;
+};
+
+struct wlc_info {
+    struct osl_info *osh;
+    struct wl_info *wl;
+    struct wlc_hw_info *hw;
+    struct wlc_band *band;
+};
+
+struct ethernet_ip_udp_header {
+    uint8 ethernet[14];
+    uint8 ip[20];
+    uint8 udp[8];
+} __attribute__((packed));
+
+struct hndrte_timer {
+    uint32 *context;
+    void *data;
+    void (*mainfn)(struct hndrte_timer *);
+    void (*auxfn)(void *);
+    int interval;
+    int set;
+    int periodic;
+    bool _freedone;
+};
+
+#endif /*STRUCTS_H*/
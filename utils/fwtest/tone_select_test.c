@@ -0,0 +1,92 @@
+// changes the tone selection of ioctl 509 while a csi frame is reassembled. the frame has to carry
+// the tones of the mask in its descriptor, which is the one that was set when its first chunk arrived
+
+#include <stdio.h>
+#include <string.h>
+#include "fake_fw.h"
+
+#define N_TONES             64
+#define UDP_HEADER_LEN      42
+#define FRAME_HEADER_LEN    70
+#define TONE_DESC_LEN       36
+
+static uint32 csi[N_TONES];
+static const uint8 src_mac[6] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+static uint32 null_mask[8];
+static int frames = 0;
+static int failed = 0;
+
+static void
+check_frame(struct sk_buff *p)
+{
+    const uint8 *frm = (const uint8 *) p->data + UDP_HEADER_LEN;
+    const uint8 *desc = frm + FRAME_HEADER_LEN;
+    uint32 mask[8];
+    uint16 n, flags;
+    int t, i = 0;
+
+    frames++;
+    memcpy(&flags, frm + FRAME_HEADER_LEN - 2, 2);
+    memcpy(&n, desc + 2, 2);
+    memcpy(mask, desc + 4, sizeof(mask));
+    if (!(flags & 0x01) || desc[0] != 2) {
+        printf("frame %d: flags 0x%x, decimation %d instead of tone selection with decimation 2\n", frames, flags, desc[0]);
+        failed = 1;
+        return;
+    }
+    // values of the tones in the mask of the descriptor, in order
+    for (t = 0; t < N_TONES; t++) {
+        if (!(mask[t >> 5] & (1u << (t & 31)))) {
+            continue;
+        }
+        int16 v[2];
+        memcpy(v, desc + TONE_DESC_LEN + i * 4, 4);
+        if (i >= n || v[0] != t || v[1] != -t) {
+            printf("frame %d: value %d is %d%+dj, expected tone %d\n", frames, i, v[0], v[1], t);
+            failed = 1;
+            return;
+        }
+        i++;
+    }
+    if (i != n) {
+        printf("frame %d: %d tones, the mask has %d\n", frames, n, i);
+        failed = 1;
+    }
+}
+
+// the second chunk arrives after ioctl 509 set decimation 4
+static void
+change_decimation(int chunk)
+{
+    if (chunk == 1) {
+        configure_tone_select(4, null_mask);
+    }
+}
+
+int
+main(void)
+{
+    int t;
+
+    fake_fw_init();
+    csi_pool_refill(fake_wlc_hw->wlc->osh);
+    for (t = 0; t < N_TONES; t++) {
+        csi[t] = ((t & 0x3fff) << 14) | (-t & 0x3fff);
+    }
+    fake_xmit_hook = check_frame;
+
+    configure_tone_select(2, null_mask);
+    fake_csi_rx(0, csi, N_TONES, src_mac, 1, 0x88);
+
+    configure_tone_select(2, null_mask);
+    fake_chunk_hook = change_decimation;
+    fake_csi_rx(0, csi, N_TONES, src_mac, 2, 0x88);
+    fake_chunk_hook = 0;
+
+    if (frames != 2) {
+        printf("%d frames sent instead of 2\n", frames);
+        failed = 1;
+    }
+    printf("%s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
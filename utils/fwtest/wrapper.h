@@ -0,0 +1,20 @@
+#ifndef WRAPPER_H
+#define WRAPPER_H
+
+#include <stdio.h>
+#include <string.h>
+#include <structs.h>
+
+// firmware functions used by the csi extractor, implemented in fake_fw.c
+struct sk_buff *pkt_buf_get_skb(struct osl_info *osh, unsigned int len);
+void pkt_buf_free_skb(struct osl_info *osh, struct sk_buff *p, int send);
+void *skb_pull(struct sk_buff *p, unsigned int len);
+unsigned short get_chanspec(struct wlc_info *wlc);
+void wlc_phy_rssi_compute(struct phy_info *pi, void *ctx);
+void wlc_phyreg_enter(struct phy_info *pi);
+void wlc_phyreg_exit(struct phy_info *pi);
+void wlc_phy_stay_in_carriersearch_acphy(struct phy_info *pi, bool enable);
+void wlc_recv(struct wlc_info *wlc, struct sk_buff *p);
+void hndrte_free_timer(struct hndrte_timer *t);
+
+#endif /*WRAPPER_H*/
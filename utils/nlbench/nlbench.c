@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#define NETLINK_USER            31
+#define NEXUDP_IOCTL            0
+#define NEXUDP_IOCTL_BATCH      1
+
+#define MAX_MSG_LEN             (1 << 16)
+
+// see brcmfmac_4.19.y-nexmon/core.c
+struct nexudp_header {
+    char nex[3];
+    char type;
+    int securitycookie;
+} __attribute__((packed));
+
+struct nexudp_ioctl_header {
+    struct nexudp_header nexudphdr;
+    unsigned int cmd;
+    unsigned int set;
+    char payload[1];
+} __attribute__((packed));
+
+struct nexudp_ioctl_entry {
+    unsigned int cmd;
+    unsigned short set;
+    unsigned short len;
+    int status;
+    char payload[0];
+} __attribute__((packed));
+
+struct nexudp_ioctl_batch_header {
+    struct nexudp_header nexudphdr;
+    unsigned int n_entries;
+    struct nexudp_ioctl_entry entries[0];
+} __attribute__((packed));
+
+static uint8_t tx_buf[MAX_MSG_LEN];
+static uint8_t rx_buf[MAX_MSG_LEN];
+
+void usage ()
+{
+    char *usage_str =
+        "Usage: nlbench [OPTION...]\n"
+        "\n"
+        "Measures round trips of nexmon ioctls over netlink. Load brcmfmac with nl_dry_run=1\n"
+        "to measure the netlink path without the firmware.\n"
+        "\n"
+        "   -h           print this message\n"
+        "   -c cmd       ioctl number (default is 0)\n"
+        "   -l len       payload bytes of every ioctl (default is 4)\n"
+        "   -s           set instead of get ioctls\n"
+        "   -n count     number of ioctls (default is 10000)\n"
+        "   -b entries   ioctls per message, 0 for the single ioctl format (default is 0)\n";
+    fprintf (stdout, "%s\n", usage_str);
+}
+
+static double
+now ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// builds the message once, every round trip sends the same one
+static size_t
+build_message (unsigned int cmd, unsigned int len, int set, unsigned int entries)
+{
+    struct nlmsghdr *nlh = (struct nlmsghdr *) tx_buf;
+    struct nexudp_header *hdr = NLMSG_DATA(nlh);
+    size_t payload_len;
+    unsigned int i;
+
+    if (entries == 0) {
+        struct nexudp_ioctl_header *frame = (struct nexudp_ioctl_header *) hdr;
+        payload_len = offsetof(struct nexudp_ioctl_header, payload) + len;
+        if (NLMSG_SPACE(payload_len) > MAX_MSG_LEN) {
+            return 0;
+        }
+        frame->cmd = cmd;
+        frame->set = set;
+    } else {
+        struct nexudp_ioctl_batch_header *batch = (struct nexudp_ioctl_batch_header *) hdr;
+        size_t entry_len = sizeof(struct nexudp_ioctl_entry) + ((len + 3) & ~3u);
+        payload_len = sizeof(*batch) + entries * entry_len;
+        if (len > 0xffff || NLMSG_SPACE(payload_len) > MAX_MSG_LEN) {
+            return 0;
+        }
+        batch->n_entries = entries;
+        for (i = 0; i < entries; i++) {
+            struct nexudp_ioctl_entry *entry = (struct nexudp_ioctl_entry *) ((uint8_t *) batch->entries + i * entry_len);
+            entry->cmd = cmd;
+            entry->set = set;
+            entry->len = len;
+            entry->status = 0;
+        }
+    }
+    memcpy(hdr->nex, "NEX", 3);
+    hdr->type = entries == 0 ? NEXUDP_IOCTL : NEXUDP_IOCTL_BATCH;
+    hdr->securitycookie = 0;
+    nlh->nlmsg_len = NLMSG_LENGTH(payload_len);
+    nlh->nlmsg_pid = getpid();
+    nlh->nlmsg_flags = 0;
+    nlh->nlmsg_type = 0;
+    return nlh->nlmsg_len;
+}
+
+int main (int argc, char **argv)
+{
+    unsigned int cmd = 0, len = 4, entries = 0;
+    long count = 10000;
+    int set = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "hc:l:sn:b:")) != EOF) {
+        switch (c) {
+            case 'h':
+                usage ();
+                return 0;
+            case 'c':
+                cmd = strtoul(optarg, NULL, 0);
+                break;
+            case 'l':
+                len = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                set = 1;
+                break;
+            case 'n':
+                count = strtol(optarg, NULL, 0);
+                break;
+            case 'b':
+                entries = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf (stderr, "Invalid option\n");
+                usage ();
+                return 1;
+        }
+    }
+    size_t msg_len = build_message(cmd, len, set, entries);
+    if (msg_len == 0 || count <= 0) {
+        fprintf (stderr, "Invalid message size or count\n");
+        return 1;
+    }
+
+    int fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_USER);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    struct sockaddr_nl src = { .nl_family = AF_NETLINK, .nl_pid = getpid() };
+    struct sockaddr_nl dst = { .nl_family = AF_NETLINK, .nl_pid = 0 };
+    if (bind(fd, (struct sockaddr *) &src, sizeof(src)) < 0) {
+        perror("bind");
+        close(fd);
+        return 1;
+    }
+
+    unsigned int per_msg = entries ? entries : 1;
+    long round_trips = (count + per_msg - 1) / per_msg;
+    long failed = 0, i;
+    uint32_t seq = 0;
+    double start = now();
+    for (i = 0; i < round_trips; i++) {
+        ((struct nlmsghdr *) tx_buf)->nlmsg_seq = seq++;
+        if (sendto(fd, tx_buf, msg_len, 0, (struct sockaddr *) &dst, sizeof(dst)) < 0) {
+            perror("sendto");
+            break;
+        }
+        ssize_t rx_len = recv(fd, rx_buf, sizeof(rx_buf), 0);
+        if (rx_len < 0) {
+            perror("recv");
+            break;
+        }
+        if (entries) {
+            struct nlmsghdr *nlh = (struct nlmsghdr *) rx_buf;
+            struct nexudp_ioctl_batch_header *batch = NLMSG_DATA(nlh);
+            if (!NLMSG_OK(nlh, rx_len) || NLMSG_PAYLOAD(nlh, 0) < sizeof(*batch) || batch->n_entries != entries) {
+                failed++;
+            }
+        }
+    }
+    double elapsed = now() - start;
+    close(fd);
+
+    if (i == 0 || elapsed <= 0) {
+        return 1;
+    }
+    fprintf (stdout, "%ld round trips in %.3f s: %.0f round trips/s, %.0f ioctls/s\n",
+        i, elapsed, i / elapsed, i * per_msg / elapsed);
+    if (failed) {
+        fprintf (stdout, "%ld incomplete replies\n", failed);
+    }
+    return i < round_trips;
+}